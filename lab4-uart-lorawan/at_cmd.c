@@ -0,0 +1,102 @@
+//
+// One command is on the wire at a time: the module answers in order and has no command buffer.
+//
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "at_cmd.h"
+
+static at_cmd *queue[AT_QUEUE_LEN];
+static int queue_head = 0; // command on the wire, or next to go
+static int queue_count = 0;
+static bool sent = false; // head command has been sent and its response is being framed
+static iuart_response response;
+static int uart = 0;
+
+// what the module prints after a reset it did not get from us; echo, garbage and other unsolicited
+// lines are not a reason to think it has changed
+static const char *const restart_lines[] = { "+RESET:", "+FACTORY:" };
+
+void at_init(int uart_nr)
+{
+    uart = uart_nr;
+    queue_head = 0;
+    queue_count = 0;
+    sent = false;
+}
+
+bool at_submit(at_cmd *c, const char *cmd, const char *expect)
+{
+    if (queue_count == AT_QUEUE_LEN) return false;
+    for (int i = 0; i < queue_count; ++i)
+    {
+        if (queue[(queue_head + i) % AT_QUEUE_LEN] == c) return false; // slot still in use
+    }
+    c->cmd = cmd;
+    c->expect = expect;
+    c->tries = 0;
+    c->status = IUART_RESPONSE_PENDING;
+    c->response[0] = '\0';
+    c->queued_us = time_us_32();
+    queue[(queue_head + queue_count) % AT_QUEUE_LEN] = c;
+    ++queue_count;
+    at_poll(); // send right away if nothing is on the wire
+    return true;
+}
+
+static void send_head(void)
+{
+    at_cmd *c = queue[queue_head];
+    ++c->tries;
+    iuart_response_start(&response, c->expect, AT_TIMEOUT_US);
+    iuart_send(uart, c->cmd);
+    sent = true;
+}
+
+static bool module_restarted(const char *text)
+{
+    for (const char *line = text; *line;)
+    {
+        for (size_t i = 0; i < sizeof(restart_lines) / sizeof(restart_lines[0]); ++i)
+        {
+            if (!strncmp(line, restart_lines[i], strlen(restart_lines[i]))) return true;
+        }
+        const char *end = strchr(line, '\n');
+        if (!end) break;
+        line = end + 1;
+    }
+    return false;
+}
+
+void at_poll(void)
+{
+    if (!queue_count) return;
+    if (!sent)
+    {
+        send_head();
+        return;
+    }
+
+    at_cmd *c = queue[queue_head];
+    iuart_response_status status = iuart_response_poll(uart, &response);
+    if (status == IUART_RESPONSE_PENDING) return;
+    if (status == IUART_RESPONSE_TIMEOUT && c->tries < AT_RETRIES)
+    {
+        send_head(); // no answer, send again
+        return;
+    }
+
+    strcpy(c->response, response.match);
+    c->restarted = module_restarted(response.text);
+    c->done_us = time_us_32();
+    c->status = status;
+    sent = false;
+    queue_head = (queue_head + 1) % AT_QUEUE_LEN;
+    --queue_count;
+    if (queue_count) send_head(); // next one goes out without a gap
+}
+
+bool at_busy(void)
+{
+    return queue_count > 0;
+}
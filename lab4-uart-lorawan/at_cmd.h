@@ -0,0 +1,40 @@
+//
+// AT command queue for the LoRa module. Commands wait in a queue and the next one is sent as soon
+// as the previous response is complete. at_poll() advances the queue; nothing blocks.
+//
+
+#ifndef AT_CMD_H
+#define AT_CMD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "iuart.h"
+
+#define AT_QUEUE_LEN 4
+#define AT_RETRIES 5 // sends per command before it fails
+#define AT_TIMEOUT_US 500000 // per send
+
+typedef struct at_cmd {
+    const char *cmd; // with "\r\n"
+    const char *expect; // response line prefix, see iuart_response
+    int tries;
+    iuart_response_status status; // PENDING while queued or running, then the result
+    char response[IUART_LINE_LEN]; // matched line
+    bool restarted; // a line received with it says the module has started again, see at_cmd.c
+    uint32_t queued_us;
+    uint32_t done_us; // done_us - queued_us is the command latency
+} at_cmd;
+
+void at_init(int uart_nr);
+// the command and result slot must stay valid until the status is no longer PENDING,
+// false if the queue is full or the slot is still queued
+bool at_submit(at_cmd *c, const char *cmd, const char *expect);
+void at_poll(void); // call often
+bool at_busy(void);
+
+static inline bool at_done(const at_cmd *c)
+{
+    return c->status != IUART_RESPONSE_PENDING;
+}
+
+#endif //AT_CMD_H
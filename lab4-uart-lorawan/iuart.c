@@ -1,144 +1,467 @@
-//
-// Created by keijo on 4.11.2023.
-//
-#include <string.h>
-#include "pico/stdlib.h"
-#include "hardware/uart.h"
-#include "pico/util/queue.h"
-
-#include "iuart.h"
-
-typedef struct {
-    queue_t tx;
-    queue_t rx;
-    uart_inst_t *uart;
-    int irqn;
-    irq_handler_t handler;
-} uart_t;
-
-void uart_irq_rx(uart_t *u);
-void uart_irq_tx(uart_t *u);
-void uart0_handler(void);
-void uart1_handler(void);
-
-static uart_t *uart_get_handle(int uart_nr);
-
-static uart_t u0 = { .uart = uart0, .irqn = UART0_IRQ, .handler = uart0_handler };
-static uart_t u1 = { .uart = uart1, .irqn = UART1_IRQ, .handler = uart1_handler };
-
-static uart_t *uart_get_handle(int uart_nr) {
-    return uart_nr ? &u1 : &u0;
-}
-
-
-void iuart_setup(int uart_nr, int tx_pin, int rx_pin, int speed)
-{
-    uart_t *uart = uart_get_handle(uart_nr);
-
-    // ensure that we don't get any interrupts from the uart during configuration
-    irq_set_enabled(uart->irqn, false);
-
-    // allocate space for ring buffers
-    queue_init(&uart->rx, 1, 256);
-    queue_init(&uart->tx, 1, 256);
-
-    // Set up our UART with the required speed.
-    uart_init(uart->uart, speed);
-
-    // Set the TX and RX pins by using the function select on the GPIO
-    // See datasheet for more information on function select
-    gpio_set_function(tx_pin, GPIO_FUNC_UART);
-    gpio_set_function(rx_pin, GPIO_FUNC_UART);
-
-    irq_set_exclusive_handler(uart->irqn, uart->handler);
-
-    // Now enable the UART to send interrupts - RX only
-    uart_set_irq_enables(uart->uart, true, false);
-    //uart_set_irq_enables(uart->uart, true, true);
-    // enable UART0 interrupts on NVIC
-    irq_set_enabled(uart->irqn, true);
-}
-
-int iuart_read(int uart_nr, uint8_t *buffer, int size)
-{
-    int count = 0;
-    uart_t *u = uart_get_handle(uart_nr);
-    while(count < size && !queue_is_empty(&u->rx)) {
-        queue_remove_blocking(&u->rx, buffer++);
-        ++count;
-    }
-    return count;
-}
-
-int iuart_write(int uart_nr, const uint8_t *buffer, int size)
-{
-    int count = 0;
-    uart_t *u = uart_get_handle(uart_nr);
-    // write data to ring buffer
-    while(count < size && !queue_is_full(&u->tx)) {
-        queue_add_blocking(&u->tx, buffer++);
-        ++count;
-    }
-    // disable interrupts on NVIC while managing transmit interrupts
-    irq_set_enabled(u->irqn, false);
-#if 1
-    // if transmit interrupt is not enabled we need to enable it and give fifo an initial filling
-    if(!(uart_get_hw(u->uart)->imsc & (1 << UART_UARTIMSC_TXIM_LSB))) {
-        // enable transmit interrupt
-        uart_set_irq_enables(u->uart, true, true);
-        // fifo requires initial filling
-        uart_irq_tx(u);
-    }
-#else
-    uart_irq_tx(u);
-#endif
-    // enable interrupts on NVIC
-    irq_set_enabled(u->irqn, true);
-
-    return count;
-}
-
-int iuart_send(int uart_nr, const char *str)
-{
-    return iuart_write(uart_nr, (const uint8_t *)str, strlen(str));
-}
-
-
-void uart_irq_rx(uart_t *u)
-{
-    while(uart_is_readable(u->uart)) {
-        uint8_t c = uart_getc(u->uart);
-        // ignoring return value for now
-        queue_try_add(&u->rx, &c);
-    }
-}
-
-void uart_irq_tx(uart_t *u)
-{
-    while(!queue_is_empty(&u->tx) && uart_is_writable(u->uart)) {
-        uint8_t c;
-        queue_try_remove(&u->tx, &c);
-        uart_get_hw(u->uart)->dr = c;
-    }
-#if 1
-    if (queue_is_empty(&u->tx)) {
-        // disable tx interrupt if transmit buffer is empty
-        uart_set_irq_enables(u->uart, true, false);
-    }
-#else
-    // acknowledge transmit interrupt
-    uart_get_hw(u->uart)->icr = (1 << UART_UARTIMSC_TXIM_LSB);
-#endif
-}
-
-void uart0_handler(void)
-{
-    uart_irq_rx(&u0);
-    uart_irq_tx(&u0);
-}
-
-void uart1_handler(void)
-{
-    uart_irq_rx(&u1);
-    uart_irq_tx(&u1);
-}
+//
+// Created by keijo on 4.11.2023.
+//
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "hardware/sync.h"
+#include "hardware/dma.h"
+
+#include "iuart.h"
+#include "ring.h"
+
+#ifndef IUART_DMA
+#define IUART_DMA 0 // 1: DMA moves the data, 0: FIFO interrupts do
+#endif
+
+#define RX_REARM 0x80000000u // restart the RX channel before its transfer count runs out
+#define RX_SYNC_MIN_US 20 // shortest period of the RX sync timer
+
+// The ISR fills rx and empties tx, iuart_read/iuart_write do the opposite, see ring.h.
+// In DMA mode the RX channel writes the ring in a circle and the head follows its write pointer.
+// The TX channel sends straight from the ring, one contiguous piece at a time, and the tail
+// moves when the piece is done.
+typedef struct {
+    ring_t tx;
+    ring_t rx;
+    uart_inst_t *uart;
+    int irqn;
+    irq_handler_t handler;
+    iuart_stats stats; // rx fields are written by the receiving side only, tx fields by iuart_write
+#if IUART_DMA
+    bool dma_claimed;
+    int rx_chan;
+    int tx_chan;
+    uint32_t tx_len; // bytes in the TX transfer, 0 when the channel is idle
+    repeating_timer_t rx_timer; // moves the RX head, see iuart_setup_buffers
+    volatile uint32_t rx_floor; // oldest byte the RX channel has not overwritten, written by dma_rx_sync
+#endif
+} uart_t;
+
+void uart_irq_rx(uart_t *u);
+void uart_irq_tx(uart_t *u);
+void uart0_handler(void);
+void uart1_handler(void);
+#if IUART_DMA
+void dma_handler(void);
+static void dma_setup(uart_t *u);
+static void dma_rx_sync(uart_t *u);
+static void dma_tx_start(uart_t *u);
+static bool rx_timer_callback(repeating_timer_t *t);
+#endif
+
+static uart_t *uart_get_handle(int uart_nr);
+
+static uart_t u0 = { .uart = uart0, .irqn = UART0_IRQ, .handler = uart0_handler };
+static uart_t u1 = { .uart = uart1, .irqn = UART1_IRQ, .handler = uart1_handler };
+
+static uart_t *uart_get_handle(int uart_nr) {
+    return uart_nr ? &u1 : &u0;
+}
+
+// keeps the interrupts that write the rx side and the stats away, in DMA mode that includes the sync timer
+static uint32_t rx_lock(uart_t *u)
+{
+#if IUART_DMA
+    (void)u;
+    return save_and_disable_interrupts();
+#else
+    irq_set_enabled(u->irqn, false);
+    return 0;
+#endif
+}
+
+static void rx_unlock(uart_t *u, uint32_t saved)
+{
+#if IUART_DMA
+    (void)u;
+    restore_interrupts(saved);
+#else
+    (void)saved;
+    irq_set_enabled(u->irqn, true);
+#endif
+}
+
+
+bool iuart_setup(int uart_nr, int tx_pin, int rx_pin, int speed)
+{
+    return iuart_setup_buffers(uart_nr, tx_pin, rx_pin, speed, IUART_DEFAULT_SIZE, IUART_DEFAULT_SIZE);
+}
+
+bool iuart_setup_buffers(int uart_nr, int tx_pin, int rx_pin, int speed, int rx_size, int tx_size)
+{
+    uart_t *uart = uart_get_handle(uart_nr);
+
+    // ensure that we don't get any interrupts from the uart during configuration
+    irq_set_enabled(uart->irqn, false);
+#if IUART_DMA
+    if (uart->dma_claimed) {
+        // set up again: stop the timer and the channels before their buffers go
+        cancel_repeating_timer(&uart->rx_timer);
+        dma_channel_abort(uart->rx_chan);
+        dma_channel_abort(uart->tx_chan);
+    }
+#endif
+
+    // allocate space for ring buffers
+    memset(&uart->stats, 0, sizeof(uart->stats));
+    uart->stats.rx_size = ring_init(&uart->rx, rx_size, IUART_DMA);
+    uart->stats.tx_size = ring_init(&uart->tx, tx_size, false);
+    if (!uart->stats.rx_size || !uart->stats.tx_size) {
+        printf("UART%d: no memory for %d + %d bytes of buffers, the UART is left off\n", uart_nr, rx_size, tx_size);
+        return false;
+    }
+
+    // Set up our UART with the required speed.
+    uart_init(uart->uart, speed);
+
+    // Set the TX and RX pins by using the function select on the GPIO
+    // See datasheet for more information on function select
+    gpio_set_function(tx_pin, GPIO_FUNC_UART);
+    gpio_set_function(rx_pin, GPIO_FUNC_UART);
+
+    irq_set_exclusive_handler(uart->irqn, uart->handler);
+
+#if IUART_DMA
+    dma_setup(uart);
+    // The RX DREQ keeps the FIFO empty, so the receive timeout interrupt never fires. A timer moves
+    // the head instead, a few times per lap of the ring at the line rate, so the channel can't get a
+    // whole lap ahead between two syncs. The UART interrupt is left for FIFO overruns, which happen
+    // only while the RX channel is stopped.
+    uint64_t lap_us = (uint64_t)(uart->rx.mask + 1) * 10 * 1000000 / speed;
+    int64_t sync_us = lap_us / 4 > RX_SYNC_MIN_US ? lap_us / 4 : RX_SYNC_MIN_US;
+    add_repeating_timer_us(-sync_us, rx_timer_callback, uart, &uart->rx_timer);
+    uart_get_hw(uart->uart)->imsc = UART_UARTIMSC_OEIM_BITS;
+#else
+    // Now enable the UART to send interrupts - RX only
+    uart_set_irq_enables(uart->uart, true, false);
+    //uart_set_irq_enables(uart->uart, true, true);
+#endif
+    // enable UART0 interrupts on NVIC
+    irq_set_enabled(uart->irqn, true);
+    return true;
+}
+
+int iuart_read(int uart_nr, uint8_t *buffer, int size)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+#if IUART_DMA
+    // the sync timer moves the head too
+    uint32_t irq = rx_lock(u);
+    dma_rx_sync(u);
+    // the channel went past unread bytes: go on from the oldest one it left, the rest are counted as dropped
+    if ((int32_t)(u->rx_floor - u->rx.tail) > 0) u->rx.tail = u->rx_floor;
+    int n = ring_get(&u->rx, buffer, size);
+    rx_unlock(u, irq);
+    return n;
+#else
+    return ring_get(&u->rx, buffer, size);
+#endif
+}
+
+int iuart_write(int uart_nr, const uint8_t *buffer, int size)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    // write data to ring buffer
+    int count = ring_put(&u->tx, buffer, size);
+    uint32_t level = ring_count(&u->tx);
+    u->stats.tx_bytes += count;
+    u->stats.tx_drops += size - count;
+    if (level > u->stats.tx_high_water) u->stats.tx_high_water = level;
+#if IUART_DMA
+    // the completion interrupt starts the next piece, only an idle channel needs a start here
+    irq_set_enabled(DMA_IRQ_0, false);
+    if (!u->tx_len) dma_tx_start(u);
+    irq_set_enabled(DMA_IRQ_0, true);
+#else
+    // disable interrupts on NVIC while managing transmit interrupts
+    irq_set_enabled(u->irqn, false);
+#if 1
+    // if transmit interrupt is not enabled we need to enable it and give fifo an initial filling
+    if(!(uart_get_hw(u->uart)->imsc & (1 << UART_UARTIMSC_TXIM_LSB))) {
+        // enable transmit interrupt
+        uart_set_irq_enables(u->uart, true, true);
+        // fifo requires initial filling
+        uart_irq_tx(u);
+    }
+#else
+    uart_irq_tx(u);
+#endif
+    // enable interrupts on NVIC
+    irq_set_enabled(u->irqn, true);
+#endif
+
+    return count;
+}
+
+int iuart_send(int uart_nr, const char *str)
+{
+    return iuart_write(uart_nr, (const uint8_t *)str, strlen(str));
+}
+
+void iuart_get_stats(int uart_nr, iuart_stats *stats)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    // copied with interrupts off so the rx counters belong together
+    uint32_t irq = rx_lock(u);
+#if IUART_DMA
+    dma_rx_sync(u);
+#endif
+    *stats = u->stats;
+    rx_unlock(u, irq);
+}
+
+void iuart_response_start(iuart_response *r, const char *expect, uint32_t timeout_us)
+{
+    r->expect = expect;
+    r->status = IUART_RESPONSE_PENDING;
+    r->text[0] = '\0';
+    r->len = 0;
+    r->match[0] = '\0';
+    r->line_len = 0;
+    r->start_us = time_us_32();
+    r->timeout_us = timeout_us;
+}
+
+static bool line_is_error(const char *line)
+{
+    return strstr(line, "ERROR") != NULL;
+}
+
+static void response_line(iuart_response *r)
+{
+    r->line[r->line_len] = '\0';
+    int n = r->line_len;
+    r->line_len = 0;
+    if (n == 0) return; // blank line between responses
+
+    // keep the line, the newest lines are kept if they don't all fit
+    if (r->len + n + 1 >= IUART_RESPONSE_LEN) r->len = 0;
+    memcpy(&r->text[r->len], r->line, n);
+    r->len += n;
+    r->text[r->len++] = '\n';
+    r->text[r->len] = '\0';
+
+    if (r->status != IUART_RESPONSE_PENDING) return; // trailing lines of a finished response
+    if (line_is_error(r->line)) r->status = IUART_RESPONSE_ERROR;
+    else if (!strncmp(r->line, r->expect, strlen(r->expect))) r->status = IUART_RESPONSE_OK;
+    else return;
+    memcpy(r->match, r->line, n + 1);
+}
+
+iuart_response_status iuart_response_feed(iuart_response *r, const uint8_t *data, int len)
+{
+    for (int i = 0; i < len; ++i) {
+        char c = (char) data[i];
+        if (c == '\n') response_line(r);
+        else if (c == '\r') continue;
+        else if (r->line_len < IUART_LINE_LEN - 1) r->line[r->line_len++] = c; // overlong lines are cut
+    }
+    return r->status;
+}
+
+iuart_response_status iuart_response_poll(int uart_nr, iuart_response *r)
+{
+    uint8_t buffer[32];
+    int n;
+    // everything waiting is taken, lines after the match belong to the same response
+    while ((n = iuart_read(uart_nr, buffer, sizeof(buffer))) > 0) {
+        iuart_response_feed(r, buffer, n);
+    }
+    if (r->status == IUART_RESPONSE_PENDING && time_us_32() - r->start_us > r->timeout_us) {
+        r->status = IUART_RESPONSE_TIMEOUT;
+    }
+    return r->status;
+}
+
+void iuart_clear_stats(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    uint32_t irq = rx_lock(u);
+    uint32_t rx_size = u->stats.rx_size;
+    uint32_t tx_size = u->stats.tx_size;
+    memset(&u->stats, 0, sizeof(u->stats));
+    u->stats.rx_size = rx_size;
+    u->stats.tx_size = tx_size;
+    rx_unlock(u, irq);
+}
+
+
+void uart_irq_rx(uart_t *u)
+{
+    // drain the whole FIFO, the new head is published once for the burst
+    uart_hw_t *hw = uart_get_hw(u->uart);
+    ring_t *r = &u->rx;
+    uint32_t head = r->head;
+    uint32_t end = r->tail + r->mask + 1;
+    while(uart_is_readable(u->uart)) {
+        uint32_t dr = hw->dr; // error flags come with the byte they belong to
+        if (dr & UART_UARTDR_OE_BITS) ++u->stats.rx_overruns;
+        if (dr & (UART_UARTDR_BE_BITS | UART_UARTDR_PE_BITS | UART_UARTDR_FE_BITS)) ++u->stats.rx_errors;
+        if (head != end) r->data[head++ & r->mask] = (uint8_t) dr;
+        else ++u->stats.rx_drops; // buffer full
+    }
+    u->stats.rx_bytes += head - r->head;
+    if (head - r->tail > u->stats.rx_high_water) u->stats.rx_high_water = head - r->tail;
+    __dmb();
+    r->head = head;
+}
+
+void uart_irq_tx(uart_t *u)
+{
+    // fill the FIFO from the ring, the new tail is published once for the burst
+    uart_hw_t *hw = uart_get_hw(u->uart);
+    ring_t *r = &u->tx;
+    uint32_t tail = r->tail;
+    uint32_t head = r->head;
+    __dmb();
+    while(tail != head && uart_is_writable(u->uart)) {
+        hw->dr = r->data[tail++ & r->mask];
+    }
+    __dmb();
+    r->tail = tail;
+#if 1
+    if (ring_count(r) == 0) {
+        // disable tx interrupt if transmit buffer is empty
+        uart_set_irq_enables(u->uart, true, false);
+    }
+#else
+    // acknowledge transmit interrupt
+    uart_get_hw(u->uart)->icr = (1 << UART_UARTIMSC_TXIM_LSB);
+#endif
+}
+
+#if IUART_DMA
+static void dma_setup(uart_t *u)
+{
+    uart_get_hw(u->uart)->dmacr = UART_UARTDMACR_TXDMAE_BITS | UART_UARTDMACR_RXDMAE_BITS;
+
+    if (!u->dma_claimed) {
+        u->rx_chan = dma_claim_unused_channel(true);
+        u->tx_chan = dma_claim_unused_channel(true);
+        u->dma_claimed = true;
+    }
+
+    // RX: data register to the ring, the write address wraps at the ring size
+    uint ring_bits = 0;
+    while ((1u << ring_bits) <= u->rx.mask) ++ring_bits;
+    dma_channel_config c = dma_channel_get_default_config(u->rx_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, ring_bits);
+    channel_config_set_dreq(&c, uart_get_dreq(u->uart, false));
+    dma_channel_configure(u->rx_chan, &c, u->rx.data, &uart_get_hw(u->uart)->dr, UINT32_MAX, true);
+
+    // TX: ring to the data register, configured now and started by dma_tx_start
+    c = dma_channel_get_default_config(u->tx_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(u->uart, true));
+    dma_channel_configure(u->tx_chan, &c, &uart_get_hw(u->uart)->dr, u->tx.data, 0, false);
+    u->tx_len = 0;
+    u->rx_floor = 0;
+
+    static bool dma_irq_added = false;
+    if (!dma_irq_added) {
+        irq_add_shared_handler(DMA_IRQ_0, dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+        dma_irq_added = true;
+    }
+    dma_channel_set_irq0_enabled(u->tx_chan, true);
+}
+
+// head is the DMA write pointer plus the laps it has made, the sync timer runs often enough that the
+// channel is never a whole lap ahead of the last sync
+static void dma_rx_sync(uart_t *u)
+{
+    dma_channel_hw_t *ch = dma_channel_hw_addr(u->rx_chan);
+    uart_hw_t *hw = uart_get_hw(u->uart);
+    ring_t *r = &u->rx;
+    uint32_t pos = ch->write_addr - (uint32_t)(uintptr_t)r->data;
+    uint32_t received = (pos - r->head) & r->mask;
+    __dmb();
+
+    // DMA reads only the data byte, error flags are picked up from the status register
+    uint32_t rsr = hw->rsr;
+    if (rsr & UART_UARTRSR_OE_BITS) ++u->stats.rx_overruns;
+    if (rsr & (UART_UARTRSR_BE_BITS | UART_UARTRSR_PE_BITS | UART_UARTRSR_FE_BITS)) ++u->stats.rx_errors;
+    if (rsr) hw->rsr = 0; // any write clears them
+
+    // The channel never stops: what went past the unread data has overwritten it. Unread bytes start at
+    // the tail, or at the floor if an earlier sync has already counted the ones below it as dropped.
+    uint32_t start = (int32_t)(u->rx_floor - r->tail) > 0 ? u->rx_floor : r->tail;
+    uint32_t level = r->head + received - start;
+    if (level > r->mask + 1) {
+        u->stats.rx_drops += level - (r->mask + 1);
+        level = r->mask + 1;
+        u->rx_floor = r->head + received - level;
+    }
+    u->stats.rx_bytes += received;
+    if (level > u->stats.rx_high_water) u->stats.rx_high_water = level;
+    r->head += received;
+    if (ch->transfer_count < RX_REARM) {
+        // a few billion bytes later: carry on from the same place with a fresh count
+        dma_channel_abort(u->rx_chan);
+        dma_channel_set_write_addr(u->rx_chan, &r->data[pos & r->mask], false);
+        dma_channel_set_trans_count(u->rx_chan, UINT32_MAX, true);
+    }
+}
+
+static void dma_tx_start(uart_t *u)
+{
+    ring_t *r = &u->tx;
+    uint32_t tail = r->tail;
+    uint32_t n = ring_count(r);
+    uint32_t first = r->mask + 1 - (tail & r->mask); // contiguous up to the wrap
+    if (n > first) n = first;
+    u->tx_len = n;
+    if (n) dma_channel_transfer_from_buffer_now(u->tx_chan, &r->data[tail & r->mask], n);
+}
+
+void dma_handler(void)
+{
+    uart_t *uarts[] = { &u0, &u1 };
+    for (int i = 0; i < 2; ++i) {
+        uart_t *u = uarts[i];
+        if (!u->tx_len || !dma_channel_get_irq0_status(u->tx_chan)) continue;
+        dma_channel_acknowledge_irq0(u->tx_chan);
+        __dmb();
+        u->tx.tail += u->tx_len; // piece sent, the writer may reuse the space
+        dma_tx_start(u);
+    }
+}
+
+static bool rx_timer_callback(repeating_timer_t *t)
+{
+    dma_rx_sync((uart_t *)t->user_data);
+    return true; // keep repeating
+}
+
+void uart0_handler(void)
+{
+    uart_get_hw(u0.uart)->icr = UART_UARTICR_OEIC_BITS;
+    dma_rx_sync(&u0);
+}
+
+void uart1_handler(void)
+{
+    uart_get_hw(u1.uart)->icr = UART_UARTICR_OEIC_BITS;
+    dma_rx_sync(&u1);
+}
+#else
+void uart0_handler(void)
+{
+    uart_irq_rx(&u0);
+    uart_irq_tx(&u0);
+}
+
+void uart1_handler(void)
+{
+    uart_irq_rx(&u1);
+    uart_irq_tx(&u1);
+}
+#endif
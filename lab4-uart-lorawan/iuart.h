@@ -1,14 +1,66 @@
-//
-// Created by keijo on 4.11.2023.
-//
-
-#ifndef UART_IRQ_UART_H
-#define UART_IRQ_UART_H
-
-
-void iuart_setup(int uart_nr, int tx_pin, int rx_pin, int speed);
-int iuart_read(int uart_nr, uint8_t *buffer, int size);
-int iuart_write(int uart_nr, const uint8_t *buffer, int size);
-int iuart_send(int uart_nr, const char *str);
-
-#endif //UART_IRQ_UART_H
+//
+// Created by keijo on 4.11.2023.
+//
+
+#ifndef UART_IRQ_UART_H
+#define UART_IRQ_UART_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IUART_DEFAULT_SIZE 256 // ring buffer bytes per direction for iuart_setup
+
+typedef struct iuart_stats {
+    uint32_t rx_bytes; // received into the RX buffer
+    uint32_t tx_bytes; // taken into the TX buffer by iuart_write
+    uint32_t rx_overruns; // hardware FIFO overruns, bytes were lost before the buffer
+    uint32_t rx_errors; // framing, parity and break errors
+    uint32_t rx_drops; // received bytes that did not fit the RX buffer
+    uint32_t tx_drops; // bytes iuart_write could not take
+    uint32_t rx_high_water; // most bytes waiting in the RX buffer
+    uint32_t tx_high_water;
+    uint32_t rx_size; // buffer sizes in use
+    uint32_t tx_size;
+} iuart_stats;
+
+// false if there was no memory for the buffers, the UART is left off then
+bool iuart_setup(int uart_nr, int tx_pin, int rx_pin, int speed);
+// buffer sizes are rounded up to a power of two
+bool iuart_setup_buffers(int uart_nr, int tx_pin, int rx_pin, int speed, int rx_size, int tx_size);
+int iuart_read(int uart_nr, uint8_t *buffer, int size);
+int iuart_write(int uart_nr, const uint8_t *buffer, int size);
+int iuart_send(int uart_nr, const char *str);
+void iuart_get_stats(int uart_nr, iuart_stats *stats);
+void iuart_clear_stats(int uart_nr);
+
+// Response framing: received bytes are assembled into "\r\n" terminated lines and each complete line
+// is matched against the expected prefix. Lines before it (echo, unsolicited output) are kept in text.
+#define IUART_RESPONSE_LEN 256
+#define IUART_LINE_LEN 128
+
+typedef enum {
+    IUART_RESPONSE_PENDING,
+    IUART_RESPONSE_OK, // line starting with the expected prefix
+    IUART_RESPONSE_ERROR, // that line or any other reported an error
+    IUART_RESPONSE_TIMEOUT
+} iuart_response_status;
+
+typedef struct iuart_response {
+    const char *expect; // e.g. "+AT: OK", "+VER:", "+ID: DevEui"
+    iuart_response_status status;
+    char text[IUART_RESPONSE_LEN]; // complete lines, "\n" separated
+    int len;
+    char match[IUART_LINE_LEN]; // the line that ended the response
+    char line[IUART_LINE_LEN]; // line being assembled
+    int line_len;
+    uint32_t start_us;
+    uint32_t timeout_us;
+} iuart_response;
+
+void iuart_response_start(iuart_response *r, const char *expect, uint32_t timeout_us);
+// feed received bytes, returns the status after them
+iuart_response_status iuart_response_feed(iuart_response *r, const uint8_t *data, int len);
+// read what the UART has and feed it, PENDING until a full response or the timeout
+iuart_response_status iuart_response_poll(int uart_nr, iuart_response *r);
+
+#endif //UART_IRQ_UART_H
@@ -0,0 +1,160 @@
+//
+// Parsers for the identity lines of the LoRa module.
+//
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "lora_info.h"
+
+#ifndef LORA_CACHE_FLASH
+#define LORA_CACHE_FLASH 0 // 1: keep the identity in flash too
+#endif
+
+#define CACHE_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE) // last sector, clear of the program
+#define CACHE_MAGIC 0x4C6F5261 // "LoRa"
+
+typedef struct cache_record {
+    uint32_t magic;
+    lora_info info;
+    uint32_t check;
+} cache_record;
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// exactly len bytes of hex pairs, optionally ':' separated, nothing but spaces after them
+static bool parse_hex(const char *s, uint8_t *out, int len)
+{
+    uint8_t bytes[EUI_LEN];
+    for (int i = 0; i < len; ++i)
+    {
+        if (i && *s == ':') ++s;
+        int hi = hex_digit(s[0]);
+        int lo = hi < 0 ? -1 : hex_digit(s[1]);
+        if (lo < 0) return false;
+        bytes[i] = (uint8_t)(hi << 4 | lo);
+        s += 2;
+    }
+    while (*s == ' ') ++s;
+    if (*s != '\0') return false;
+    memcpy(out, bytes, len); // only a complete value replaces the old one
+    return true;
+}
+
+bool lora_parse_version(const char *line, lora_info *info)
+{
+    const char *prefix = "+VER: ";
+    if (strncmp(line, prefix, strlen(prefix))) return false;
+    const char *s = line + strlen(prefix);
+    uint8_t version[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        if (i && *s++ != '.') return false;
+        if (*s < '0' || *s > '9') return false;
+        unsigned v = 0;
+        while (*s >= '0' && *s <= '9') v = v * 10 + (unsigned)(*s++ - '0');
+        if (v > 255) return false;
+        version[i] = (uint8_t)v;
+    }
+    memcpy(info->version, version, sizeof(version));
+    info->valid |= LORA_HAVE_VERSION;
+    return true;
+}
+
+bool lora_parse_id(const char *line, lora_info *info)
+{
+    const char *prefix = "+ID: ";
+    if (strncmp(line, prefix, strlen(prefix))) return false;
+    const char *s = line + strlen(prefix);
+
+    if (!strncmp(s, "DevEui, ", 8))
+    {
+        if (!parse_hex(s + 8, info->dev_eui, EUI_LEN)) return false;
+        info->valid |= LORA_HAVE_DEV_EUI;
+    }
+    else if (!strncmp(s, "AppEui, ", 8))
+    {
+        if (!parse_hex(s + 8, info->app_eui, EUI_LEN)) return false;
+        info->valid |= LORA_HAVE_APP_EUI;
+    }
+    else if (!strncmp(s, "DevAddr, ", 9))
+    {
+        if (!parse_hex(s + 9, info->dev_addr, DEV_ADDR_LEN)) return false;
+        info->valid |= LORA_HAVE_DEV_ADDR;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+static uint32_t cache_check(const lora_info *info)
+{
+    // FNV-1a over the struct, an erased or half written sector does not pass
+    const uint8_t *p = (const uint8_t *)info;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(*info); ++i) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+bool lora_cache_load(lora_info *info)
+{
+#if LORA_CACHE_FLASH
+    const cache_record *r = (const cache_record *)(XIP_BASE + CACHE_OFFSET);
+    if (r->magic != CACHE_MAGIC || r->check != cache_check(&r->info) || r->info.valid != LORA_HAVE_ALL) return false;
+    *info = r->info;
+    return true;
+#else
+    (void)info;
+    return false;
+#endif
+}
+
+void lora_cache_store(const lora_info *info)
+{
+#if LORA_CACHE_FLASH
+    lora_info cached;
+    if (lora_cache_load(&cached) && !memcmp(&cached, info, sizeof(cached))) return; // same module, spare the flash
+    static uint8_t page[FLASH_PAGE_SIZE];
+    cache_record r = { .magic = CACHE_MAGIC, .info = *info, .check = cache_check(info) };
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, &r, sizeof(r));
+    // code runs from flash: nothing may execute from it while the sector is rewritten
+    uint32_t irq = save_and_disable_interrupts();
+    flash_range_erase(CACHE_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(CACHE_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(irq);
+#else
+    (void)info;
+#endif
+}
+
+void lora_cache_clear(void)
+{
+#if LORA_CACHE_FLASH
+    const cache_record *r = (const cache_record *)(XIP_BASE + CACHE_OFFSET);
+    if (r->magic != CACHE_MAGIC) return; // already clear
+    uint32_t irq = save_and_disable_interrupts();
+    flash_range_erase(CACHE_OFFSET, FLASH_SECTOR_SIZE);
+    restore_interrupts(irq);
+#endif
+}
+
+void lora_format_hex(char *out, const uint8_t *bytes, int len)
+{
+    const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < len; ++i)
+    {
+        *out++ = digits[bytes[i] >> 4];
+        *out++ = digits[bytes[i] & 0x0F];
+    }
+    *out = '\0';
+}
@@ -0,0 +1,41 @@
+//
+// Module identity parsed from AT responses into binary fields. The parsers read the response line
+// where it is and write only the struct, uplink code uses the bytes without asking the module again.
+//
+
+#ifndef LORA_INFO_H
+#define LORA_INFO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EUI_LEN 8
+#define DEV_ADDR_LEN 4
+#define EUI_STR_LEN (2 * EUI_LEN + 1) // hex digits and terminating null
+
+// bits in lora_info.valid
+#define LORA_HAVE_VERSION 0x01
+#define LORA_HAVE_DEV_EUI 0x02
+#define LORA_HAVE_APP_EUI 0x04
+#define LORA_HAVE_DEV_ADDR 0x08
+#define LORA_HAVE_ALL 0x0F
+
+typedef struct lora_info {
+    uint8_t version[3]; // major, minor, patch
+    uint8_t dev_eui[EUI_LEN]; // most significant byte first, as the module prints it
+    uint8_t app_eui[EUI_LEN];
+    uint8_t dev_addr[DEV_ADDR_LEN];
+    uint8_t valid; // LORA_HAVE_* for the fields parsed so far
+} lora_info;
+
+bool lora_parse_version(const char *line, lora_info *info); // "+VER: 4.0.11"
+bool lora_parse_id(const char *line, lora_info *info); // "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70", AppEui or DevAddr
+void lora_format_hex(char *out, const uint8_t *bytes, int len); // lowercase, no separators
+
+// Identity cache in the last flash sector, kept across power cycles when LORA_CACHE_FLASH is 1.
+// Without it load finds nothing and store and clear do nothing.
+bool lora_cache_load(lora_info *info);
+void lora_cache_store(const lora_info *info);
+void lora_cache_clear(void);
+
+#endif //LORA_INFO_H
@@ -2,7 +2,8 @@
 #include <string.h>
 #include "pico/stdlib.h"
 #include "iuart.h"
-#include <ctype.h>
+#include "at_cmd.h"
+#include "lora_info.h"
 
 #include "pico/util/queue.h"
 
@@ -24,10 +25,6 @@
 #define BAUD_RATE 9600
 #define BOOT_SLEEP 2000
 #define DELAY 2
-#define TIMEOUT 500000
-#define SLEEP 200
-#define STR_LEN 256
-#define ASCII_DIFF 32
 
 //give states meaningful names
 
@@ -40,22 +37,36 @@ typedef enum
     AT,
     firmwareVersion,
     devEui,
-    goToStep1
+    goToStep1,
+    confirmEui
 } lora_st;
 
 typedef struct lora_sm
 {
     lora_st state;
-    uint32_t timer;
+    uint32_t timer; // handshake start
+    at_cmd at; // result slots, filled in by at_poll
+    at_cmd ver;
+    at_cmd dev_eui;
+    at_cmd app_eui;
+    at_cmd dev_addr;
+    lora_info info; // module identity in binary, for the uplink code; complete while it is cached
+    bool confirmed; // info was read from this module since boot, not only loaded from flash
+    uint32_t cold_ms; // last full handshake
+    uint32_t warm_ms; // last liveness check with the identity cached
 } lora_sm;
 
-void remove_colons(const char *str);
-
 bool debounce();
 
 void lora_wan_sm(lora_sm *lora_struct);
 
-bool lora_cmd(const char *cmd, char *response);
+bool lora_result(const at_cmd *c);
+
+void print_identity(const lora_info *info);
+
+void forget_identity(lora_info *info);
+
+bool submit_identity(lora_sm *lora_struct);
 
 int main()
 {
@@ -75,25 +86,28 @@ int main()
 
     // setup our own UART
     iuart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE);
+    at_init(UART_NR);
 
 #if 1
    /*for (int i = 0; i < 3; ++i) {
-    char response_test[STR_LEN];
-    char cmd_test[]="another very long string\r\n";
-    lora_cmd(cmd_test, response_test);
-    printf("test response!%s\n", response_test);
+    at_cmd test;
+    at_submit(&test, "another very long string\r\n", "+AT: OK");
+    while (!at_done(&test)) at_poll();
+    printf("test response!%s\n", test.response);
        if(i==0) sleep_ms(200); // for testing that sending takes place in the background even when we are sleeping
     }*/
 #endif
 
     //declare initial params (first state and timer set to zero):
 
-    lora_sm lora_struct={.state=buttonPress, .timer=0};
+    lora_sm lora_struct={.state=buttonPress, .timer=0, .confirmed=false};
+    if (lora_cache_load(&lora_struct.info)) printf("Module identity loaded from flash.\n");
 
     //main loop
 
     while (true)
     {
+        at_poll(); // commands go out and responses come in while the state machine waits
         lora_wan_sm(&lora_struct);
         sleep_ms(DELAY);
     }
@@ -105,45 +119,72 @@ int main()
     switch (lora_struct->state)
     {
         case (buttonPress): //State 1
-            if (debounce()) lora_struct->state=AT;
+            if (debounce())
+            {
+                lora_struct->timer = time_us_32();
+                if (at_submit(&lora_struct->at, "AT\r\n", "+AT: OK")) lora_struct->state=AT;
+                else printf("Commands from the last press are still queued, press again.\n");
+            }
             break;
 
         case (AT): //State 2
-            const char send1[] = "AT\r\n";
-            char response1[STR_LEN];
-            if (lora_cmd(send1, response1)) // if response from LoRaWan received - move to the next state
-             {
-                sleep_ms(SLEEP);
-                 lora_struct->state=firmwareVersion;
-             }
-            else
+            if (!at_done(&lora_struct->at)) break; // still waiting for the response
+            if (lora_struct->at.restarted) forget_identity(&lora_struct->info); // reset by someone else, ask again
+            if (!lora_result(&lora_struct->at))
             {
+                forget_identity(&lora_struct->info); // no answer: the module may be replaced or reset before the next one
                 lora_struct->state=buttonPress;
             }
+            else if (lora_struct->info.valid == LORA_HAVE_ALL && lora_struct->confirmed)
+            {
+                // version and IDs don't change while the module stays powered, AT was enough
+                lora_struct->warm_ms = (time_us_32() - lora_struct->timer) / 1000;
+                print_identity(&lora_struct->info);
+                printf("Warm handshake took %lu ms (cold %lu ms).\n", lora_struct->warm_ms, lora_struct->cold_ms);
+                lora_struct->state=goToStep1;
+            }
+            else if (lora_struct->info.valid == LORA_HAVE_ALL)
+            {
+                // loaded from flash: the module may have been swapped while the power was off, check it once
+                if (at_submit(&lora_struct->dev_eui, "AT+ID=DevEui\r\n", "+ID: DevEui"))
+                {
+                    lora_struct->state=confirmEui;
+                }
+                else
+                {
+                    printf("AT command queue is full, press again.\n");
+                    lora_struct->state=buttonPress;
+                }
+            }
+            else // if response from LoRaWan received - move to the next state
+            {
+                lora_struct->state = submit_identity(lora_struct) ? firmwareVersion : buttonPress;
+            }
             break;
 
         case (firmwareVersion): //State 3
-            const char send2[] = "AT+VER\r\n";
-            char response2[STR_LEN];
-            if (lora_cmd(send2, response2)) // if response from LoRaWan received - move to the next state
+            if (!at_done(&lora_struct->ver)) break;
+            if (lora_result(&lora_struct->ver) && lora_parse_version(lora_struct->ver.response, &lora_struct->info))
             {
-                sleep_ms(SLEEP);
                 lora_struct->state=devEui;
             }
             else
             {
-                lora_struct->state=buttonPress;
+                lora_struct->state=buttonPress; // the ID commands still finish in the queue, their results are not used
             }
             break;
 
         case (devEui): //State 4
-            const char send3[] = "AT+ID=DevEui\r\n";
-            char response3[STR_LEN];
-
-            if (lora_cmd(send3, response3)) // if response from LoRaWan received - move to the next state
+            if (!at_done(&lora_struct->dev_addr)) break; // last one queued, the others are done before it
+            if (lora_result(&lora_struct->dev_eui) && lora_parse_id(lora_struct->dev_eui.response, &lora_struct->info) &&
+                lora_result(&lora_struct->app_eui) && lora_parse_id(lora_struct->app_eui.response, &lora_struct->info) &&
+                lora_result(&lora_struct->dev_addr) && lora_parse_id(lora_struct->dev_addr.response, &lora_struct->info))
             {
-                sleep_ms(SLEEP);
-                remove_colons(response3);
+                lora_struct->cold_ms = (time_us_32() - lora_struct->timer) / 1000;
+                lora_struct->confirmed = true;
+                lora_cache_store(&lora_struct->info);
+                print_identity(&lora_struct->info);
+                printf("Cold handshake took %lu ms (warm %lu ms).\n", lora_struct->cold_ms, lora_struct->warm_ms);
                 lora_struct->state=goToStep1;
             }
             else
@@ -153,72 +194,105 @@ int main()
             break;
 
         case (goToStep1): //State 5
+            iuart_stats stats;
+            iuart_get_stats(UART_NR, &stats); // buffer use so far, for sizing them in iuart_setup_buffers
+            printf("UART rx %lu bytes, high water %lu/%lu, tx %lu bytes, high water %lu/%lu, "
+                   "overruns %lu, errors %lu, dropped %lu rx %lu tx\n",
+                   stats.rx_bytes, stats.rx_high_water, stats.rx_size, stats.tx_bytes, stats.tx_high_water,
+                   stats.tx_size, stats.rx_overruns, stats.rx_errors, stats.rx_drops, stats.tx_drops);
             lora_struct->state=buttonPress;
             break;
+
+        case (confirmEui): //State 6
+            if (!at_done(&lora_struct->dev_eui)) break;
+            if (!lora_result(&lora_struct->dev_eui))
+            {
+                forget_identity(&lora_struct->info);
+                lora_struct->state=buttonPress;
+                break;
+            }
+            lora_info module = {.valid = 0};
+            if (lora_parse_id(lora_struct->dev_eui.response, &module) &&
+                !memcmp(module.dev_eui, lora_struct->info.dev_eui, EUI_LEN))
+            {
+                lora_struct->confirmed = true;
+                lora_struct->warm_ms = (time_us_32() - lora_struct->timer) / 1000;
+                print_identity(&lora_struct->info);
+                printf("Warm handshake took %lu ms, identity from flash confirmed.\n", lora_struct->warm_ms);
+                lora_struct->state=goToStep1;
+            }
+            else
+            {
+                printf("Module is not the one in flash.\n");
+                forget_identity(&lora_struct->info);
+                lora_struct->state = submit_identity(lora_struct) ? firmwareVersion : buttonPress;
+            }
+            break;
     }
 }
 
-bool debounce() //simple debounce logic in a separate function (added while statement to wait until user releases the button)
+bool debounce() // true once per press, after the button has read the same for DELAY ms; never waits
 {
-    if (gpio_get(button)==0) //if you detect press first wait
+    static bool down = false; // last reading
+    static bool pressed = false; // press reported, release not seen yet
+    static uint32_t changed = 0; // when the reading last changed
+    bool now_down = gpio_get(button)==0;
+    if (now_down != down) // still bouncing, or just pressed or released
     {
-        sleep_ms(DELAY);
-        if (gpio_get(button)==0) // if you still detect the press, wait until the button is released
-        {
-            while (gpio_get(button)==0);
-            return true; //means the button was pressed
-        }
+        down = now_down;
+        changed = time_us_32();
+        return false;
     }
-    return false;
+    if (time_us_32() - changed < DELAY * 1000) return false;
+    if (!down)
+    {
+        pressed = false; // released for good, the next press counts
+        return false;
+    }
+    if (pressed) return false; // still held from the last one
+    pressed = true;
+    return true; //means the button was pressed
 }
 
-bool lora_cmd(const char *cmd, char *response) // handles the char string to iuart.h for further processing
+bool lora_result(const at_cmd *c) // prints how the command went
 {
-    //const char send[] = "at+VER\r\n";
-    //const char send[] = "at+ID\r\n";
-    //char str[STRLEN];
-    int pos = 0;
-
-    for (int i=0; i<5;++i) // try up to 5 times
+    if (c->status == IUART_RESPONSE_OK)
     {
-        uint32_t t = time_us_32();
-        iuart_send(UART_NR, cmd); // send the command
-        //sleep_ms(200);
-
-        while ((time_us_32() - t) <= TIMEOUT) //compare current time to recorded time stamp and loop until time out is reached
-        {
-            pos = iuart_read(UART_NR, (uint8_t *) response, STRLEN-1);
-            
-            if (pos > 0)
-            {
-                response[pos] = '\0';
-                printf("%d, Connected to LoRa module. %s\n", time_us_32() / 1000, response);
-                return true;
-            }
-        }
+        printf("%d, Connected to LoRa module. %s (%lu ms)\n", time_us_32() / 1000, c->response,
+               (c->done_us - c->queued_us) / 1000);
+        return true;
     }
-        printf("Module is not responding!\n");
-        return false;
+    if (c->status == IUART_RESPONSE_ERROR) printf("Module returned an error: %s\n", c->response);
+    else printf("Module is not responding!\n");
+    return false;
 }
 
-void remove_colons(const char *str)
-{
-    printf("%s\n", str);
-    unsigned char c=0; 
-    int j=0;
-    char output[STR_LEN];
-for (int i=0;str[i]!='\0';++i)
+void print_identity(const lora_info *info)
 {
-    c=str[i];
-    if (c==':') continue;
-    output[j++]=tolower(c);
+    char eui[EUI_STR_LEN];
+    lora_format_hex(eui, info->dev_eui, EUI_LEN);
+    printf("Firmware %u.%u.%u, DevEui %s\n", info->version[0], info->version[1], info->version[2], eui);
 }
-    output[j]='\0';
-    printf("%s", output);
-}
-
-
-
-
 
+bool submit_identity(lora_sm *lora_struct) // queues the version and ID queries for a full handshake
+{
+    lora_struct->info.valid = 0;
+    // independent queries, queued back to back
+    if (at_submit(&lora_struct->ver, "AT+VER\r\n", "+VER:") &&
+        at_submit(&lora_struct->dev_eui, "AT+ID=DevEui\r\n", "+ID: DevEui") &&
+        at_submit(&lora_struct->app_eui, "AT+ID=AppEui\r\n", "+ID: AppEui") &&
+        at_submit(&lora_struct->dev_addr, "AT+ID=DevAddr\r\n", "+ID: DevAddr"))
+    {
+        return true;
+    }
+    // the ones that were queued still finish, their results are not used
+    printf("AT command queue is full, press again.\n");
+    return false;
+}
 
+void forget_identity(lora_info *info) // next press runs the full handshake
+{
+    if (info->valid) printf("Module identity cache cleared.\n");
+    info->valid = 0;
+    lora_cache_clear();
+}
@@ -0,0 +1,82 @@
+//
+// Single producer, single consumer byte ring used by iuart. Each index is written by one side only,
+// so no lock is needed. Indexes run freely, head - tail is the fill level. Only __dmb comes from
+// the SDK, tools/ring_test.c runs the same code on the host.
+//
+
+#ifndef IUART_RING_H
+#define IUART_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hardware/sync.h"
+
+#define RING_MIN 16
+#define RING_MAX 32768 // largest ring the DMA address wrap can handle
+
+typedef struct {
+    uint8_t *data;
+    uint32_t mask; // size - 1, sizes are powers of two
+    volatile uint32_t head; // next byte to write, producer only
+    volatile uint32_t tail; // next byte to read, consumer only
+} ring_t;
+
+// size is rounded up to a power of two, returns the size used, 0 if there was no memory for it
+static inline uint32_t ring_init(ring_t *r, int size, bool aligned)
+{
+    uint32_t n = RING_MIN;
+    while (n < (uint32_t)size && n < RING_MAX) n <<= 1;
+    free(r->data);
+    // the DMA address wrap needs the buffer aligned to its size
+    r->data = aligned ? aligned_alloc(n, n) : malloc(n);
+    if (!r->data) n = 0; // a ring of size 0: nothing fits, nothing to read
+    r->mask = n - 1;
+    r->head = 0;
+    r->tail = 0;
+    return n;
+}
+
+static inline uint32_t ring_count(const ring_t *r)
+{
+    return r->head - r->tail;
+}
+
+static inline uint32_t ring_free(const ring_t *r)
+{
+    return r->mask + 1 - (r->head - r->tail);
+}
+
+// producer side: copy as much as fits, in at most two pieces around the wrap
+static inline int ring_put(ring_t *r, const uint8_t *src, int size)
+{
+    uint32_t head = r->head;
+    uint32_t n = ring_free(r);
+    if (n > (uint32_t)size) n = size;
+    uint32_t first = r->mask + 1 - (head & r->mask);
+    if (first > n) first = n;
+    memcpy(&r->data[head & r->mask], src, first);
+    memcpy(r->data, src + first, n - first);
+    __dmb(); // data is in the buffer before the consumer sees the new head
+    r->head = head + n;
+    return n;
+}
+
+// consumer side
+static inline int ring_get(ring_t *r, uint8_t *dst, int size)
+{
+    uint32_t tail = r->tail;
+    uint32_t n = ring_count(r);
+    if (n > (uint32_t)size) n = size;
+    __dmb(); // head was read before the data it covers
+    uint32_t first = r->mask + 1 - (tail & r->mask);
+    if (first > n) first = n;
+    memcpy(dst, &r->data[tail & r->mask], first);
+    memcpy(dst + first, r->data, n - first);
+    __dmb(); // bytes are copied out before the producer may reuse them
+    r->tail = tail + n;
+    return n;
+}
+
+#endif //IUART_RING_H
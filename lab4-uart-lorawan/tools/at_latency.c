@@ -0,0 +1,187 @@
+//
+// Handshake latency of the AT command queue (at_cmd.c) against the blocking flow it replaced, on the
+// simulated UART (sim/uart_sim.c) with a module that answers each command line after a fixed delay.
+// The blocking flow is lora_wan_sm as it was before the queue: one command per state, lora_cmd polls
+// until the response is complete, then sleep_ms(200), and the main loop does not run in between.
+// The queued flow is the one main.c runs now: AT, then the version and ID queries back to back, with
+// the main loop going round every DELAY ms. For both the handshake time (first command queued to the
+// last response) and the longest time the main loop was held up are printed. In FIFO interrupt mode an
+// answer's last bytes wait for the receive timeout, about 3 ms per command at 9600 baud.
+//
+// gcc -std=gnu11 -Wall -DIUART_DMA=1 -Isim -I.. -o at_latency at_latency.c sim/uart_sim.c ../iuart.c ../at_cmd.c
+// ./at_latency
+// and the same with -DIUART_DMA=0 for the FIFO interrupt mode.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "uart_sim.h"
+#include "iuart.h"
+#include "at_cmd.h"
+
+#define UART_NR 1
+#define BAUD_RATE 9600
+#define POLL_NS 200
+#define DELAY 2 // main loop sleep, as in main.c
+#define SLEEP 200 // what the blocking flow slept after each command
+#define TIMEOUT 500000
+#define RUNS 20
+
+static int module_ms; // module processing time before it answers
+static char module_line[64];
+static int module_len;
+
+// the module: reads command lines off the TX line, answers each one module_ms after its last byte
+static void module_hook(int uart_nr, bool rx, uint8_t byte, uint64_t ns)
+{
+    if (rx) return;
+    if (byte != '\n')
+    {
+        if (byte != '\r' && module_len < (int)sizeof(module_line) - 1) module_line[module_len++] = (char)byte;
+        return;
+    }
+    module_line[module_len] = '\0';
+    module_len = 0;
+    const char *answer = "+AT: ERROR(-1)\r\n";
+    if (!strcmp(module_line, "AT")) answer = "+AT: OK\r\n";
+    else if (!strcmp(module_line, "AT+VER")) answer = "+VER: 4.0.11\r\n";
+    else if (!strcmp(module_line, "AT+ID=DevEui")) answer = "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70\r\n";
+    else if (!strcmp(module_line, "AT+ID=AppEui")) answer = "+ID: AppEui, 80:00:00:00:00:00:00:06\r\n";
+    else if (!strcmp(module_line, "AT+ID=DevAddr")) answer = "+ID: DevAddr, 42:00:A5:70\r\n";
+    sim_receive_at(uart_nr, (const uint8_t *)answer, (int)strlen(answer), ns + module_ms * 1000000ull);
+}
+
+typedef struct result {
+    uint32_t handshake_us;
+    uint32_t held_us; // longest main loop pass
+    int loops; // main loop passes during the handshake
+    int commands;
+} result;
+
+static bool lora_cmd(const char *cmd, const char *expect)
+{
+    iuart_response r;
+    for (int i = 0; i < 5; ++i)
+    {
+        iuart_response_start(&r, expect, TIMEOUT);
+        iuart_send(UART_NR, cmd);
+        iuart_response_status status;
+        while ((status = iuart_response_poll(UART_NR, &r)) == IUART_RESPONSE_PENDING);
+        if (status != IUART_RESPONSE_TIMEOUT) return status == IUART_RESPONSE_OK;
+    }
+    return false;
+}
+
+static result blocking_flow(void)
+{
+    static const char *const cmds[][2] = {
+        { "AT\r\n", "+AT: OK" }, { "AT+VER\r\n", "+VER:" }, { "AT+ID=DevEui\r\n", "+ID: DevEui" }
+    };
+    result res = { .commands = 3 };
+    uint32_t start = time_us_32();
+    int state = 0;
+    while (state < 3)
+    {
+        uint32_t pass = time_us_32();
+        if (lora_cmd(cmds[state][0], cmds[state][1]))
+        {
+            sleep_ms(SLEEP);
+            ++state;
+        }
+        else
+        {
+            printf("blocking flow: %s failed\n", cmds[state][0]);
+            break;
+        }
+        if (state == 3) res.handshake_us = time_us_32() - start;
+        sleep_ms(DELAY);
+        uint32_t held = time_us_32() - pass;
+        if (held > res.held_us) res.held_us = held;
+        ++res.loops;
+    }
+    return res;
+}
+
+static result queued_flow(void)
+{
+    at_cmd at;
+    at_cmd ver;
+    at_cmd dev_eui;
+    at_cmd app_eui;
+    at_cmd dev_addr;
+    result res = { .commands = 5 };
+    at_init(UART_NR);
+    uint32_t start = time_us_32();
+    bool queued = at_submit(&at, "AT\r\n", "+AT: OK");
+    int state = 0;
+    while (queued && state < 2)
+    {
+        uint32_t pass = time_us_32();
+        at_poll();
+        if (state == 0 && at_done(&at))
+        {
+            if (at.status != IUART_RESPONSE_OK ||
+                !(at_submit(&ver, "AT+VER\r\n", "+VER:") && at_submit(&dev_eui, "AT+ID=DevEui\r\n", "+ID: DevEui") &&
+                  at_submit(&app_eui, "AT+ID=AppEui\r\n", "+ID: AppEui") &&
+                  at_submit(&dev_addr, "AT+ID=DevAddr\r\n", "+ID: DevAddr")))
+                break;
+            state = 1;
+        }
+        else if (state == 1 && at_done(&dev_addr))
+        {
+            res.handshake_us = time_us_32() - start;
+            state = 2;
+        }
+        sleep_ms(DELAY);
+        uint32_t held = time_us_32() - pass;
+        if (held > res.held_us) res.held_us = held;
+        ++res.loops;
+    }
+    if (state < 2 || ver.status != IUART_RESPONSE_OK || dev_eui.status != IUART_RESPONSE_OK ||
+        app_eui.status != IUART_RESPONSE_OK || dev_addr.status != IUART_RESPONSE_OK)
+        printf("queued flow: handshake failed\n");
+    while (at_busy()) at_poll();
+    return res;
+}
+
+static void report(const char *name, const result *r)
+{
+    printf("%4d %-9s %8d %12.1f %14.1f %10.1f %6d\n", module_ms, name, r->commands, r->handshake_us / 1000.0,
+           r->handshake_us / 1000.0 / r->commands, r->held_us / 1000.0, r->loops);
+}
+
+int main(void)
+{
+    static const int delays_ms[] = { 2, 10, 50 };
+    sim_init(POLL_NS);
+    sim_set_line_hook(module_hook);
+    iuart_setup(UART_NR, 4, 5, BAUD_RATE);
+    printf("Module answering after the given ms, %d baud, %s, mean of %d handshakes.\n", BAUD_RATE,
+           IUART_DMA ? "DMA" : "FIFO interrupts", RUNS);
+    printf("%4s %-9s %8s %12s %14s %10s %6s\n", "ms", "flow", "commands", "handshake ms", "per command ms",
+           "held ms", "loops");
+    for (size_t d = 0; d < sizeof(delays_ms) / sizeof(delays_ms[0]); ++d)
+    {
+        module_ms = delays_ms[d];
+        result blocking = { 0 };
+        result queued = { 0 };
+        for (int i = 0; i < RUNS; ++i)
+        {
+            result b = blocking_flow();
+            result q = queued_flow();
+            blocking.commands = b.commands;
+            blocking.handshake_us += b.handshake_us / RUNS;
+            blocking.loops = b.loops;
+            if (b.held_us > blocking.held_us) blocking.held_us = b.held_us;
+            queued.commands = q.commands;
+            queued.handshake_us += q.handshake_us / RUNS;
+            if (q.loops > queued.loops) queued.loops = q.loops;
+            if (q.held_us > queued.held_us) queued.held_us = q.held_us;
+            sleep_ms(DELAY);
+        }
+        report("blocking", &blocking);
+        report("queued", &queued);
+    }
+    return 0;
+}
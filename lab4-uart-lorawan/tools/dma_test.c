@@ -0,0 +1,262 @@
+//
+// Host test for iuart.c on the simulated UART and DMA channels (sim/uart_sim.c), in both modes.
+//  - bursts with pauses, read by a loop that polls like main does: every byte must come out once and in
+//    order; in DMA mode the receive timeout interrupt must not be what makes them visible (the RX DREQ
+//    keeps the FIFO empty, so the PL011 never raises it),
+//  - a reader that stays away for several laps of the RX ring: the byte count must still be exact and
+//    the lost bytes counted as dropped once however often the stats are read. In DMA mode the channel
+//    overwrites the oldest bytes and the reader must go on from the oldest one still in the ring; in
+//    interrupt mode the handler drops the newest and the reader gets the first ring's worth. Either
+//    way it must then keep up with new bytes as before,
+//  - interrupt mode: the UART interrupt held off while more than a FIFO arrives: the FIFO's worth comes
+//    out, the rest are PL011 overruns and iuart counts one when the next byte brings the flag,
+//  - writes larger than the TX ring, and writes while the channel is sending: what goes out on the
+//    line is what iuart_write took, in order.
+//
+// gcc -std=gnu11 -Wall -DIUART_DMA=1 -Isim -I.. -o dma_test dma_test.c sim/uart_sim.c ../iuart.c
+// ./dma_test
+// and the same with -DIUART_DMA=0 for the FIFO interrupt mode.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "uart_sim.h"
+#include "iuart.h"
+
+#define UART_NR 1
+#define POLL_NS 200 // CPU time of one clock read
+#define LOOP_MS 2 // main loop sleep
+#define SETTLE_MS 5 // more than the receive timeout at 9600 baud, the last bytes of a burst wait for it in interrupt mode
+#define BURSTS 40
+
+static int failures;
+
+static uint8_t stream(uint32_t i)
+{
+    return (uint8_t)(i ^ i >> 8 ^ i >> 16);
+}
+
+static void send_stream(uint32_t from, uint32_t len)
+{
+    uint8_t data[1024];
+    while (len)
+    {
+        uint32_t n = len < sizeof(data) ? len : sizeof(data);
+        for (uint32_t i = 0; i < n; ++i) data[i] = stream(from + i);
+        sim_receive(UART_NR, data, (int)n);
+        from += n;
+        len -= n;
+    }
+}
+
+static void fail(const char * what)
+{
+    if (failures < 10) printf("FAIL %s\n", what);
+    ++failures;
+}
+
+static void setup(int speed, int rx_size, int tx_size)
+{
+    sim_init(POLL_NS);
+    if (!iuart_setup_buffers(UART_NR, 4, 5, speed, rx_size, tx_size)) fail("setup: no buffers");
+}
+
+// reads what is there and checks it against the stream, returns the next expected index
+static uint32_t read_check(uint32_t expect, const char * name)
+{
+    uint8_t buffer[48];
+    int n;
+    while ((n = iuart_read(UART_NR, buffer, 1 + rand() % (int)sizeof(buffer))) > 0)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            if (buffer[i] != stream(expect + i))
+            {
+                if (failures < 10) printf("FAIL %s: byte %lu is %02X, expected %02X\n", name,
+                                          (unsigned long)(expect + i), buffer[i], stream(expect + i));
+                ++failures;
+                return expect + n;
+            }
+        }
+        expect += n;
+    }
+    return expect;
+}
+
+static void bursts(int speed, int rx_size)
+{
+    setup(speed, rx_size, IUART_DEFAULT_SIZE);
+    uint32_t sent = 0;
+    uint32_t expect = 0;
+    for (int b = 0; b < BURSTS; ++b)
+    {
+        uint32_t len = 1 + rand() % 200;
+        send_stream(sent, len);
+        sent += len;
+        uint64_t pause_ns = (uint64_t)(rand() % 50) * 1000000;
+        uint64_t end = sim_time_ns() + pause_ns;
+        while (!sim_rx_idle(UART_NR) || sim_time_ns() < end)
+        {
+            sleep_ms(LOOP_MS);
+            expect = read_check(expect, "bursts");
+        }
+    }
+    sleep_ms(SETTLE_MS);
+    expect = read_check(expect, "bursts");
+
+    iuart_stats stats;
+    iuart_get_stats(UART_NR, &stats);
+    const sim_uart_stats * sim = sim_get_stats(UART_NR);
+    printf("%7d %5lu %-12s %7lu %7lu %7lu %7lu %9lu\n", speed, (unsigned long)stats.rx_size, "bursts",
+           (unsigned long)sent, (unsigned long)expect, (unsigned long)stats.rx_bytes, (unsigned long)stats.rx_drops,
+           (unsigned long)sim->rx_timeouts);
+    if (expect != sent || stats.rx_bytes != sent || stats.rx_drops || sim->rx_overruns) fail("bursts: bytes lost");
+    if (IUART_DMA && sim->rx_timeouts) fail("bursts: the receive timeout was raised");
+}
+
+static void slow_reader(int speed, int rx_size)
+{
+    // nobody reads while three and a bit laps of the ring arrive
+    setup(speed, rx_size, IUART_DEFAULT_SIZE);
+    iuart_stats stats;
+    iuart_get_stats(UART_NR, &stats);
+    uint32_t size = stats.rx_size;
+    uint32_t sent = 3 * size + size / 3;
+    send_stream(0, sent);
+    while (!sim_rx_idle(UART_NR)) sleep_ms(LOOP_MS);
+    sleep_ms(LOOP_MS);
+
+    iuart_get_stats(UART_NR, &stats);
+    uint32_t drops = stats.rx_drops;
+    sleep_ms(10 * LOOP_MS); // the sync timer runs a few more times
+    iuart_get_stats(UART_NR, &stats);
+#if IUART_DMA
+    if (stats.rx_bytes != sent) fail("slow reader: received bytes miscounted"); // overwritten ones were received
+#else
+    if (stats.rx_bytes + stats.rx_drops != sent) fail("slow reader: received bytes miscounted");
+#endif
+    if (stats.rx_drops != sent - size || stats.rx_drops != drops) fail("slow reader: dropped bytes miscounted");
+    if (stats.rx_high_water != size) fail("slow reader: high water is not the ring size");
+
+#if IUART_DMA
+    uint32_t kept = sent - size; // the channel went on over the oldest bytes, the newest ring's worth is left
+#else
+    uint32_t kept = 0; // the handler dropped what found the ring full, the oldest ring's worth is left
+#endif
+    uint32_t expect = read_check(kept, "slow reader");
+    if (expect != kept + size) fail("slow reader: the ring did not come out whole");
+    uint32_t out = expect - kept;
+
+    // then the reader keeps up with what follows
+    expect = sent;
+    send_stream(sent, size / 2);
+    sent += size / 2;
+    while (!sim_rx_idle(UART_NR))
+    {
+        sleep_ms(LOOP_MS);
+        expect = read_check(expect, "slow reader");
+    }
+    sleep_ms(LOOP_MS);
+    expect = read_check(expect, "slow reader");
+    iuart_get_stats(UART_NR, &stats);
+    out += expect - (sent - size / 2);
+    printf("%7d %5lu %-12s %7lu %7lu %7lu %7lu %9lu\n", speed, (unsigned long)size, "slow reader", (unsigned long)sent,
+           (unsigned long)out, (unsigned long)stats.rx_bytes,
+           (unsigned long)stats.rx_drops, (unsigned long)sim_get_stats(UART_NR)->rx_timeouts);
+    if (expect != sent || stats.rx_drops != drops) fail("slow reader: lost bytes after catching up");
+}
+
+#if !IUART_DMA
+static void held_off(int speed)
+{
+    // the handler can't run while more than the FIFO holds arrives, as under a long critical section
+    setup(speed, IUART_DEFAULT_SIZE, IUART_DEFAULT_SIZE);
+    uint32_t sent = 100;
+    irq_set_enabled(UART0_IRQ + UART_NR, false);
+    send_stream(0, sent);
+    while (!sim_rx_idle(UART_NR)) sleep_ms(LOOP_MS);
+    irq_set_enabled(UART0_IRQ + UART_NR, true);
+    uint32_t expect = read_check(0, "held off");
+    if (expect != SIM_FIFO_LEN) fail("held off: the FIFO did not come out whole");
+    uint32_t out = expect;
+
+    // the byte after the lost ones carries the overrun flag
+    expect = sent;
+    send_stream(sent, 40);
+    sent += 40;
+    while (!sim_rx_idle(UART_NR))
+    {
+        sleep_ms(LOOP_MS);
+        expect = read_check(expect, "held off");
+    }
+    sleep_ms(SETTLE_MS);
+    expect = read_check(expect, "held off");
+    out += expect - (sent - 40);
+    iuart_stats stats;
+    iuart_get_stats(UART_NR, &stats);
+    const sim_uart_stats * sim = sim_get_stats(UART_NR);
+    printf("%7d %5lu %-12s %7lu %7lu %7lu %7lu %9lu\n", speed, (unsigned long)stats.rx_size, "held off",
+           (unsigned long)sent, (unsigned long)out, (unsigned long)stats.rx_bytes,
+           (unsigned long)sim->rx_overruns, (unsigned long)sim->rx_timeouts);
+    if (expect != sent) fail("held off: lost bytes after the overrun");
+    if (sim->rx_overruns != 100 - SIM_FIFO_LEN || stats.rx_overruns != 1) fail("held off: overruns miscounted");
+    if (stats.rx_bytes != out || stats.rx_drops) fail("held off: received bytes miscounted");
+}
+#endif
+
+static void transmit(int speed, int tx_size)
+{
+    setup(speed, IUART_DEFAULT_SIZE, tx_size);
+    static uint8_t line[8192];
+    static uint8_t taken[8192];
+    uint32_t n_taken = 0;
+    uint32_t n_line = 0;
+    uint32_t offered = 0;
+    for (int w = 0; w < 60; ++w)
+    {
+        uint8_t data[400];
+        int len = 1 + rand() % (w % 10 ? 64 : 400); // now and then more than the ring holds
+        for (int i = 0; i < len; ++i) data[i] = (uint8_t)rand();
+        int n = iuart_write(UART_NR, data, len);
+        memcpy(&taken[n_taken], data, n);
+        n_taken += n;
+        offered += len;
+        sleep_ms(rand() % (1 + 600000 / speed)); // sometimes faster than the line
+        n_line += sim_sent(UART_NR, &line[n_line], (int)(sizeof(line) - n_line));
+    }
+    for (int t = 0; t < 2000 && n_line < n_taken; ++t)
+    {
+        sleep_ms(LOOP_MS);
+        n_line += sim_sent(UART_NR, &line[n_line], (int)(sizeof(line) - n_line));
+    }
+    iuart_stats stats;
+    iuart_get_stats(UART_NR, &stats);
+    printf("%7d %5lu %-12s %7lu %7lu %7lu %7lu %9s\n", speed, (unsigned long)stats.tx_size, "transmit",
+           (unsigned long)offered, (unsigned long)n_line, (unsigned long)stats.tx_bytes, (unsigned long)stats.tx_drops,
+           "-");
+    if (n_line != n_taken || memcmp(line, taken, n_taken) != 0) fail("transmit: line differs from what was written");
+    if (stats.tx_bytes != n_taken || stats.tx_drops != offered - n_taken) fail("transmit: counts");
+}
+
+int main(void)
+{
+    srand(7);
+    printf("%7s %5s %-12s %7s %7s %7s %7s %9s\n", "baud", "ring", "case", "offered", "out", "counted", "dropped",
+           "timeouts");
+    bursts(9600, 256);
+    bursts(115200, 64);
+    slow_reader(9600, 256);
+    slow_reader(115200, 64);
+    slow_reader(921600, 16);
+#if !IUART_DMA
+    held_off(9600);
+    held_off(115200);
+#endif
+    transmit(9600, 256);
+    transmit(115200, 64);
+    printf("%s\n", failures ? "FAILED" : "every byte came through or was counted as dropped, once");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+//
+// Host test for the AT response framer in iuart.c. A scripted module answers commands the way the
+// LoRa-E5 does, now and then with the command echoed, blank lines, a garbage line, an overlong line or
+// an error, and the bytes are cut into random-sized fragments:
+//  - fed straight to iuart_response_feed: the status must stay PENDING until the last byte of the
+//    deciding line and then be OK or ERROR as scripted, with that line as the match,
+//  - sent over the simulated UART (sim/uart_sim.c) with gaps between fragments and read with
+//    iuart_response_poll in a loop like at_poll: the response must not end before its line has
+//    arrived and must end within a loop or two after, and a command left unanswered must time out.
+//    In FIFO interrupt mode the line's last bytes may also wait in the RX FIFO until it is half full
+//    or the receive timeout fires, so up to 16 character times more are allowed there.
+//
+// gcc -std=gnu11 -Wall -DIUART_DMA=1 -Isim -I.. -o frame_test frame_test.c sim/uart_sim.c ../iuart.c
+// ./frame_test
+// and the same with -DIUART_DMA=0 for the FIFO interrupt mode.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "uart_sim.h"
+#include "iuart.h"
+
+#define UART_NR 1
+#define SPEED 9600
+#define POLL_NS 200
+#define LOOP_MS 2
+#define TIMEOUT_US 500000
+#define EXCHANGES 400
+#define MODULE_LEN 1024
+#define FIFO_HOLD_NS (IUART_DMA ? 0 : 16 * 10 * 1000000000ull / SPEED) // bytes below the RX interrupt level
+
+typedef struct exchange {
+    const char *cmd;
+    const char *expect;
+    const char *lines; // "|" separated, the module's answer
+    int decides; // line of the answer that ends the response
+    iuart_response_status status;
+} exchange;
+
+static const exchange script[] = {
+    { "AT", "+AT: OK", "+AT: OK", 0, IUART_RESPONSE_OK },
+    { "AT+VER", "+VER:", "+VER: 4.0.11", 0, IUART_RESPONSE_OK },
+    { "AT+ID=DevEui", "+ID: DevEui", "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70", 0, IUART_RESPONSE_OK },
+    { "AT+ID", "+ID: AppEui", "+ID: DevAddr, 42:00:A5:70|+ID: DevEui, 2C:F7:F1:20:32:30:A5:70|"
+      "+ID: AppEui, 80:00:00:00:00:00:00:06", 2, IUART_RESPONSE_OK },
+    { "AT+JOIN", "+JOIN: Done", "+JOIN: Start|+JOIN: NORMAL|+JOIN: Network joined|"
+      "+JOIN: NetID 000013 DevAddr 42:00:A5:70|+JOIN: Done", 4, IUART_RESPONSE_OK },
+    { "AT+VER", "+VER:", "+VER: ERROR(-1)", 0, IUART_RESPONSE_ERROR },
+    { "AT+MODE=LWOTAA", "+MODE:", "+AT: ERROR(-10)|+MODE: LWOTAA", 0, IUART_RESPONSE_ERROR },
+    { "AT+MSG=hi", "+MSG: Done", "+MSG: Start|+MSG: FPENDING|+MSG: Done", 2, IUART_RESPONSE_OK },
+};
+#define SCRIPT_LEN (int)(sizeof(script) / sizeof(script[0]))
+
+static int failures;
+
+static void fail(int n, const char *what)
+{
+    if (failures < 10) printf("FAIL exchange %d: %s\n", n, what);
+    ++failures;
+}
+
+static void add(char *out, int *len, const char *s)
+{
+    int n = (int)strlen(s);
+    if (*len + n < MODULE_LEN) memcpy(&out[*len], s, n);
+    *len += n;
+}
+
+// what the module puts on the line for one exchange, end is set past the '\n' of the deciding line
+static int module_bytes(const exchange *e, char *out, int *end, char *match)
+{
+    int len = 0;
+    char line[300];
+    if (rand() % 4 == 0) // echo on
+    {
+        add(out, &len, e->cmd);
+        add(out, &len, "\r\n");
+    }
+    if (rand() % 4 == 0) add(out, &len, "\r\n");
+    if (rand() % 5 == 0) // garbage, sometimes longer than a line
+    {
+        int n = rand() % 3 ? 1 + rand() % 40 : IUART_LINE_LEN + rand() % 150;
+        for (int i = 0; i < n; ++i) line[i] = (char)('a' + rand() % 26);
+        line[n] = '\0';
+        add(out, &len, line);
+        add(out, &len, "\r\n");
+    }
+    const char *p = e->lines;
+    for (int i = 0; *p; ++i)
+    {
+        const char *bar = strchr(p, '|');
+        int taken = bar ? (int)(bar - p) + 1 : (int)strlen(p);
+        int n = bar ? taken - 1 : taken;
+        memcpy(line, p, n);
+        line[n] = '\0';
+        if (i == e->decides && rand() % 8 == 0) // overlong answer, only the start of it is kept
+        {
+            while (n < IUART_LINE_LEN + 20) line[n++] = 'x';
+            line[n] = '\0';
+        }
+        add(out, &len, line);
+        add(out, &len, "\r\n");
+        if (i == e->decides)
+        {
+            *end = len;
+            line[IUART_LINE_LEN - 1] = '\0';
+            strcpy(match, line);
+        }
+        p += taken;
+    }
+    return len;
+}
+
+static void feed_test(void)
+{
+    static const int max_fragment[] = { 1, 3, 16, 100 };
+    int checked = 0;
+    for (int x = 0; x < EXCHANGES; ++x)
+    {
+        const exchange *e = &script[rand() % SCRIPT_LEN];
+        char bytes[MODULE_LEN];
+        char match[IUART_LINE_LEN];
+        int end = 0;
+        int len = module_bytes(e, bytes, &end, match);
+        int max = max_fragment[x % 4];
+        iuart_response r;
+        iuart_response_start(&r, e->expect, TIMEOUT_US);
+        for (int fed = 0; fed < len;)
+        {
+            int n = 1 + rand() % max;
+            if (n > len - fed) n = len - fed;
+            iuart_response_status s = iuart_response_feed(&r, (const uint8_t *)&bytes[fed], n);
+            fed += n;
+            ++checked;
+            if (fed < end && s != IUART_RESPONSE_PENDING)
+            {
+                fail(x, "feed: ended before the deciding line was complete");
+                break;
+            }
+            if (fed >= end && s != e->status)
+            {
+                fail(x, "feed: wrong status after the deciding line");
+                break;
+            }
+        }
+        if (strcmp(r.match, match) != 0) fail(x, "feed: matched line differs");
+    }
+    printf("feed: %d exchanges, %d fragments\n", EXCHANGES, checked);
+}
+
+static uint64_t arrived_ns[MODULE_LEN];
+static int arrived;
+
+static void line_hook(int uart_nr, bool rx, uint8_t byte, uint64_t ns)
+{
+    if (rx && arrived < MODULE_LEN) arrived_ns[arrived++] = ns;
+}
+
+static void uart_test(void)
+{
+    sim_init(POLL_NS);
+    sim_set_line_hook(line_hook);
+    iuart_setup(UART_NR, 4, 5, SPEED);
+    uint64_t worst_ns = 0;
+    int timeouts = 0;
+    for (int x = 0; x < EXCHANGES / 4; ++x)
+    {
+        const exchange *e = &script[rand() % SCRIPT_LEN];
+        bool silent = rand() % 10 == 0; // the module drops this one
+        char bytes[MODULE_LEN];
+        char match[IUART_LINE_LEN];
+        int end = 0;
+        int len = silent ? 0 : module_bytes(e, bytes, &end, match);
+        arrived = 0;
+        iuart_response r;
+        iuart_response_start(&r, e->expect, TIMEOUT_US);
+        uint64_t start_ns = sim_time_ns();
+        uint64_t next_ns = start_ns;
+        int queued = 0;
+        iuart_response_status s;
+        while ((s = iuart_response_poll(UART_NR, &r)) == IUART_RESPONSE_PENDING)
+        {
+            if (queued < len && sim_rx_idle(UART_NR) && sim_time_ns() >= next_ns) // next fragment
+            {
+                int n = 1 + rand() % 24;
+                if (n > len - queued) n = len - queued;
+                sim_receive(UART_NR, (const uint8_t *)&bytes[queued], n);
+                queued += n;
+                next_ns = sim_time_ns() + (rand() % 3 ? 0 : (uint64_t)(rand() % 20000) * 1000); // gap now and then
+            }
+            sleep_ms(LOOP_MS);
+        }
+        uint64_t done_ns = sim_time_ns();
+        if (silent)
+        {
+            ++timeouts;
+            if (s != IUART_RESPONSE_TIMEOUT) fail(x, "uart: no answer but not a timeout");
+            if (done_ns - start_ns < TIMEOUT_US * 1000ull) fail(x, "uart: timed out early");
+            continue;
+        }
+        if (s != e->status) fail(x, "uart: wrong status");
+        else if (arrived < end) fail(x, "uart: ended before the deciding line arrived");
+        else
+        {
+            uint64_t late = done_ns - arrived_ns[end - 1];
+            if (late > worst_ns) worst_ns = late;
+            if (late > 2 * LOOP_MS * 1000000ull + FIFO_HOLD_NS) fail(x, "uart: response seen late");
+        }
+        if (strcmp(r.match, match) != 0) fail(x, "uart: matched line differs");
+        // the rest of this answer goes before the next command, as at_cmd waits for it
+        while (queued < len)
+        {
+            int n = len - queued;
+            sim_receive(UART_NR, (const uint8_t *)&bytes[queued], n);
+            queued += n;
+        }
+        while (!sim_rx_idle(UART_NR)) sleep_ms(LOOP_MS);
+        sleep_ms(LOOP_MS);
+        iuart_response_poll(UART_NR, &r);
+    }
+    iuart_stats stats;
+    iuart_get_stats(UART_NR, &stats);
+    printf("uart: %d exchanges at %d baud, %d timeouts, worst %.2f ms from last byte to result, %lu dropped\n",
+           EXCHANGES / 4, SPEED, timeouts, worst_ns / 1e6, (unsigned long)stats.rx_drops);
+    if (stats.rx_drops || stats.rx_overruns) fail(-1, "uart: bytes lost");
+}
+
+int main(void)
+{
+    srand(21);
+    sim_init(POLL_NS); // the framer reads the clock
+    feed_test();
+    uart_test();
+    printf("%s\n", failures ? "FAILED" : "every response ended on its own line and nowhere else");
+    return failures ? 1 : 0;
+}
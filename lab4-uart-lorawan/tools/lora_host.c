@@ -0,0 +1,265 @@
+//
+// Host build of the lab4 firmware: main.c, iuart.c, at_cmd.c and lora_info.c as they are, on the
+// simulated UART (sim/uart_sim.c) with its line on the pseudo-terminal of lora_sim. This file is
+// what the board would provide: the button is pressed on a schedule, stdio is the terminal and the
+// flash is an array, kept in a file if one is given. The UART line is watched for commands and
+// answers, and at exit the round-trip time of every command (first byte out to the end of the
+// answer line) and of every handshake is printed as histograms. A handshake is the commands after
+// one press; it is cold when it asked for the version, warm when AT alone was enough.
+//
+// gcc -std=gnu11 -Wall -Wno-format -DIUART_DMA=1 -DLORA_CACHE_FLASH=1 -Isim -I.. -o lora_host
+//     lora_host.c sim/uart_sim.c ../main.c ../iuart.c ../at_cmd.c ../lora_info.c
+// ./lora_sim -p -l 20 -f 4 -g 5 &                      (prints the pty, e.g. /dev/pts/3)
+// LORA_PORT=/dev/pts/3 LORA_PRESSES=5 LORA_FLASH=flash.bin ./lora_host
+// -DIUART_DMA=0 builds the FIFO interrupt mode, which is what the firmware build defaults to; there
+// answers come a few ms later, after the receive timeout.
+//
+// Environment: LORA_PORT the module's pty, LORA_PRESSES button presses (3), LORA_PRESS_MS time
+// between them (1500), LORA_FLASH file that keeps the flash between runs (none: erased at start).
+// Printing uses the firmware's formats, which take uint32_t as long: hence -Wno-format.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "uart_sim.h"
+
+#define UART_NR 1 // main.c's
+#define BUTTON_PIN 9
+#define FIRST_PRESS_MS 2500 // after main.c's boot sleep
+#define PRESS_LEN_MS 100
+#define BOUNCE_US 3000 // contact bounce after each edge
+#define HIST_BUCKETS 10
+#define HIST_MAX 16
+#define LINE_LEN 128
+
+typedef struct histogram {
+    char name[32];
+    unsigned count[HIST_BUCKETS];
+    double total_ms;
+    double max_ms;
+    unsigned n;
+} histogram;
+
+static const double bucket_ms[HIST_BUCKETS] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1e9 };
+
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+static const char *flash_file;
+static int presses = 3;
+static int press_ms = 1500;
+
+static histogram hist[HIST_MAX];
+static int hist_len;
+
+static char tx_line[LINE_LEN]; // command going out
+static int tx_len;
+static uint64_t tx_start_ns;
+static char rx_line[LINE_LEN]; // answer coming in
+static int rx_len;
+
+static char command[LINE_LEN]; // waiting for its answer
+static char tag[LINE_LEN]; // "+VER" for AT+VER, the answer line starts with it
+static uint64_t command_ns;
+static bool waiting;
+static unsigned unanswered; // a new command went out before the answer
+static unsigned resent;
+
+static uint64_t handshake_ns; // first AT after a press, 0 when none is running
+static uint64_t answered_ns; // end of the last answer
+static bool handshake_cold;
+
+static histogram *hist_get(const char *name)
+{
+    for (int i = 0; i < hist_len; ++i)
+    {
+        if (!strcmp(hist[i].name, name)) return &hist[i];
+    }
+    if (hist_len == HIST_MAX) return &hist[HIST_MAX - 1];
+    snprintf(hist[hist_len].name, sizeof(hist[0].name), "%s", name);
+    return &hist[hist_len++];
+}
+
+static void hist_add(const char *name, double ms)
+{
+    histogram *h = hist_get(name);
+    int b = 0;
+    while (b < HIST_BUCKETS - 1 && ms >= bucket_ms[b]) ++b;
+    ++h->count[b];
+    ++h->n;
+    h->total_ms += ms;
+    if (ms > h->max_ms) h->max_ms = ms;
+}
+
+static void handshake_end(void)
+{
+    if (handshake_ns && answered_ns > handshake_ns)
+        hist_add(handshake_cold ? "cold" : "warm", (answered_ns - handshake_ns) / 1e6);
+    handshake_ns = 0;
+}
+
+static void command_out(void)
+{
+    if (waiting && !strcmp(command, tx_line)) ++resent; // at_cmd gave up waiting and sent it again
+    else if (waiting) ++unanswered;
+    snprintf(command, sizeof(command), "%s", tx_line);
+    const char *name = strncmp(command, "AT+", 3) ? "AT" : command + 3;
+    snprintf(tag, sizeof(tag), "+%.*s", (int)strcspn(name, "="), name);
+    command_ns = tx_start_ns;
+    waiting = true;
+    if (!strcmp(command, "AT")) // a press starts with AT
+    {
+        handshake_end();
+        handshake_ns = tx_start_ns;
+        handshake_cold = false;
+    }
+    if (!strcmp(command, "AT+VER")) handshake_cold = true;
+}
+
+static void answer_in(uint64_t ns)
+{
+    if (!waiting) return; // output the module sent on its own
+    size_t n = strlen(tag);
+    if ((strncmp(rx_line, tag, n) || rx_line[n] != ':') && !strstr(rx_line, "ERROR")) return; // echo or garbage
+    hist_add(command, (ns - command_ns) / 1e6);
+    waiting = false;
+    answered_ns = ns;
+}
+
+static void line_hook(int uart_nr, bool rx, uint8_t byte, uint64_t ns)
+{
+    if (uart_nr != UART_NR || byte == '\r') return;
+    char *line = rx ? rx_line : tx_line;
+    int *len = rx ? &rx_len : &tx_len;
+    if (!rx && !tx_len) tx_start_ns = ns;
+    if (byte != '\n')
+    {
+        if (*len < LINE_LEN - 1) line[(*len)++] = (char)byte;
+        return;
+    }
+    line[*len] = '\0';
+    *len = 0;
+    if (!line[0]) return;
+    if (rx) answer_in(ns);
+    else command_out();
+}
+
+static void report(void)
+{
+    handshake_end();
+    printf("\n%-14s %6s %8s %8s ", "command", "n", "avg ms", "max ms");
+    for (int b = 0; b < HIST_BUCKETS; ++b)
+    {
+        if (b < HIST_BUCKETS - 1) printf(" <%-4g", bucket_ms[b]);
+        else printf(" more");
+    }
+    printf("\n");
+    for (int i = 0; i < hist_len; ++i)
+    {
+        const histogram *h = &hist[i];
+        printf("%-14s %6u %8.1f %8.1f ", h->name, h->n, h->total_ms / h->n, h->max_ms);
+        for (int b = 0; b < HIST_BUCKETS; ++b) printf(" %5u", h->count[b]);
+        printf("\n");
+    }
+    printf("resent %u, unanswered %u\n", resent, unanswered + waiting);
+}
+
+static void flash_save(void)
+{
+    if (!flash_file) return;
+    FILE *f = fopen(flash_file, "wb");
+    if (!f || fwrite(sim_flash, sizeof(sim_flash), 1, f) != 1) perror(flash_file);
+    if (f) fclose(f);
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    memset(&sim_flash[flash_offs], 0xFF, count);
+    flash_save();
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) sim_flash[flash_offs + i] &= data[i];
+    flash_save();
+}
+
+void stdio_init_all(void)
+{
+    const char *port = getenv("LORA_PORT");
+    if (!port)
+    {
+        fprintf(stderr, "LORA_PORT: set it to the pty lora_sim -p prints\n");
+        exit(2);
+    }
+    if (getenv("LORA_PRESSES")) presses = atoi(getenv("LORA_PRESSES"));
+    if (getenv("LORA_PRESS_MS")) press_ms = atoi(getenv("LORA_PRESS_MS"));
+    flash_file = getenv("LORA_FLASH");
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+    FILE *f = flash_file ? fopen(flash_file, "rb") : NULL;
+    if (f)
+    {
+        if (fread(sim_flash, sizeof(sim_flash), 1, f) != 1) memset(sim_flash, 0xFF, sizeof(sim_flash));
+        fclose(f);
+    }
+
+    int fd = open(port, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(port);
+        exit(1);
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    sim_init(0);
+    sim_use_pty(UART_NR, fd);
+    sim_set_line_hook(line_hook);
+    atexit(report);
+}
+
+// pressed for PRESS_LEN_MS every press_ms, bouncing at both edges; the run ends one period after the last
+bool gpio_get(uint gpio)
+{
+    if (gpio != BUTTON_PIN) return false;
+    uint64_t us = time_us_64();
+    uint64_t first = FIRST_PRESS_MS * 1000ull;
+    uint64_t period = press_ms * 1000ull;
+    if (us >= first + presses * period) exit(0);
+    if (us < first) return true; // released, the button is active low
+    uint64_t in = (us - first) % period;
+    uint64_t release = PRESS_LEN_MS * 1000ull;
+    if (in < BOUNCE_US || (in >= release && in < release + BOUNCE_US)) return (in / 500) % 2;
+    return in >= release;
+}
+
+void gpio_init(uint gpio)
+{
+    (void)gpio;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    (void)gpio;
+    (void)out;
+}
+
+void gpio_pull_up(uint gpio)
+{
+    (void)gpio;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    (void)gpio;
+    (void)value;
+}
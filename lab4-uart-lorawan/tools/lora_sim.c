@@ -0,0 +1,363 @@
+//
+// Host stand-in for the LoRa-E5 module. Answers AT commands on a pseudo-terminal (or a serial port
+// wired to the Pico's UART) with configurable latency, fragmentation, dropped responses and garbage
+// lines, and keeps a latency histogram per command. Ctrl-C prints the histograms.
+//
+// gcc -std=gnu11 -Wall -o lora_sim lora_sim.c
+// ./lora_sim -p -l 20 -f 4 -x 5 -g 5       (pty: prints the device to connect to)
+// ./lora_sim -d /dev/ttyUSB0 -b 9600       (USB serial adapter on the Pico's UART pins)
+//
+// Options: -l latency ms, -j jitter ms, -f largest fragment in bytes (0: whole lines),
+// -x percent of commands left unanswered, -g percent of responses preceded by a garbage line,
+// -t percent of responses preceded by "+RESET: OK", as if the module had been reset in between,
+// -s random seed. Script lines "COMMAND|RESPONSE LINE|..." in a file given with -r override the
+// built-in answers, e.g. "AT+VER|+VER: 4.1.0".
+//
+// The histograms count, per command, the time from the end of the command line to the end of the
+// response, latency and fragment pauses included. A handshake is an AT and the commands after it up
+// to the next AT, timed to the end of its last response: cold when it asked for the version, warm
+// when it did not. lora_host.c measures the same from the firmware's side of the line, built with either
+// UART mode.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/select.h>
+
+#define LINE_LEN 256
+#define SCRIPT_MAX 32
+#define HIST_BUCKETS 10
+#define CMD_KINDS 9
+
+typedef struct script_entry {
+    char cmd[64];
+    char response[LINE_LEN];
+} script_entry;
+
+typedef struct histogram {
+    const char * name;
+    unsigned count[HIST_BUCKETS];
+    double total_ms;
+    double max_ms;
+    unsigned n;
+} histogram;
+
+static const double bucket_ms[HIST_BUCKETS] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1e9 };
+
+static histogram hist[CMD_KINDS] = {
+    { "AT" }, { "AT+VER" }, { "AT+ID" }, { "AT+JOIN" }, { "AT+MSG" }, { "AT+RESET" }, { "other" }, { "cold" },
+    { "warm" }
+};
+#define HIST_COLD 7
+#define HIST_WARM 8
+
+static script_entry script[SCRIPT_MAX];
+static int script_len = 0;
+
+static int latency_ms = 10;
+static int jitter_ms = 0;
+static int fragment = 0;
+static int drop_percent = 0;
+static int garbage_percent = 0;
+static int restart_percent = 0;
+static volatile sig_atomic_t stop = 0;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(double ms)
+{
+    if (ms <= 0) return;
+    struct timespec ts = { (time_t)(ms / 1000), (long)((ms - (time_t)(ms / 1000) * 1000) * 1e6) };
+    nanosleep(&ts, NULL);
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static speed_t baud(int rate)
+{
+    switch (rate)
+    {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        default: return B115200;
+    }
+}
+
+static void serial_raw(int fd, int rate)
+{
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) return;
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud(rate));
+    cfsetospeed(&tio, baud(rate));
+    tcsetattr(fd, TCSANOW, &tio);
+}
+
+static int kind_of(const char * cmd)
+{
+    if (!strcasecmp(cmd, "AT")) return 0;
+    if (!strncasecmp(cmd, "AT+VER", 6)) return 1;
+    if (!strncasecmp(cmd, "AT+ID", 5)) return 2;
+    if (!strncasecmp(cmd, "AT+JOIN", 7)) return 3;
+    if (!strncasecmp(cmd, "AT+MSG", 6) || !strncasecmp(cmd, "AT+CMSG", 7)) return 4;
+    if (!strncasecmp(cmd, "AT+RESET", 8)) return 5;
+    return 6;
+}
+
+static void hist_add(histogram * h, double ms)
+{
+    int b = 0;
+    while (b < HIST_BUCKETS - 1 && ms >= bucket_ms[b]) ++b;
+    ++h->count[b];
+    ++h->n;
+    h->total_ms += ms;
+    if (ms > h->max_ms) h->max_ms = ms;
+}
+
+static void hist_print(void)
+{
+    fprintf(stderr, "\n%-10s %6s %8s %8s ", "command", "n", "avg ms", "max ms");
+    for (int b = 0; b < HIST_BUCKETS; ++b)
+    {
+        if (b < HIST_BUCKETS - 1) fprintf(stderr, " <%-4g", bucket_ms[b]);
+        else fprintf(stderr, " more");
+    }
+    fprintf(stderr, "\n");
+    for (int k = 0; k < CMD_KINDS; ++k)
+    {
+        const histogram * h = &hist[k];
+        if (!h->n) continue;
+        fprintf(stderr, "%-10s %6u %8.1f %8.1f ", h->name, h->n, h->total_ms / h->n, h->max_ms);
+        for (int b = 0; b < HIST_BUCKETS; ++b) fprintf(stderr, " %5u", h->count[b]);
+        fprintf(stderr, "\n");
+    }
+}
+
+// response lines for a command, '|' separated
+static void answer(const char * cmd, char * out, size_t size)
+{
+    for (int i = 0; i < script_len; ++i)
+    {
+        if (!strcasecmp(cmd, script[i].cmd))
+        {
+            snprintf(out, size, "%s", script[i].response);
+            return;
+        }
+    }
+
+    const char * eq = strchr(cmd, '=');
+    if (!strcasecmp(cmd, "AT")) snprintf(out, size, "+AT: OK");
+    else if (!strcasecmp(cmd, "AT+VER")) snprintf(out, size, "+VER: 4.0.11");
+    else if (!strcasecmp(cmd, "AT+ID=DevEui")) snprintf(out, size, "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70");
+    else if (!strcasecmp(cmd, "AT+ID=AppEui")) snprintf(out, size, "+ID: AppEui, 80:00:00:00:00:00:00:06");
+    else if (!strcasecmp(cmd, "AT+ID=DevAddr")) snprintf(out, size, "+ID: DevAddr, 42:00:A5:70");
+    else if (!strcasecmp(cmd, "AT+ID"))
+        snprintf(out, size, "+ID: DevAddr, 42:00:A5:70|+ID: DevEui, 2C:F7:F1:20:32:30:A5:70|"
+                            "+ID: AppEui, 80:00:00:00:00:00:00:06");
+    else if (!strncasecmp(cmd, "AT+JOIN", 7))
+        snprintf(out, size, "+JOIN: Start|+JOIN: NORMAL|+JOIN: Network joined|"
+                            "+JOIN: NetID 000013 DevAddr 42:00:A5:70|+JOIN: Done");
+    else if (!strncasecmp(cmd, "AT+MSG", 6) || !strncasecmp(cmd, "AT+CMSG", 7))
+        snprintf(out, size, "+%.*s: Start|+%.*s: Done", (int)(eq ? eq - cmd - 3 : strlen(cmd) - 3), cmd + 3,
+                 (int)(eq ? eq - cmd - 3 : strlen(cmd) - 3), cmd + 3);
+    else if (!strcasecmp(cmd, "AT+RESET")) snprintf(out, size, "+RESET: OK");
+    else if (!strncasecmp(cmd, "AT+", 3))
+        snprintf(out, size, "+%.*s: ERROR(-1)", (int)(eq ? eq - cmd - 3 : strlen(cmd) - 3), cmd + 3);
+    else snprintf(out, size, "+AT: ERROR(-1)");
+}
+
+// the whole response goes out in random pieces of up to fragment bytes with short pauses
+static void send_text(int fd, const char * text, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len)
+    {
+        size_t n = fragment ? 1 + (size_t)rand() % fragment : len - sent;
+        if (n > len - sent) n = len - sent;
+        if (write(fd, text + sent, n) < 0) return;
+        sent += n;
+        if (fragment && sent < len) sleep_ms(rand() % 3);
+    }
+}
+
+static void respond(int fd, const char * cmd)
+{
+    char lines[LINE_LEN * 2];
+    char out[LINE_LEN * 3];
+    size_t len = 0;
+
+    answer(cmd, lines, sizeof(lines));
+    if (rand() % 100 < garbage_percent)
+    {
+        for (int i = 0; i < 8; ++i) out[len++] = (char)(0x21 + rand() % 94);
+        out[len++] = '\r';
+        out[len++] = '\n';
+    }
+    if (rand() % 100 < restart_percent) len += snprintf(&out[len], sizeof(out) - len, "+RESET: OK\r\n");
+    for (char * line = strtok(lines, "|"); line; line = strtok(NULL, "|"))
+    {
+        len += snprintf(&out[len], sizeof(out) - len, "%s\r\n", line);
+    }
+    sleep_ms(latency_ms + (jitter_ms ? rand() % (jitter_ms + 1) : 0));
+    send_text(fd, out, len);
+}
+
+static void load_script(const char * path)
+{
+    FILE * f = fopen(path, "r");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    char line[LINE_LEN + 64];
+    while (script_len < SCRIPT_MAX && fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        char * bar = strchr(line, '|');
+        if (!bar || line[0] == '#') continue;
+        *bar = '\0';
+        snprintf(script[script_len].cmd, sizeof(script[0].cmd), "%.63s", line);
+        snprintf(script[script_len].response, sizeof(script[0].response), "%.255s", bar + 1);
+        ++script_len;
+    }
+    fclose(f);
+}
+
+int main(int argc, char ** argv)
+{
+    const char * device = NULL;
+    int use_pty = 0;
+    int rate = 9600;
+    unsigned seed = (unsigned)time(NULL);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "pd:b:l:j:f:x:g:t:s:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p': use_pty = 1; break;
+            case 'd': device = optarg; break;
+            case 'b': rate = atoi(optarg); break;
+            case 'l': latency_ms = atoi(optarg); break;
+            case 'j': jitter_ms = atoi(optarg); break;
+            case 'f': fragment = atoi(optarg); break;
+            case 'x': drop_percent = atoi(optarg); break;
+            case 'g': garbage_percent = atoi(optarg); break;
+            case 't': restart_percent = atoi(optarg); break;
+            case 's': seed = (unsigned)strtoul(optarg, NULL, 0); break;
+            case 'r': load_script(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s -p | -d device [-b baud] [-l ms] [-j ms] [-f bytes] [-x %%] [-g %%] "
+                                "[-t %%] [-s seed] [-r script]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (!use_pty && !device)
+    {
+        fprintf(stderr, "%s: give -p or -d device\n", argv[0]);
+        return 2;
+    }
+    srand(seed);
+
+    int fd;
+    if (use_pty)
+    {
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) || unlockpt(fd))
+        {
+            perror("pty");
+            return 1;
+        }
+        fprintf(stderr, "Module on %s\n", ptsname(fd));
+    }
+    else
+    {
+        fd = open(device, O_RDWR | O_NOCTTY);
+        if (fd < 0)
+        {
+            perror(device);
+            return 1;
+        }
+    }
+    serial_raw(fd, rate);
+    fprintf(stderr, "latency %d+%d ms, fragments %d, drop %d%%, garbage %d%%, restarts %d%%, seed %u\n", latency_ms,
+            jitter_ms, fragment, drop_percent, garbage_percent, restart_percent, seed);
+
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+
+    char line[LINE_LEN];
+    size_t len = 0;
+    double answered_ms = -1; // end of the last response
+    double handshake_ms = -1; // AT that started the handshake in progress
+    int cold = 0; // the handshake asked for the version
+    while (!stop)
+    {
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(fd, &set);
+        if (select(fd + 1, &set, NULL, NULL, NULL) <= 0) continue; // interrupted
+        char c;
+        if (read(fd, &c, 1) != 1)
+        {
+            sleep_ms(10); // pty without a peer yet
+            continue;
+        }
+        if (c == '\r') continue;
+        if (c != '\n')
+        {
+            if (len < LINE_LEN - 1) line[len++] = c;
+            continue;
+        }
+        line[len] = '\0';
+        len = 0;
+        if (!line[0]) continue;
+
+        double t = now_ms();
+        int kind = kind_of(line);
+        if (kind == 0)
+        {
+            if (handshake_ms >= 0 && answered_ms > handshake_ms)
+                hist_add(&hist[cold ? HIST_COLD : HIST_WARM], answered_ms - handshake_ms);
+            handshake_ms = t;
+            cold = 0;
+        }
+        if (kind == 1) cold = 1;
+        fprintf(stderr, "%10.1f  <- %s\n", t, line);
+
+        if (rand() % 100 < drop_percent)
+        {
+            fprintf(stderr, "%10s  (dropped)\n", "");
+            continue;
+        }
+        respond(fd, line);
+        answered_ms = now_ms();
+        hist_add(&hist[kind], answered_ms - t);
+    }
+    if (handshake_ms >= 0 && answered_ms > handshake_ms)
+        hist_add(&hist[cold ? HIST_COLD : HIST_WARM], answered_ms - handshake_ms);
+    hist_print();
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,201 @@
+//
+// Host test for the iuart rings (ring.h). A producer and a consumer thread push a numbered byte stream
+// through rings of several sizes in random-sized pieces: every byte must come out once, in order, and
+// the consumer must never see more than a ring's worth. Then the cost of moving bytes through a ring
+// the way iuart does (bulk copy on the thread side, one FIFO's worth per interrupt) is compared with
+// the queue_t it replaced (a locked call per byte on both sides).
+// The numbers are for the host CPU, they only show the ratio.
+//
+// gcc -std=gnu11 -O2 -Wall -pthread -Isim -I.. -o ring_test ring_test.c sim/queue.c
+// ./ring_test
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+#include "pico/util/queue.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#else
+#define HAVE_CYCLES 0
+#endif
+
+#define STRESS_BYTES 20000000u
+#define BENCH_BYTES 4000000u
+#define FIFO_LEN 32 // UART FIFO, what one interrupt moves at most
+#define QUEUE_LEN 256 // size iuart_setup used for the queues
+
+typedef struct stress {
+    ring_t ring;
+    int max_piece;
+    uint32_t puts;
+    uint32_t full; // puts that moved nothing
+    uint32_t gets;
+    uint32_t empty; // gets that moved nothing
+    uint32_t errors;
+    uint32_t overfull;
+} stress;
+
+static uint8_t stream(uint32_t i)
+{
+    // neighbouring bytes differ, a lost or repeated byte shows
+    return (uint8_t)(i ^ i >> 8 ^ i >> 16 ^ i >> 24);
+}
+
+static uint32_t next_rand(uint32_t * s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static void * producer(void * arg)
+{
+    stress * st = arg;
+    uint8_t piece[2 * RING_MAX];
+    uint32_t seed = 12345;
+    uint32_t sent = 0;
+    while (sent < STRESS_BYTES)
+    {
+        int n = 1 + (int)(next_rand(&seed) % st->max_piece);
+        if ((uint32_t)n > STRESS_BYTES - sent) n = (int)(STRESS_BYTES - sent);
+        for (int i = 0; i < n; ++i) piece[i] = stream(sent + i);
+        int put = ring_put(&st->ring, piece, n);
+        sent += put;
+        ++st->puts;
+        if (!put)
+        {
+            ++st->full;
+            sched_yield(); // the other side may have no core of its own
+        }
+    }
+    return NULL;
+}
+
+static void * consumer(void * arg)
+{
+    stress * st = arg;
+    uint8_t piece[2 * RING_MAX];
+    uint32_t seed = 67890;
+    uint32_t received = 0;
+    while (received < STRESS_BYTES)
+    {
+        if (ring_count(&st->ring) > st->ring.mask + 1) ++st->overfull;
+        int n = ring_get(&st->ring, piece, 1 + (int)(next_rand(&seed) % st->max_piece));
+        for (int i = 0; i < n; ++i)
+        {
+            if (piece[i] != stream(received + i) && st->errors++ < 5)
+                printf("FAIL: byte %lu is %02X, expected %02X\n", (unsigned long)(received + i), piece[i],
+                       stream(received + i));
+        }
+        received += n;
+        ++st->gets;
+        if (!n)
+        {
+            ++st->empty;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static int run_stress(int size)
+{
+    stress st = { .ring = { .data = NULL }, .max_piece = 2 * size };
+    uint32_t used = ring_init(&st.ring, size, false);
+    pthread_t p;
+    pthread_t c;
+    pthread_create(&c, NULL, consumer, &st);
+    pthread_create(&p, NULL, producer, &st);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+    printf("%6lu %10lu %10lu %8lu %10lu %8lu %8lu\n", (unsigned long)used, (unsigned long)STRESS_BYTES,
+           (unsigned long)st.puts, (unsigned long)st.full, (unsigned long)st.gets, (unsigned long)st.empty,
+           (unsigned long)(st.errors + st.overfull));
+    free(st.ring.data);
+    return st.errors || st.overfull || ring_count(&st.ring) != 0;
+}
+
+static uint64_t now_cycles(void)
+{
+#if HAVE_CYCLES
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+// iuart_write and the TX interrupt: the writer copies its piece in, interrupts take a FIFO's worth
+static uint64_t bench_ring(int piece, volatile uint8_t * sink)
+{
+    static uint8_t src[QUEUE_LEN];
+    ring_t r = { .data = NULL };
+    ring_init(&r, QUEUE_LEN, false);
+    uint64_t start = now_cycles();
+    for (uint32_t moved = 0; moved < BENCH_BYTES; moved += piece)
+    {
+        ring_put(&r, src, piece);
+        uint8_t fifo[FIFO_LEN];
+        int n;
+        while ((n = ring_get(&r, fifo, FIFO_LEN)) > 0) *sink += fifo[n - 1];
+    }
+    uint64_t cycles = now_cycles() - start;
+    free(r.data);
+    return cycles;
+}
+
+// the same with the queue: one blocking add per byte, one try_remove per byte in the interrupt
+static uint64_t bench_queue(int piece, volatile uint8_t * sink)
+{
+    static uint8_t src[QUEUE_LEN];
+    queue_t q;
+    queue_init(&q, 1, QUEUE_LEN);
+    uint64_t start = now_cycles();
+    for (uint32_t moved = 0; moved < BENCH_BYTES; moved += piece)
+    {
+        for (int i = 0; i < piece; ++i) queue_add_blocking(&q, &src[i]);
+        bool more = true;
+        while (more)
+        {
+            uint8_t c = 0;
+            for (int i = 0; i < FIFO_LEN && (more = queue_try_remove(&q, &c)); ++i) *sink += c;
+        }
+    }
+    uint64_t cycles = now_cycles() - start;
+    queue_free(&q);
+    return cycles;
+}
+
+int main(void)
+{
+    const int sizes[] = { 16, 256, 4096 };
+    const int pieces[] = { 1, 4, 16, 80, 256 };
+    volatile uint8_t sink = 0;
+    int failures = 0;
+
+    printf("Two threads, pieces of 1 to twice the ring size.\n");
+    printf("%6s %10s %10s %8s %10s %8s %8s\n", "ring", "bytes", "puts", "full", "gets", "empty", "errors");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) failures += run_stress(sizes[i]);
+
+    printf("\n%s per byte through a %d byte buffer, %d bytes per interrupt.\n", HAVE_CYCLES ? "Cycles" : "ns",
+           QUEUE_LEN, FIFO_LEN);
+    printf("%6s %8s %8s %6s\n", "piece", "ring", "queue_t", "ratio");
+    for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); ++i)
+    {
+        bench_ring(pieces[i], &sink); // warm up
+        double ring = (double)bench_ring(pieces[i], &sink) / BENCH_BYTES;
+        double queue = (double)bench_queue(pieces[i], &sink) / BENCH_BYTES;
+        printf("%6d %8.2f %8.2f %6.1f\n", pieces[i], ring, queue, queue / ring);
+    }
+    printf("%s\n", failures ? "FAILED" : "every byte came through once and in order");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+//
+// Host stand-in for hardware/flash.h: the flash is an array the program provides, mapped where
+// XIP_BASE points. Erase sets bytes to 0xFF and program can only clear bits, as on the chip.
+//
+
+#ifndef SIM_HARDWARE_FLASH_H
+#define SIM_HARDWARE_FLASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLASH_PAGE_SIZE 256u
+#define FLASH_SECTOR_SIZE 4096u
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (16 * FLASH_SECTOR_SIZE) // only the top of the flash is used off target
+#endif
+
+extern uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)sim_flash)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif //SIM_HARDWARE_FLASH_H
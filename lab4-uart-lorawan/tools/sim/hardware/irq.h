@@ -0,0 +1,21 @@
+//
+// Host stand-in for hardware/irq.h, handlers are called by uart_sim.c.
+//
+
+#ifndef SIM_HARDWARE_IRQ_H
+#define SIM_HARDWARE_IRQ_H
+
+#include "pico/stdlib.h"
+
+typedef void (*irq_handler_t)(void);
+
+#define DMA_IRQ_0 11
+#define UART0_IRQ 20
+#define UART1_IRQ 21
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0X80
+
+void irq_set_enabled(uint num, bool enabled);
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+
+#endif //SIM_HARDWARE_IRQ_H
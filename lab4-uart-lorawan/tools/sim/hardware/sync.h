@@ -0,0 +1,19 @@
+//
+// Host stand-in for hardware/sync.h. The barrier is a full fence, so ring.h can be run from two
+// threads. Masking interrupts holds back the handlers and timers of uart_sim.c.
+//
+
+#ifndef SIM_HARDWARE_SYNC_H
+#define SIM_HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+static inline void __dmb(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+#endif //SIM_HARDWARE_SYNC_H
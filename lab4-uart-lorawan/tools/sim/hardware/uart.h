@@ -0,0 +1,61 @@
+//
+// Host stand-in for hardware/uart.h: the PL011 registers iuart.c touches, backed by uart_sim.c.
+// Writes to icr take effect when the handler returns, rsr is plain memory like the sticky flags are.
+// dr is plain memory too: uart_is_readable moves the next received byte into it, and a byte written to
+// it goes into the TX FIFO at the next uart_is_writable, when the handler returns or when interrupts
+// are enabled again. The FIFO flags in fr are not kept, poll with those two.
+//
+
+#ifndef SIM_HARDWARE_UART_H
+#define SIM_HARDWARE_UART_H
+
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+
+typedef struct {
+    volatile uint32_t dr;
+    volatile uint32_t rsr;
+    volatile uint32_t fr;
+    volatile uint32_t imsc;
+    volatile uint32_t ris;
+    volatile uint32_t icr;
+    volatile uint32_t dmacr;
+} uart_hw_t;
+
+typedef struct uart_inst {
+    uart_hw_t hw;
+    int nr;
+} uart_inst_t;
+
+extern uart_inst_t sim_uart_inst[2];
+#define uart0 (&sim_uart_inst[0])
+#define uart1 (&sim_uart_inst[1])
+
+#define UART_UARTDR_FE_BITS 0X100u
+#define UART_UARTDR_PE_BITS 0X200u
+#define UART_UARTDR_BE_BITS 0X400u
+#define UART_UARTDR_OE_BITS 0X800u
+#define UART_UARTRSR_FE_BITS 0X1u
+#define UART_UARTRSR_PE_BITS 0X2u
+#define UART_UARTRSR_BE_BITS 0X4u
+#define UART_UARTRSR_OE_BITS 0X8u
+#define UART_UARTFR_RXFE_BITS 0X10u
+#define UART_UARTFR_TXFF_BITS 0X20u
+#define UART_UARTIMSC_RXIM_BITS 0X10u
+#define UART_UARTIMSC_TXIM_LSB 5
+#define UART_UARTIMSC_TXIM_BITS 0X20u
+#define UART_UARTIMSC_RTIM_BITS 0X40u
+#define UART_UARTIMSC_OEIM_BITS 0X400u
+#define UART_UARTICR_RTIC_BITS 0X40u
+#define UART_UARTICR_OEIC_BITS 0X400u
+#define UART_UARTDMACR_RXDMAE_BITS 0X1u
+#define UART_UARTDMACR_TXDMAE_BITS 0X2u
+
+uint uart_init(uart_inst_t *uart, uint baudrate);
+bool uart_is_readable(uart_inst_t *uart);
+bool uart_is_writable(uart_inst_t *uart);
+uart_hw_t *uart_get_hw(uart_inst_t *uart);
+uint uart_get_dreq(uart_inst_t *uart, bool is_tx);
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data);
+
+#endif //SIM_HARDWARE_UART_H
@@ -0,0 +1,30 @@
+//
+// Host stand-in for the parts of pico/stdlib.h that iuart.c, at_cmd.c and main.c use.
+// Time is simulated or real, see uart_sim.h. The GPIO and stdio calls main.c makes are up to the
+// program that runs it.
+//
+
+#ifndef SIM_PICO_STDLIB_H
+#define SIM_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+#define GPIO_IN 0
+#define GPIO_OUT 1
+#define GPIO_FUNC_UART 2
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_pull_up(uint gpio);
+bool gpio_get(uint gpio);
+void gpio_put(uint gpio, bool value);
+void gpio_set_function(uint gpio, int fn);
+void stdio_init_all(void);
+
+#include "pico/time.h"
+
+#endif //SIM_PICO_STDLIB_H
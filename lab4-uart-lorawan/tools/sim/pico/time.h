@@ -0,0 +1,31 @@
+//
+// Host stand-in for pico/time.h: the clock, sleeps and repeating timers. Timer callbacks run like
+// an interrupt, see uart_sim.h.
+//
+
+#ifndef SIM_PICO_TIME_H
+#define SIM_PICO_TIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *rt);
+
+struct repeating_timer {
+    int64_t delay_us; // < 0: between starts, > 0: from the end of one callback to the next
+    void *user_data;
+    repeating_timer_callback_t callback;
+    uint64_t due_ns;
+    struct repeating_timer *next; // in the list of running timers
+};
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data,
+                            repeating_timer_t *out);
+bool cancel_repeating_timer(repeating_timer_t *timer);
+
+#endif //SIM_PICO_TIME_H
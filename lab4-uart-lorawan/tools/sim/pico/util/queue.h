@@ -0,0 +1,32 @@
+//
+// Host stand-in for pico/util/queue.h, the queue iuart used before the rings: every call takes the
+// queue's spin lock and copies one element. On the target the lock also masks interrupts, which is
+// not modelled here, so the host numbers for the queue are on the low side.
+//
+
+#ifndef SIM_PICO_UTIL_QUEUE_H
+#define SIM_PICO_UTIL_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+typedef struct {
+    volatile int lock;
+    uint8_t *data;
+    uint16_t wptr;
+    uint16_t rptr;
+    uint16_t element_size;
+    uint16_t element_count; // one more than asked for, like the SDK
+} queue_t;
+
+void queue_init(queue_t *q, uint element_size, uint element_count);
+void queue_free(queue_t *q);
+uint queue_get_level(queue_t *q);
+bool queue_try_add(queue_t *q, const void *data);
+bool queue_try_remove(queue_t *q, void *data);
+void queue_add_blocking(queue_t *q, const void *data);
+void queue_remove_blocking(queue_t *q, void *data);
+
+#endif //SIM_PICO_UTIL_QUEUE_H
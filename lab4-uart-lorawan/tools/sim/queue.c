@@ -0,0 +1,89 @@
+//
+// Same structure as the SDK queue: indexes wrap at element_count, the lock is held for the level
+// check and the copy.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "pico/util/queue.h"
+
+static void lock(queue_t *q)
+{
+    while (__atomic_exchange_n(&q->lock, 1, __ATOMIC_ACQUIRE)) continue;
+}
+
+static void unlock(queue_t *q)
+{
+    __atomic_store_n(&q->lock, 0, __ATOMIC_RELEASE);
+}
+
+static uint16_t inc_index(queue_t *q, uint16_t index)
+{
+    return ++index == q->element_count ? 0 : index;
+}
+
+void queue_init(queue_t *q, uint element_size, uint element_count)
+{
+    q->lock = 0;
+    q->data = calloc(element_count + 1, element_size);
+    q->wptr = 0;
+    q->rptr = 0;
+    q->element_size = (uint16_t)element_size;
+    q->element_count = (uint16_t)(element_count + 1);
+}
+
+void queue_free(queue_t *q)
+{
+    free(q->data);
+    q->data = NULL;
+}
+
+static uint level_unsafe(queue_t *q)
+{
+    int32_t rc = (int32_t)q->wptr - (int32_t)q->rptr;
+    return rc < 0 ? (uint)(rc + q->element_count) : (uint)rc;
+}
+
+uint queue_get_level(queue_t *q)
+{
+    lock(q);
+    uint level = level_unsafe(q);
+    unlock(q);
+    return level;
+}
+
+bool queue_try_add(queue_t *q, const void *data)
+{
+    lock(q);
+    bool ok = level_unsafe(q) != (uint)q->element_count - 1u;
+    if (ok)
+    {
+        memcpy(&q->data[q->wptr * q->element_size], data, q->element_size);
+        q->wptr = inc_index(q, q->wptr);
+    }
+    unlock(q);
+    return ok;
+}
+
+bool queue_try_remove(queue_t *q, void *data)
+{
+    lock(q);
+    bool ok = level_unsafe(q) != 0;
+    if (ok)
+    {
+        memcpy(data, &q->data[q->rptr * q->element_size], q->element_size);
+        q->rptr = inc_index(q, q->rptr);
+    }
+    unlock(q);
+    return ok;
+}
+
+void queue_add_blocking(queue_t *q, const void *data)
+{
+    while (!queue_try_add(q, data)) continue;
+}
+
+void queue_remove_blocking(queue_t *q, void *data)
+{
+    while (!queue_try_remove(q, data)) continue;
+}
@@ -0,0 +1,752 @@
+//
+// Everything that happens on its own (a byte arriving or leaving a line, a receive timeout, a timer
+// falling due) is an event at a point in time. Reading the clock or sleeping runs the events up to
+// the new time in order, and after each one the DMA channels move what their DREQs allow at once and
+// the interrupts that are pending and unmasked are taken.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include "uart_sim.h"
+#include "hardware/uart.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#define SIM_UARTS 2
+#define SIM_CHANNELS 12
+#define SIM_IRQS 32
+#define SIM_HANDLERS 4
+#define SIM_QUEUE 8192 // bytes on their way in, and sent bytes not yet collected
+#define SIM_IRQ_LOOP 1000 // handler calls in a row before the model gives up on an interrupt
+#define DREQ_UART0_TX 20 // then UART0 RX, UART1 TX, UART1 RX
+#define UART_RIS_RX 0X10u
+#define UART_RIS_TX 0X20u
+#define UART_RIS_RT 0X40u
+#define UART_RIS_OE 0X400u
+#define FIFO_TRIGGER (SIM_FIFO_LEN / 2) // interrupt levels after reset, uart_init leaves them
+#define DR_IDLE 0XFFFFFFFFu // what the data register shows between accesses, no received byte reads as that
+#define NEVER UINT64_MAX
+
+typedef struct sim_line {
+    uint64_t char_ns; // start, 8 data and stop bit
+    uint8_t pending[SIM_QUEUE]; // given to sim_receive, not arrived yet
+    uint32_t pending_head;
+    uint32_t pending_tail;
+    uint64_t next_rx_ns; // arrival of the first pending byte
+    uint64_t last_rx_ns; // arrival of the last byte, for the receive timeout
+    uint8_t rx_fifo[SIM_FIFO_LEN];
+    uint32_t rx_flags[SIM_FIFO_LEN]; // error bits the byte is read with
+    int rx_first;
+    int rx_level;
+    bool overrun; // a byte was lost, the next one into the FIFO carries OE
+    uint32_t dr_shown; // what the model last put in the data register, anything else was written
+    uint8_t tx_fifo[SIM_FIFO_LEN];
+    int tx_first;
+    int tx_level;
+    uint64_t tx_done_ns; // end of the byte being shifted out, NEVER when the line is idle
+    uint8_t sent[SIM_QUEUE];
+    uint32_t sent_head;
+    uint32_t sent_tail;
+    int fd; // pseudo-terminal, -1 for none
+    sim_uart_stats stats;
+} sim_line;
+
+typedef struct sim_channel {
+    bool claimed;
+    bool busy;
+    bool irq0_enabled;
+    bool irq0_status;
+    dma_channel_config config;
+    volatile uint8_t *read;
+    volatile uint8_t *write;
+    uint32_t count;
+    dma_channel_hw_t hw;
+} sim_channel;
+
+uart_inst_t sim_uart_inst[SIM_UARTS] = { { .nr = 0 }, { .nr = 1 } };
+
+static sim_line lines[SIM_UARTS];
+static sim_channel channels[SIM_CHANNELS];
+static irq_handler_t handlers[SIM_IRQS][SIM_HANDLERS];
+static bool irq_enabled[SIM_IRQS];
+static repeating_timer_t *timers; // running ones
+static bool masked; // save_and_disable_interrupts
+static int depth; // handlers running, they don't nest
+static uint64_t now_ns;
+static uint32_t poll_cost_ns;
+static bool real_time;
+static uint64_t real_start_ns;
+static sim_line_hook line_hook;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t real_ns(void)
+{
+    return monotonic_ns() - real_start_ns;
+}
+
+void sim_init(uint32_t poll_ns)
+{
+    // handlers, enabled interrupts and claimed channels stay, like a program that sets up again
+    memset(lines, 0, sizeof(lines));
+    for (int i = 0; i < SIM_UARTS; ++i)
+    {
+        lines[i].fd = -1;
+        lines[i].tx_done_ns = NEVER;
+        lines[i].char_ns = 10 * 1000000000ULL / 115200;
+        lines[i].dr_shown = DR_IDLE;
+        memset(&sim_uart_inst[i].hw, 0, sizeof(sim_uart_inst[i].hw));
+        sim_uart_inst[i].hw.dr = DR_IDLE;
+    }
+    for (int i = 0; i < SIM_CHANNELS; ++i)
+    {
+        channels[i].busy = false;
+        channels[i].irq0_status = false;
+        channels[i].count = 0;
+    }
+    timers = NULL;
+    masked = false;
+    depth = 0;
+    now_ns = 0;
+    poll_cost_ns = poll_ns;
+    real_time = false;
+    line_hook = NULL;
+}
+
+void sim_use_pty(int uart_nr, int fd)
+{
+    lines[uart_nr].fd = fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (!real_time)
+    {
+        real_time = true;
+        real_start_ns = monotonic_ns() - now_ns;
+    }
+}
+
+void sim_set_line_hook(sim_line_hook hook)
+{
+    line_hook = hook;
+}
+
+void sim_receive(int uart_nr, const uint8_t *data, int len)
+{
+    sim_receive_at(uart_nr, data, len, 0);
+}
+
+void sim_receive_at(int uart_nr, const uint8_t *data, int len, uint64_t ns)
+{
+    sim_line *l = &lines[uart_nr];
+    for (int i = 0; i < len && l->pending_tail - l->pending_head < SIM_QUEUE; ++i)
+    {
+        if (l->pending_tail == l->pending_head)
+        {
+            // line idle: the byte starts now, at ns, or right after the last one
+            uint64_t start = l->last_rx_ns > now_ns ? l->last_rx_ns : now_ns;
+            if (ns > start) start = ns;
+            l->next_rx_ns = start + l->char_ns;
+        }
+        l->pending[l->pending_tail++ % SIM_QUEUE] = data[i];
+    }
+}
+
+bool sim_rx_idle(int uart_nr)
+{
+    return lines[uart_nr].pending_tail == lines[uart_nr].pending_head;
+}
+
+int sim_sent(int uart_nr, uint8_t *out, int size)
+{
+    sim_line *l = &lines[uart_nr];
+    int n = 0;
+    while (n < size && l->sent_head != l->sent_tail) out[n++] = l->sent[l->sent_head++ % SIM_QUEUE];
+    return n;
+}
+
+const sim_uart_stats *sim_get_stats(int uart_nr)
+{
+    return &lines[uart_nr].stats;
+}
+
+static volatile uint8_t *ring_next(volatile uint8_t *p, const dma_channel_config *c, bool write)
+{
+    uintptr_t a = (uintptr_t)p + 1;
+    if (c->ring_bits && c->ring_write == write)
+    {
+        uintptr_t mask = ((uintptr_t)1 << c->ring_bits) - 1;
+        a = ((uintptr_t)p & ~mask) | (a & mask);
+    }
+    return (volatile uint8_t *)a;
+}
+
+static void mirror(sim_channel *ch)
+{
+    ch->hw.read_addr = (uint32_t)(uintptr_t)ch->read;
+    ch->hw.write_addr = (uint32_t)(uintptr_t)ch->write;
+    ch->hw.transfer_count = ch->count;
+}
+
+// every busy channel moves what its DREQ lets through
+static void dma_step(void)
+{
+    for (int i = 0; i < SIM_CHANNELS; ++i)
+    {
+        sim_channel *ch = &channels[i];
+        uint dreq = ch->config.dreq;
+        if (!ch->busy || dreq < DREQ_UART0_TX || dreq >= DREQ_UART0_TX + 2 * SIM_UARTS) continue;
+        int u = (dreq - DREQ_UART0_TX) / 2;
+        bool tx = (dreq - DREQ_UART0_TX) % 2 == 0;
+        sim_line *l = &lines[u];
+        uart_hw_t *hw = &sim_uart_inst[u].hw;
+        if (tx)
+        {
+            while (ch->count && (hw->dmacr & UART_UARTDMACR_TXDMAE_BITS) && l->tx_level < SIM_FIFO_LEN)
+            {
+                l->tx_fifo[(l->tx_first + l->tx_level++) % SIM_FIFO_LEN] = *ch->read;
+                if (ch->config.read_increment) ch->read = ring_next(ch->read, &ch->config, false);
+                --ch->count;
+            }
+            if (l->tx_level && l->tx_done_ns == NEVER) l->tx_done_ns = now_ns + l->char_ns;
+        }
+        else
+        {
+            while (ch->count && (hw->dmacr & UART_UARTDMACR_RXDMAE_BITS) && l->rx_level)
+            {
+                *ch->write = l->rx_fifo[l->rx_first];
+                l->rx_first = (l->rx_first + 1) % SIM_FIFO_LEN;
+                --l->rx_level;
+                if (ch->config.write_increment) ch->write = ring_next(ch->write, &ch->config, true);
+                --ch->count;
+                ++l->stats.rx_dma;
+                hw->ris &= ~UART_RIS_RT; // reading the FIFO clears the timeout
+            }
+        }
+        if (!ch->count)
+        {
+            ch->busy = false;
+            ch->irq0_status = true;
+        }
+        mirror(ch);
+    }
+}
+
+// a byte the program wrote to the data register goes into the TX FIFO, or is lost if it is full
+static void dr_commit(int u)
+{
+    sim_line *l = &lines[u];
+    uart_hw_t *hw = &sim_uart_inst[u].hw;
+    if (hw->dr == l->dr_shown) return;
+    if (l->tx_level < SIM_FIFO_LEN)
+    {
+        l->tx_fifo[(l->tx_first + l->tx_level++) % SIM_FIFO_LEN] = (uint8_t)hw->dr;
+        if (l->tx_done_ns == NEVER) l->tx_done_ns = now_ns + l->char_ns;
+        if (l->tx_level > FIFO_TRIGGER) hw->ris &= ~UART_RIS_TX; // filled past the level, as the PL011 clears it
+    }
+    hw->dr = l->dr_shown = DR_IDLE;
+}
+
+// the RX interrupt follows the FIFO level; the TX one is raised on the way down, in tx_leave
+static void uart_update(int u)
+{
+    uart_hw_t *hw = &sim_uart_inst[u].hw;
+    dr_commit(u);
+    if (lines[u].rx_level >= FIFO_TRIGGER) hw->ris |= UART_RIS_RX;
+    else hw->ris &= ~UART_RIS_RX;
+}
+
+static void call_handlers(uint num)
+{
+    ++depth;
+    for (int h = 0; h < SIM_HANDLERS && handlers[num][h]; ++h) handlers[num][h]();
+    --depth;
+}
+
+static bool dma_irq_pending(void)
+{
+    for (int i = 0; i < SIM_CHANNELS; ++i)
+    {
+        if (channels[i].irq0_enabled && channels[i].irq0_status) return true;
+    }
+    return false;
+}
+
+static void remove_timer(repeating_timer_t *t)
+{
+    for (repeating_timer_t **p = &timers; *p; p = &(*p)->next)
+    {
+        if (*p == t)
+        {
+            *p = t->next;
+            return;
+        }
+    }
+}
+
+static uint64_t next_timer_ns(void)
+{
+    uint64_t next = NEVER;
+    for (repeating_timer_t *t = timers; t; t = t->next)
+    {
+        if (t->due_ns < next) next = t->due_ns;
+    }
+    return next;
+}
+
+// pending interrupts, unless masked or a handler is running
+static void dispatch(void)
+{
+    if (masked || depth) return;
+    for (int loop = 0; loop < SIM_IRQ_LOOP; ++loop)
+    {
+        bool ran = false;
+        for (int u = 0; u < SIM_UARTS; ++u)
+        {
+            uart_hw_t *hw = &sim_uart_inst[u].hw;
+            uart_update(u);
+            if (!irq_enabled[UART0_IRQ + u] || !(hw->imsc & hw->ris)) continue;
+            ++lines[u].stats.uart_irqs;
+            call_handlers(UART0_IRQ + u);
+            dr_commit(u);
+            hw->ris &= ~hw->icr;
+            hw->icr = 0;
+            ran = true;
+        }
+        if (irq_enabled[DMA_IRQ_0] && dma_irq_pending())
+        {
+            call_handlers(DMA_IRQ_0);
+            ran = true;
+        }
+        repeating_timer_t *t = timers;
+        while (t && t->due_ns > now_ns) t = t->next;
+        if (t)
+        {
+            ++depth;
+            bool again = t->callback(t);
+            --depth;
+            if (!again) remove_timer(t);
+            else t->due_ns = t->delay_us < 0 ? t->due_ns + (uint64_t)(-t->delay_us) * 1000 : now_ns + t->delay_us * 1000;
+            ran = true;
+        }
+        dma_step();
+        if (!ran) return;
+    }
+    fprintf(stderr, "sim: interrupt keeps firing, the handler does not clear it\n");
+    exit(1);
+}
+
+static uint64_t timeout_ns(const sim_line *l)
+{
+    const uart_hw_t *hw = &sim_uart_inst[l - lines].hw;
+    if (!l->rx_level || (hw->ris & UART_RIS_RT)) return NEVER;
+    return l->last_rx_ns + 32 * l->char_ns / 10; // 32 bit times
+}
+
+static void rx_arrive(sim_line *l)
+{
+    int u = (int)(l - lines);
+    uart_hw_t *hw = &sim_uart_inst[u].hw;
+    uint8_t byte = l->pending[l->pending_head++ % SIM_QUEUE];
+    l->last_rx_ns = now_ns;
+    ++l->stats.rx_line;
+    if (l->rx_level == SIM_FIFO_LEN)
+    {
+        ++l->stats.rx_overruns;
+        hw->rsr |= UART_UARTRSR_OE_BITS;
+        hw->ris |= UART_RIS_OE;
+        l->overrun = true;
+    }
+    else
+    {
+        int i = (l->rx_first + l->rx_level++) % SIM_FIFO_LEN;
+        l->rx_fifo[i] = byte;
+        l->rx_flags[i] = l->overrun ? UART_UARTDR_OE_BITS : 0;
+        l->overrun = false;
+    }
+    l->next_rx_ns = l->pending_head != l->pending_tail ? now_ns + l->char_ns : NEVER;
+    if (line_hook) line_hook(u, true, byte, now_ns);
+}
+
+static void tx_leave(sim_line *l)
+{
+    int u = (int)(l - lines);
+    uint8_t byte = l->tx_fifo[l->tx_first];
+    l->tx_first = (l->tx_first + 1) % SIM_FIFO_LEN;
+    --l->tx_level;
+    ++l->stats.tx_line;
+    if (l->sent_tail - l->sent_head == SIM_QUEUE) ++l->sent_head; // nobody collects them, oldest go
+    l->sent[l->sent_tail++ % SIM_QUEUE] = byte;
+    if (l->fd >= 0 && write(l->fd, &byte, 1) != 1) fprintf(stderr, "sim: write to the line failed\n");
+    l->tx_done_ns = l->tx_level ? now_ns + l->char_ns : NEVER;
+    if (l->tx_level == FIFO_TRIGGER) sim_uart_inst[u].hw.ris |= UART_RIS_TX;
+    if (line_hook) line_hook(u, false, byte, now_ns);
+}
+
+// the bytes a pseudo-terminal has, as if they were on the wire now
+static void pty_poll(void)
+{
+    for (int u = 0; u < SIM_UARTS; ++u)
+    {
+        uint8_t buffer[256];
+        ssize_t n;
+        if (lines[u].fd < 0) continue;
+        while ((n = read(lines[u].fd, buffer, sizeof(buffer))) > 0) sim_receive(u, buffer, (int)n);
+    }
+}
+
+static uint64_t next_event_ns(void)
+{
+    uint64_t next = masked || depth ? NEVER : next_timer_ns();
+    for (int u = 0; u < SIM_UARTS; ++u)
+    {
+        const sim_line *l = &lines[u];
+        uint64_t rx = l->pending_head != l->pending_tail ? l->next_rx_ns : NEVER;
+        uint64_t rt = timeout_ns(l);
+        if (rx < next) next = rx;
+        if (l->tx_done_ns < next) next = l->tx_done_ns;
+        if (rt < next) next = rt;
+    }
+    return next;
+}
+
+static void run_to(uint64_t t)
+{
+    uint64_t next;
+    for (int u = 0; u < SIM_UARTS; ++u) dr_commit(u); // written with the interrupt off, e.g. by iuart_write
+    while ((next = next_event_ns()) <= t)
+    {
+        if (next > now_ns) now_ns = next;
+        for (int u = 0; u < SIM_UARTS; ++u)
+        {
+            sim_line *l = &lines[u];
+            if (l->pending_head != l->pending_tail && l->next_rx_ns <= now_ns) rx_arrive(l);
+            if (l->tx_done_ns <= now_ns) tx_leave(l);
+            if (timeout_ns(l) <= now_ns)
+            {
+                sim_uart_inst[u].hw.ris |= UART_RIS_RT;
+                ++l->stats.rx_timeouts;
+            }
+        }
+        dma_step();
+        dispatch();
+    }
+    if (t > now_ns) now_ns = t;
+    dma_step();
+    dispatch();
+}
+
+static void run_now(void)
+{
+    if (real_time)
+    {
+        pty_poll();
+        run_to(real_ns());
+    }
+    else
+    {
+        run_to(now_ns + poll_cost_ns);
+    }
+}
+
+uint64_t sim_time_ns(void)
+{
+    return now_ns;
+}
+
+void sim_advance_us(uint64_t us)
+{
+    sleep_us(us);
+}
+
+uint64_t time_us_64(void)
+{
+    run_now();
+    return now_ns / 1000;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+void sleep_us(uint64_t us)
+{
+    if (!real_time)
+    {
+        run_to(now_ns + us * 1000);
+        return;
+    }
+    uint64_t end = real_ns() + us * 1000;
+    for (;;)
+    {
+        run_now();
+        uint64_t t = real_ns();
+        if (t >= end) return;
+        uint64_t wake = next_event_ns();
+        if (wake > end) wake = end;
+        uint64_t wait = wake > t ? wake - t : 0;
+        fd_set set;
+        int top = -1;
+        FD_ZERO(&set);
+        for (int u = 0; u < SIM_UARTS; ++u)
+        {
+            if (lines[u].fd < 0) continue;
+            FD_SET(lines[u].fd, &set);
+            if (lines[u].fd > top) top = lines[u].fd;
+        }
+        struct timeval tv = { (time_t)(wait / 1000000000u), (long)(wait % 1000000000u / 1000) };
+        select(top + 1, &set, NULL, NULL, &tv); // woken early by bytes from the line
+    }
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sleep_us((uint64_t)ms * 1000);
+}
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data,
+                            repeating_timer_t *out)
+{
+    out->delay_us = delay_us;
+    out->callback = callback;
+    out->user_data = user_data;
+    out->due_ns = now_ns + (uint64_t)(delay_us < 0 ? -delay_us : delay_us) * 1000;
+    remove_timer(out);
+    out->next = timers;
+    timers = out;
+    return true;
+}
+
+bool cancel_repeating_timer(repeating_timer_t *timer)
+{
+    bool found = false;
+    for (repeating_timer_t *t = timers; t; t = t->next) found |= t == timer;
+    remove_timer(timer);
+    return found;
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+    uint32_t was = masked;
+    masked = true;
+    return was;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    masked = status != 0;
+    if (!masked) run_to(now_ns);
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    irq_enabled[num] = enabled;
+    if (enabled) run_to(now_ns);
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    memset(handlers[num], 0, sizeof(handlers[num]));
+    handlers[num][0] = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority)
+{
+    (void)order_priority;
+    int h = 0;
+    while (h < SIM_HANDLERS - 1 && handlers[num][h] && handlers[num][h] != handler) ++h;
+    handlers[num][h] = handler;
+}
+
+uint uart_init(uart_inst_t *uart, uint baudrate)
+{
+    sim_line *l = &lines[uart->nr];
+    l->char_ns = 10 * 1000000000ULL / baudrate;
+    l->rx_level = 0;
+    l->tx_level = 0;
+    l->tx_done_ns = NEVER;
+    l->overrun = false;
+    l->dr_shown = DR_IDLE;
+    memset(&uart->hw, 0, sizeof(uart->hw));
+    uart->hw.dr = DR_IDLE;
+    return baudrate;
+}
+
+bool uart_is_readable(uart_inst_t *uart)
+{
+    sim_line *l = &lines[uart->nr];
+    dr_commit(uart->nr);
+    if (!l->rx_level)
+    {
+        uart->hw.dr = l->dr_shown = DR_IDLE;
+        return false;
+    }
+    // the byte leaves the FIFO now, the read of dr that follows gets it with its error bits
+    uart->hw.dr = l->dr_shown = l->rx_fifo[l->rx_first] | l->rx_flags[l->rx_first];
+    l->rx_first = (l->rx_first + 1) % SIM_FIFO_LEN;
+    --l->rx_level;
+    ++l->stats.rx_cpu;
+    uart->hw.ris &= ~UART_RIS_RT;
+    return true;
+}
+
+bool uart_is_writable(uart_inst_t *uart)
+{
+    dr_commit(uart->nr);
+    return lines[uart->nr].tx_level < SIM_FIFO_LEN;
+}
+
+uart_hw_t *uart_get_hw(uart_inst_t *uart)
+{
+    return &uart->hw;
+}
+
+uint uart_get_dreq(uart_inst_t *uart, bool is_tx)
+{
+    return DREQ_UART0_TX + 2 * uart->nr + (is_tx ? 0 : 1);
+}
+
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data)
+{
+    uart->hw.imsc = (tx_needs_data ? UART_UARTIMSC_TXIM_BITS : 0) |
+                    (rx_has_data ? UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS : 0);
+}
+
+void gpio_set_function(uint gpio, int fn)
+{
+    (void)gpio;
+    (void)fn;
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (int i = 0; i < SIM_CHANNELS; ++i)
+    {
+        if (!channels[i].claimed)
+        {
+            channels[i].claimed = true;
+            return i;
+        }
+    }
+    if (required)
+    {
+        fprintf(stderr, "sim: no free DMA channel\n");
+        exit(1);
+    }
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    (void)channel;
+    dma_channel_config c = { .dreq = 0X3F, .read_increment = true }; // permanent request, as the SDK sets it
+    return c;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size)
+{
+    (void)c;
+    if (size != DMA_SIZE_8)
+    {
+        fprintf(stderr, "sim: only byte transfers are modelled\n");
+        exit(1);
+    }
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr)
+{
+    c->read_increment = incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr)
+{
+    c->write_increment = incr;
+}
+
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits)
+{
+    c->ring_write = write;
+    c->ring_bits = size_bits;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq)
+{
+    c->dreq = dreq;
+}
+
+static void start(sim_channel *ch, bool trigger)
+{
+    if (trigger) ch->busy = ch->count > 0;
+    mirror(ch);
+    dma_step();
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    sim_channel *ch = &channels[channel];
+    ch->config = *config;
+    ch->write = write_addr;
+    ch->read = (volatile uint8_t *)read_addr;
+    ch->count = transfer_count;
+    start(ch, trigger);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger)
+{
+    channels[channel].write = write_addr;
+    start(&channels[channel], trigger);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+    channels[channel].count = trans_count;
+    start(&channels[channel], trigger);
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count)
+{
+    channels[channel].read = (volatile uint8_t *)read_addr;
+    channels[channel].count = transfer_count;
+    start(&channels[channel], true);
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    return channels[channel].busy;
+}
+
+void dma_channel_abort(uint channel)
+{
+    channels[channel].busy = false;
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel)
+{
+    return &channels[channel].hw;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled)
+{
+    channels[channel].irq0_enabled = enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel)
+{
+    return channels[channel].irq0_enabled && channels[channel].irq0_status;
+}
+
+void dma_channel_acknowledge_irq0(uint channel)
+{
+    channels[channel].irq0_status = false;
+}
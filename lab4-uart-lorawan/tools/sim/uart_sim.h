@@ -0,0 +1,50 @@
+//
+// Host model of the RP2040 UARTs and the DMA channels that serve them, for running iuart.c off target
+// in either mode. Bytes arrive on the RX line one character time apart into the 32 byte RX FIFO; a byte
+// arriving at a full FIFO is lost and flags an overrun. With IUART_DMA=1 the RX channel empties the FIFO
+// as long as its DREQ is on and the TX channel fills the TX FIFO. With IUART_DMA=0 the handlers do it
+// through the data register (see hardware/uart.h): the RX interrupt is raised while the FIFO holds 16
+// bytes or more, the TX interrupt when the TX FIFO drains to 16, as on the PL011 after reset. The TX
+// FIFO goes out on the line at the same rate. The receive timeout interrupt is raised the way the PL011
+// raises it: bytes left in the FIFO and 32 bit times without a new one.
+// Interrupt handlers, DMA completion interrupts and repeating timers run, one at a time, when the
+// program reads the clock, sleeps or unmasks interrupts. Time is simulated (every clock read costs
+// poll_ns of CPU time) unless a line is put on a pseudo-terminal, then it is real time.
+//
+
+#ifndef UART_SIM_H
+#define UART_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_FIFO_LEN 32
+
+typedef struct sim_uart_stats {
+    uint32_t rx_line; // bytes that arrived on the RX line
+    uint32_t rx_overruns; // arrived with the RX FIFO full and were lost
+    uint32_t rx_dma; // bytes the RX channel took from the FIFO
+    uint32_t rx_cpu; // bytes the program read from the FIFO, in FIFO interrupt mode
+    uint32_t rx_timeouts; // receive timeout interrupts raised
+    uint32_t tx_line; // bytes that went out on the TX line
+    uint32_t uart_irqs; // handler calls
+} sim_uart_stats;
+
+// called for every byte on a line, at the time its stop bit ends
+typedef void (*sim_line_hook)(int uart_nr, bool rx, uint8_t byte, uint64_t ns);
+
+void sim_init(uint32_t poll_ns); // simulated clock from 0, nothing on the lines; call before anything else
+void sim_use_pty(int uart_nr, int fd); // the line of this UART goes to fd, the clock becomes real time
+void sim_set_line_hook(sim_line_hook hook);
+
+void sim_receive(int uart_nr, const uint8_t *data, int len); // sent to the UART after what is already coming
+// the same, but an idle line stays quiet until ns; may be called from the line hook to answer a byte
+void sim_receive_at(int uart_nr, const uint8_t *data, int len, uint64_t ns);
+bool sim_rx_idle(int uart_nr); // everything given to sim_receive has arrived
+int sim_sent(int uart_nr, uint8_t *out, int size); // bytes sent on the TX line since the last call
+const sim_uart_stats *sim_get_stats(int uart_nr);
+
+uint64_t sim_time_ns(void);
+void sim_advance_us(uint64_t us); // CPU busy with something else, interrupts still run
+
+#endif //UART_SIM_H
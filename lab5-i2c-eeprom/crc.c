@@ -0,0 +1,87 @@
+//
+// CRC-16/CCITT engines. All variants give the same result, they only trade flash for speed.
+//
+
+#include "crc.h"
+
+#define CRC16_POLY 0x1021
+
+// The tables are generated by the preprocessor, so they end up in flash as constants.
+// CRC_S8 clocks eight zero bits through the register, which is the same as feeding a zero byte.
+#define CRC_S1(c) ((((c) << 1) ^ (((c) & 0x8000) ? CRC16_POLY : 0)) & 0xFFFF)
+#define CRC_S2(c) CRC_S1(CRC_S1(c))
+#define CRC_S4(c) CRC_S2(CRC_S2(c))
+#define CRC_S8(c) CRC_S4(CRC_S4(c))
+
+// The CRC of a byte is linear in its bits, so each table is built from 8 basis values.
+// CRC_Bk_b is the CRC of a byte with only bit b set, followed by k zero bytes.
+enum {
+    CRC_B0_0 = CRC_S8(0x0100), CRC_B0_1 = CRC_S8(0x0200), CRC_B0_2 = CRC_S8(0x0400), CRC_B0_3 = CRC_S8(0x0800),
+    CRC_B0_4 = CRC_S8(0x1000), CRC_B0_5 = CRC_S8(0x2000), CRC_B0_6 = CRC_S8(0x4000), CRC_B0_7 = CRC_S8(0x8000),
+
+    CRC_B1_0 = CRC_S8(CRC_B0_0), CRC_B1_1 = CRC_S8(CRC_B0_1), CRC_B1_2 = CRC_S8(CRC_B0_2), CRC_B1_3 = CRC_S8(CRC_B0_3),
+    CRC_B1_4 = CRC_S8(CRC_B0_4), CRC_B1_5 = CRC_S8(CRC_B0_5), CRC_B1_6 = CRC_S8(CRC_B0_6), CRC_B1_7 = CRC_S8(CRC_B0_7),
+
+    CRC_B2_0 = CRC_S8(CRC_B1_0), CRC_B2_1 = CRC_S8(CRC_B1_1), CRC_B2_2 = CRC_S8(CRC_B1_2), CRC_B2_3 = CRC_S8(CRC_B1_3),
+    CRC_B2_4 = CRC_S8(CRC_B1_4), CRC_B2_5 = CRC_S8(CRC_B1_5), CRC_B2_6 = CRC_S8(CRC_B1_6), CRC_B2_7 = CRC_S8(CRC_B1_7),
+
+    CRC_B3_0 = CRC_S8(CRC_B2_0), CRC_B3_1 = CRC_S8(CRC_B2_1), CRC_B3_2 = CRC_S8(CRC_B2_2), CRC_B3_3 = CRC_S8(CRC_B2_3),
+    CRC_B3_4 = CRC_S8(CRC_B2_4), CRC_B3_5 = CRC_S8(CRC_B2_5), CRC_B3_6 = CRC_S8(CRC_B2_6), CRC_B3_7 = CRC_S8(CRC_B2_7),
+};
+
+#define CRC_E(k, n) ((((n) & 0x01) ? CRC_B##k##_0 : 0) ^ (((n) & 0x02) ? CRC_B##k##_1 : 0) ^ \
+                     (((n) & 0x04) ? CRC_B##k##_2 : 0) ^ (((n) & 0x08) ? CRC_B##k##_3 : 0) ^ \
+                     (((n) & 0x10) ? CRC_B##k##_4 : 0) ^ (((n) & 0x20) ? CRC_B##k##_5 : 0) ^ \
+                     (((n) & 0x40) ? CRC_B##k##_6 : 0) ^ (((n) & 0x80) ? CRC_B##k##_7 : 0))
+#define CRC_R4(k, n) CRC_E(k, n), CRC_E(k, (n) + 1), CRC_E(k, (n) + 2), CRC_E(k, (n) + 3)
+#define CRC_R16(k, n) CRC_R4(k, n), CRC_R4(k, (n) + 4), CRC_R4(k, (n) + 8), CRC_R4(k, (n) + 12)
+#define CRC_R64(k, n) CRC_R16(k, n), CRC_R16(k, (n) + 16), CRC_R16(k, (n) + 32), CRC_R16(k, (n) + 48)
+#define CRC_R256(k) CRC_R64(k, 0), CRC_R64(k, 64), CRC_R64(k, 128), CRC_R64(k, 192)
+
+// separate arrays so the linker can drop the slicing tables when they are not used
+static const uint16_t crc_tab0[256] = { CRC_R256(0) };
+static const uint16_t crc_tab1[256] = { CRC_R256(1) };
+static const uint16_t crc_tab2[256] = { CRC_R256(2) };
+static const uint16_t crc_tab3[256] = { CRC_R256(3) };
+
+uint16_t crc16_bitwise(uint16_t crc, const uint8_t *data_p, size_t length)
+{
+    uint8_t x;
+    while (length--) {
+        x = crc >> 8 ^ *data_p++;
+        x ^= x >> 4;
+        crc = (crc << 8) ^ ((uint16_t) (x << 12)) ^ ((uint16_t) (x << 5)) ^ ((uint16_t) x);
+    }
+    return crc;
+}
+
+uint16_t crc16_table(uint16_t crc, const uint8_t *data_p, size_t length)
+{
+    while (length--) {
+        crc = (uint16_t) ((crc << 8) ^ crc_tab0[(crc >> 8) ^ *data_p++]);
+    }
+    return crc;
+}
+
+uint16_t crc16_slice4(uint16_t crc, const uint8_t *data_p, size_t length)
+{
+    // the 16-bit register overlaps the first two bytes, the last two only go through the tables
+    while (length >= 4) {
+        crc = crc_tab3[(crc >> 8) ^ data_p[0]] ^ crc_tab2[(crc & 0xFF) ^ data_p[1]] ^
+              crc_tab1[data_p[2]] ^ crc_tab0[data_p[3]];
+        data_p += 4;
+        length -= 4;
+    }
+    return crc16_table(crc, data_p, length); // 0-3 leftover bytes
+}
+
+uint16_t calculate_crc(const uint8_t *data_p, size_t length)
+{
+#if CRC16_IMPL == CRC16_SLICE4
+    return crc16_slice4(CRC16_INIT, data_p, length);
+#elif CRC16_IMPL == CRC16_TABLE
+    return crc16_table(CRC16_INIT, data_p, length);
+#else
+    return crc16_bitwise(CRC16_INIT, data_p, length);
+#endif
+}
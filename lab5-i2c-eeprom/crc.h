@@ -0,0 +1,30 @@
+//
+// CRC-16/CCITT (poly 0x1021, init 0xFFFF) used to protect EEPROM log records.
+//
+
+#ifndef EEPROM_CRC_H
+#define EEPROM_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC16_INIT 0xFFFF
+
+// available implementations, select one with -DCRC16_IMPL=... at build time
+#define CRC16_BITWISE 0 // shift per byte, no tables
+#define CRC16_TABLE 1   // one 256-entry table, one lookup per byte
+#define CRC16_SLICE4 2  // four 256-entry tables, four bytes per step
+
+#ifndef CRC16_IMPL
+#define CRC16_IMPL CRC16_TABLE
+#endif
+
+// continue a CRC over more data (start from CRC16_INIT)
+uint16_t crc16_bitwise(uint16_t crc, const uint8_t *data_p, size_t length);
+uint16_t crc16_table(uint16_t crc, const uint8_t *data_p, size_t length);
+uint16_t crc16_slice4(uint16_t crc, const uint8_t *data_p, size_t length);
+
+// CRC of a whole buffer with the implementation picked by CRC16_IMPL
+uint16_t calculate_crc(const uint8_t *data_p, size_t length);
+
+#endif //EEPROM_CRC_H
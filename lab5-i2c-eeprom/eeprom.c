@@ -0,0 +1,349 @@
+//
+// The EEPROM does not acknowledge its address while a write cycle is running. Instead of sleeping
+// for the worst case after every write, the next access polls the address until it is acknowledged.
+//
+// One DMA channel feeds IC_DATA_CMD with command words (data bytes, then read commands), a second
+// one drains received bytes. The queue is advanced from eeprom_poll(), nothing runs in interrupts.
+//
+
+#include <string.h>
+#include "eeprom.h"
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+#include "crc.h"
+
+#define WRITE_RETRIES 5
+
+static eeprom_req * queue[EEPROM_QUEUE_LEN];
+static int queue_head = 0; // request on the bus (or next to go)
+static int queue_count = 0;
+
+static eeprom_req * active = NULL; // transfer on the bus, may be the probe
+static eeprom_req probe; // one byte read used for acknowledge polling
+static uint8_t probe_byte;
+static bool probe_wanted = false; // poll even with nothing queued (eeprom_wait_ready)
+
+static uint16_t cmd[EEPROM_MAX_XFER];
+static int tx_chan;
+static int rx_chan;
+static dma_channel_config tx_cfg;
+static dma_channel_config rx_cfg;
+
+static eeprom_geometry geo;
+
+static bool write_pending = false; // a write cycle may still be running
+static uint64_t write_done_us; // when the last write transaction ended
+static eeprom_ready_stats ready_stats = { .min_us = UINT32_MAX };
+static eeprom_bus_stats bus_stats;
+
+const uint eeprom_rates[EEPROM_RATE_COUNT] = { 100000, 400000, 1000000 };
+static uint rate = 0; // set by eeprom_set_rate, 0 while i2c_init's rate is in use
+
+void eeprom_init(const eeprom_geometry * geometry)
+{
+    geo = *geometry;
+
+    // TX: command words from memory to the controller, paced by its TX FIFO
+    tx_chan = dma_claim_unused_channel(true);
+    tx_cfg = dma_channel_get_default_config(tx_chan);
+    channel_config_set_transfer_data_size(&tx_cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&tx_cfg, true);
+    channel_config_set_write_increment(&tx_cfg, false);
+    channel_config_set_dreq(&tx_cfg, i2c_get_dreq(i2c1, true));
+
+    // RX: received bytes from the controller to the caller's buffer
+    rx_chan = dma_claim_unused_channel(true);
+    rx_cfg = dma_channel_get_default_config(rx_chan);
+    channel_config_set_transfer_data_size(&rx_cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&rx_cfg, false);
+    channel_config_set_write_increment(&rx_cfg, true);
+    channel_config_set_dreq(&rx_cfg, i2c_get_dreq(i2c1, false));
+
+    probe.rx = &probe_byte;
+    probe.len = 1;
+}
+
+const eeprom_geometry * eeprom_get_geometry(void)
+{
+    return &geo;
+}
+
+uint32_t eeprom_size(void)
+{
+    return geo.capacity * geo.chips;
+}
+
+size_t eeprom_span(uint32_t address, size_t len, bool write)
+{
+    // writes wrap inside a page, sequential reads inside the part the memory address bytes can reach
+    uint32_t block = geo.capacity;
+    if (geo.addr_bytes < 4 && block > 1UL << (8 * geo.addr_bytes)) block = 1UL << (8 * geo.addr_bytes);
+    if (write) block = geo.page_size;
+    size_t room = block - address % block;
+    if (len > room) len = room;
+    if (len > EEPROM_MAX_XFER - geo.addr_bytes) len = EEPROM_MAX_XFER - geo.addr_bytes;
+    return len;
+}
+
+static void transfer_start(eeprom_req * req)
+{
+    uint32_t address = req->address + req->done;
+    uint32_t offset = address % geo.capacity;
+    uint32_t chip = address / geo.capacity;
+    uint32_t block = geo.addr_bytes < 4 ? offset >> (8 * geo.addr_bytes) : 0;
+    req->chunk = eeprom_span(address, req->len - req->done, req->tx != NULL);
+
+    size_t n = 0;
+    for (int i = geo.addr_bytes - 1; i >= 0; --i) cmd[n++] = (uint8_t)(offset >> (8 * i)); // high byte first
+    for (size_t i = 0; i < req->chunk; ++i)
+    {
+        if (req->tx) cmd[n++] = req->tx[req->done + i];
+        else cmd[n++] = I2C_IC_DATA_CMD_CMD_BITS | (i == 0 ? I2C_IC_DATA_CMD_RESTART_BITS : 0); // repeated start, then read
+    }
+    cmd[n - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+    i2c_hw_t * hw = i2c_get_hw(i2c1);
+    hw->enable = 0;
+    hw->tar = EEPROM_DEVICE_ADDR | chip << geo.cs_shift | block << geo.block_shift;
+    hw->enable = 1;
+    (void)hw->clr_intr; // stop and abort flags from the previous transfer
+
+    req->status = EEPROM_REQ_ACTIVE;
+    req->start_us = time_us_64();
+    active = req;
+    if (req->rx) dma_channel_configure(rx_chan, &rx_cfg, &req->rx[req->done], &hw->data_cmd, req->chunk, true);
+    dma_channel_configure(tx_chan, &tx_cfg, &hw->data_cmd, cmd, n, true);
+}
+
+static bool transfer_finished(bool * ok)
+{
+    i2c_hw_t * hw = i2c_get_hw(i2c1);
+    uint32_t raw = hw->raw_intr_stat;
+
+    if (!(raw & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) return false; // still on the bus, an abort also ends with a stop
+    if (raw & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS)
+    {
+        // not acknowledged: the controller flushed its FIFO, stop feeding it
+        dma_channel_abort(tx_chan);
+        dma_channel_abort(rx_chan);
+        (void)hw->clr_tx_abrt;
+        (void)hw->clr_stop_det;
+        *ok = false;
+        return true;
+    }
+    if (dma_channel_is_busy(rx_chan)) return false; // last bytes still on their way to memory
+    (void)hw->clr_stop_det;
+    *ok = true;
+    return true;
+}
+
+static void ready_done(bool timeout)
+{
+    write_pending = false;
+    probe_wanted = false;
+    if (timeout)
+    {
+        ++ready_stats.timeouts; // give up, the next transfer reports the failure
+        return;
+    }
+    uint32_t elapsed = (uint32_t)(time_us_64() - write_done_us);
+    ++ready_stats.waits;
+    ready_stats.last_us = elapsed;
+    ready_stats.total_us += elapsed;
+    if (elapsed < ready_stats.min_us) ready_stats.min_us = elapsed;
+    if (elapsed > ready_stats.max_us) ready_stats.max_us = elapsed;
+}
+
+void eeprom_poll(void)
+{
+    bool ok;
+    if (active)
+    {
+        if (!transfer_finished(&ok)) return;
+        active->end_us = time_us_64();
+        ++bus_stats.transactions;
+        bus_stats.total_us += active->end_us - active->start_us;
+
+        if (active == &probe)
+        {
+            if (ok) ready_done(false);
+            else if (time_us_64() - write_done_us > WRITE_CYCLE_MAX_US) ready_done(true);
+            // still busy: probe again below
+        }
+        else if (!ok && active->retries-- > 0)
+        {
+            active->status = EEPROM_REQ_QUEUED; // stays at the head of the queue
+            write_pending = true; // most likely still busy with a write cycle, poll before retrying
+            write_done_us = active->end_us;
+            probe.address = active->address + active->done; // poll the chip that did not answer
+        }
+        else
+        {
+            if (ok && active->tx) // write cycle starts now - don't wait for it here
+            {
+                write_pending = true;
+                write_done_us = active->end_us;
+                probe.address = active->address + active->done;
+            }
+            if (ok) active->done += active->chunk;
+            if (ok && active->done < active->len)
+            {
+                active->status = EEPROM_REQ_QUEUED; // next page or block, stays at the head of the queue
+            }
+            else
+            {
+                active->status = ok ? EEPROM_REQ_DONE : EEPROM_REQ_FAILED;
+                queue_head = (queue_head + 1) % EEPROM_QUEUE_LEN;
+                --queue_count;
+            }
+        }
+        active = NULL;
+    }
+
+    if (write_pending && (queue_count || probe_wanted))
+    {
+        // previous write cycle has to finish before the EEPROM accepts the next transfer
+        ++ready_stats.polls;
+        probe.done = 0;
+        transfer_start(&probe);
+    }
+    else if (queue_count)
+    {
+        transfer_start(queue[queue_head]);
+    }
+}
+
+bool eeprom_busy(void)
+{
+    return active != NULL || queue_count > 0;
+}
+
+int eeprom_queue_space(void)
+{
+    return EEPROM_QUEUE_LEN - queue_count;
+}
+
+static bool submit(eeprom_req * req)
+{
+    if (queue_count == EEPROM_QUEUE_LEN || req->len == 0 || req->address + req->len > eeprom_size()) return false;
+    req->done = 0;
+    req->status = EEPROM_REQ_QUEUED;
+    queue[(queue_head + queue_count) % EEPROM_QUEUE_LEN] = req;
+    ++queue_count;
+    eeprom_poll(); // start right away if the bus is free
+    return true;
+}
+
+bool eeprom_read_async(eeprom_req * req, uint8_t * buffer, uint32_t address, size_t len)
+{
+    req->tx = NULL;
+    req->rx = buffer;
+    req->address = address;
+    req->len = len;
+    req->retries = 0;
+    return submit(req);
+}
+
+bool eeprom_write_async(eeprom_req * req, const uint8_t * data, uint32_t address, size_t len)
+{
+    req->tx = data;
+    req->rx = NULL;
+    req->address = address;
+    req->len = len;
+    req->retries = WRITE_RETRIES;
+    return submit(req);
+}
+
+bool eeprom_req_wait(eeprom_req * req)
+{
+    while (eeprom_req_busy(req)) eeprom_poll();
+    bool ok = req->status == EEPROM_REQ_DONE;
+    req->status = EEPROM_REQ_IDLE;
+    return ok;
+}
+
+bool eeprom_wait_ready(absolute_time_t deadline)
+{
+    probe_wanted = write_pending;
+    while (write_pending)
+    {
+        if (time_reached(deadline))
+        {
+            probe_wanted = false;
+            return false;
+        }
+        eeprom_poll();
+    }
+    return true;
+}
+
+const eeprom_ready_stats * eeprom_get_ready_stats(void)
+{
+    return &ready_stats;
+}
+
+const eeprom_bus_stats * eeprom_get_bus_stats(void)
+{
+    return &bus_stats;
+}
+
+bool i2c_read(uint8_t * buffer, uint32_t address, size_t len)
+{
+    if (address + len > eeprom_size()) return false;
+    eeprom_req req = { .status = EEPROM_REQ_IDLE };
+    while (!eeprom_read_async(&req, buffer, address, len)) eeprom_poll(); // wait for room in the queue
+    return eeprom_req_wait(&req);
+}
+
+bool i2c_write(const uint8_t * data, uint32_t address, size_t len)
+{
+    if (address + len > eeprom_size()) return false;
+    eeprom_req req = { .status = EEPROM_REQ_IDLE };
+    while (!eeprom_write_async(&req, data, address, len)) eeprom_poll();
+    return eeprom_req_wait(&req);
+}
+
+uint eeprom_set_rate(uint new_rate)
+{
+    while (eeprom_busy()) eeprom_poll(); // never change the clock under a transfer
+    eeprom_wait_ready(make_timeout_time_us(WRITE_CYCLE_MAX_US));
+    rate = i2c_set_baudrate(i2c1, new_rate);
+    return rate;
+}
+
+uint eeprom_get_rate(void)
+{
+    return rate;
+}
+
+bool eeprom_check_rate(uint check_rate, uint32_t scratch_address)
+{
+    uint8_t buffer[EEPROM_CHECK_LEN];
+    uint8_t check[EEPROM_CHECK_LEN];
+
+    // pattern depends on the rate, a pass can't come from what an earlier check left behind
+    for (int i = 0; i < EEPROM_CHECK_LEN - 2; ++i) buffer[i] = (uint8_t)((check_rate >> (i % 3 * 8)) + i * 0x5B);
+    uint16_t crc = calculate_crc(buffer, EEPROM_CHECK_LEN - 2);
+    buffer[EEPROM_CHECK_LEN - 2] = (uint8_t)(crc >> 8);
+    buffer[EEPROM_CHECK_LEN - 1] = (uint8_t)(crc & 0xFF);
+
+    eeprom_set_rate(check_rate);
+    if (!i2c_write(buffer, scratch_address, sizeof(buffer))) return false;
+    if (!eeprom_wait_ready(make_timeout_time_us(WRITE_CYCLE_MAX_US))) return false;
+
+    eeprom_req req = { .status = EEPROM_REQ_IDLE };
+    while (!eeprom_read_async(&req, check, scratch_address, sizeof(check))) eeprom_poll();
+    if (!eeprom_req_wait(&req)) return false;
+    return calculate_crc(check, sizeof(check)) == 0 && memcmp(check, buffer, sizeof(check)) == 0;
+}
+
+uint eeprom_probe_rate(uint32_t scratch_address, uint fallback)
+{
+    uint best = fallback;
+    for (int i = 0; i < EEPROM_RATE_COUNT; ++i)
+    {
+        if (!eeprom_check_rate(eeprom_rates[i], scratch_address)) break; // faster ones won't do better
+        best = eeprom_rates[i];
+    }
+    return eeprom_set_rate(best);
+}
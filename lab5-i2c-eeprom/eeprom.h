@@ -0,0 +1,112 @@
+//
+// I2C access to 24xx EEPROMs: reads, page writes and write cycle completion.
+// Transfers run from a small queue with DMA feeding the I2C controller, so the caller only
+// submits a request and checks on it later. The blocking calls are built on the same queue.
+// Addresses are linear over all chips on the bus, a request is split into bus transactions at
+// page (writes), block and chip (reads) boundaries as described by the geometry.
+//
+
+#ifndef EEPROM_EEPROM_H
+#define EEPROM_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+
+#define EEPROM_DEVICE_ADDR 0X50 // chip select and block bits are added to it
+#define WRITE_CYCLE_MAX_US 10000 // datasheet worst case for the internal write cycle
+#define EEPROM_QUEUE_LEN 4
+#define EEPROM_MAX_XFER 2048 // longest transfer in bytes, memory address included
+#define EEPROM_RATE_COUNT 3 // standard, fast and fast-plus mode
+#define EEPROM_CHECK_LEN 16 // bytes written and read back by the bus speed check, CRC included
+
+typedef struct eeprom_geometry {
+    uint16_t page_size; // write page, one write never crosses it
+    uint32_t capacity; // bytes per chip, power of two
+    uint8_t addr_bytes; // memory address bytes after the device address, higher bits go in the device address
+    uint8_t block_shift; // position of those higher bits in the device address
+    uint8_t cs_shift; // position of the chip select bits in the device address
+    uint8_t chips; // chips on the bus, strapped 0, 1, 2...
+} eeprom_geometry;
+
+#define EEPROM_24LC16 { .page_size = 16, .capacity = 2048, .addr_bytes = 1, .block_shift = 0, .cs_shift = 3, .chips = 1 }
+#define EEPROM_24LC256(n) { .page_size = 64, .capacity = 32768, .addr_bytes = 2, .block_shift = 0, .cs_shift = 0, .chips = (n) }
+#define EEPROM_24LC512(n) { .page_size = 128, .capacity = 65536, .addr_bytes = 2, .block_shift = 0, .cs_shift = 0, .chips = (n) }
+#define EEPROM_24LC1025(n) { .page_size = 128, .capacity = 131072, .addr_bytes = 2, .block_shift = 2, .cs_shift = 0, .chips = (n) }
+#define EEPROM_M24M02(n) { .page_size = 256, .capacity = 262144, .addr_bytes = 2, .block_shift = 0, .cs_shift = 2, .chips = (n) }
+
+typedef enum {
+    EEPROM_REQ_IDLE, // not submitted, or result already taken
+    EEPROM_REQ_QUEUED,
+    EEPROM_REQ_ACTIVE,
+    EEPROM_REQ_DONE,
+    EEPROM_REQ_FAILED
+} eeprom_req_status;
+
+typedef struct eeprom_req {
+    const uint8_t * tx; // data for writes, NULL for reads
+    uint8_t * rx; // read after a repeated start, NULL for writes
+    uint32_t address; // linear address of the first byte
+    size_t len;
+    size_t done; // bytes transferred by the transactions so far
+    size_t chunk; // bytes in the transaction on the bus
+    int retries; // resubmitted this many times if the EEPROM does not acknowledge
+    volatile eeprom_req_status status;
+    uint64_t start_us; // transfer start and end on the bus
+    uint64_t end_us;
+} eeprom_req;
+
+typedef struct eeprom_ready_stats {
+    uint32_t waits; // write cycles that completed
+    uint32_t timeouts; // write cycles that did not complete before the deadline
+    uint32_t polls; // address probes sent while waiting
+    uint32_t last_us; // write cycle time: from end of write until the EEPROM acknowledges again
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} eeprom_ready_stats;
+
+typedef struct eeprom_bus_stats {
+    uint32_t transactions; // bus transactions that finished, address probes included
+    uint64_t total_us; // time they spent on the bus
+} eeprom_bus_stats;
+
+void eeprom_init(const eeprom_geometry * geometry); // after i2c_init
+const eeprom_geometry * eeprom_get_geometry(void);
+uint32_t eeprom_size(void); // bytes on all chips
+size_t eeprom_span(uint32_t address, size_t len, bool write); // bytes from address that fit in one transaction
+
+// Non-blocking interface. Buffers must stay valid until the request is done.
+bool eeprom_read_async(eeprom_req * req, uint8_t * buffer, uint32_t address, size_t len);
+bool eeprom_write_async(eeprom_req * req, const uint8_t * data, uint32_t address, size_t len);
+void eeprom_poll(void); // advance the queue, call often
+bool eeprom_busy(void);
+int eeprom_queue_space(void); // requests that can be submitted right now
+
+static inline bool eeprom_req_busy(const eeprom_req * req)
+{
+    return req->status == EEPROM_REQ_QUEUED || req->status == EEPROM_REQ_ACTIVE;
+}
+
+bool eeprom_req_wait(eeprom_req * req); // true if the request completed without error
+
+// Blocking interface
+bool i2c_read(uint8_t * buffer, uint32_t address, size_t len); // false if the transfer failed
+bool i2c_write(const uint8_t * data, uint32_t address, size_t len);
+
+// Wait until the EEPROM has finished its internal write cycle, polling for an acknowledge.
+// Returns at once when no write is in progress, false if the deadline passes first.
+bool eeprom_wait_ready(absolute_time_t deadline);
+const eeprom_ready_stats * eeprom_get_ready_stats(void);
+const eeprom_bus_stats * eeprom_get_bus_stats(void); // running totals, callers take differences
+
+// Bus speed. Changing the rate waits for queued transfers and the write cycle to finish.
+// The check writes a CRC protected pattern to EEPROM_CHECK_LEN scratch bytes and reads it back.
+extern const uint eeprom_rates[EEPROM_RATE_COUNT]; // slowest first
+uint eeprom_set_rate(uint rate); // returns the rate actually set
+uint eeprom_get_rate(void);
+bool eeprom_check_rate(uint rate, uint32_t scratch_address); // leaves the bus at that rate
+uint eeprom_probe_rate(uint32_t scratch_address, uint fallback); // fastest rate that passes the check
+
+#endif //EEPROM_EEPROM_H
@@ -0,0 +1,86 @@
+//
+// The LED record is the newest one of its type in the log. Boot reads back as far as it has to for it,
+// but in ring mode it has to stay inside the ring, or the next boot starts with the LEDs off.
+//
+
+#include "led_persist.h"
+#include "log_index.h"
+
+void set_led_state(ledstate * ls, uint8_t value)
+{
+    ls->state = value;
+    ls->not_state = ~value;
+}
+
+bool led_state_is_valid(ledstate * ls)
+{
+    return ls->state == (uint8_t) ~ls->not_state;
+}
+
+uint8_t led_bits(led_persist * leds)
+{
+    uint8_t bits = 0;
+    for (int i=0;i<LED_COUNT;++i)
+    {
+        if (led_state_is_valid(&leds->leds[i]) && leds->leds[i].state) bits |= 1 << i;
+    }
+    return bits;
+}
+
+bool led_record_parse(const uint8_t * payload, uint8_t len, uint8_t * bits)
+{
+    log_event event;
+    if (!record_decode(payload, len, &event) || event.type != REC_LED || event.data_len != 2) return false;
+    if (event.data[0] != (uint8_t)~event.data[1]) return false; // same check as led_state_is_valid
+    *bits = event.data[0];
+    return true;
+}
+
+void led_record_seen(led_persist * leds, uint32_t seq, const uint8_t * payload, uint8_t len)
+{
+    if (led_record_parse(payload, len, &leds->saved)) leds->saved_seq = seq; // pages come oldest first, the newest record wins
+}
+
+bool led_page_scan(led_persist * leds, const uint8_t * data, uint16_t epoch)
+{
+    uint8_t saved = leds->saved;
+    int offset = PAGE_HDR_LEN;
+    int size;
+    if (!validate_page(data, epoch)) return false; // empty and stale pages hold no state
+    leds->saved = LED_NONE;
+    while ((size = page_next_record(data, &offset, NULL)) > 0)
+    {
+        led_record_seen(leds, page_seq(data), &data[offset + 1], data[offset]);
+        offset += size;
+    }
+    if (leds->saved != LED_NONE) return true;
+    leds->saved = saved;
+    return false;
+}
+
+bool led_persist_step(log_page * page, led_persist * leds)
+{
+    bool quiet = leds->dirty && time_us_64() - leds->last_toggle >= LED_QUIET_US;
+#if LOG_RING
+    // the ring overwrites the page once it comes back round to it, the record is written again just before
+    bool aging = leds->saved != LED_NONE && page->seq - leds->saved_seq >= LOG_SLOTS - 2;
+#else
+    bool aging = false; // the record stays until the log is erased, erase_state writes it again
+#endif
+    if (!quiet && !aging) return true;
+
+    uint8_t bits = led_bits(leds);
+    if (quiet && !aging && bits == leds->saved) // toggled back to what the log already has
+    {
+        leds->dirty = false;
+        return true;
+    }
+    uint8_t data[2] = { bits, (uint8_t)~bits };
+    if (!log_event_append(page, REC_LED, data, sizeof(data))) return false; // log full, erase makes room
+    if (bits != leds->saved) ++leds->records;
+    else ++leds->refreshes;
+    leds->dirty = false;
+    leds->saved = bits;
+    leds->saved_seq = page->seq;
+    return true;
+}
@@ -0,0 +1,45 @@
+//
+// LED state kept in the log: toggles are coalesced into one record once the buttons go quiet. Boot takes
+// the newest LED record, from the index window or, when there is none, from the older pages read back
+// newest first. In ring mode the record is written again before the ring comes round to its page, so a
+// restore never depends on how long ago the LEDs last changed. Only the log page code is used, the host
+// model runs it.
+//
+
+#ifndef EEPROM_LED_PERSIST_H
+#define EEPROM_LED_PERSIST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "log_page.h"
+
+#define LED_COUNT 3
+#define LED_NONE 0XFF // no LED record in the log
+#define LED_QUIET_US 2000000 // toggles are coalesced into one record after this long without presses
+
+typedef struct ledstate {
+    uint8_t state;
+    uint8_t not_state;
+} ledstate;
+
+typedef struct led_persist {
+    ledstate leds[LED_COUNT];
+    uint8_t saved; // LED bits in the newest record, LED_NONE if there is none
+    uint32_t saved_seq; // sequence number of the page holding that record
+    bool dirty; // toggled since the last record
+    uint64_t last_toggle;
+    uint64_t power_up;
+    uint32_t toggles;
+    uint32_t records; // LED records written for toggles, toggles - records writes saved
+    uint32_t refreshes; // records written again only to stay ahead of the ring
+} led_persist;
+
+void set_led_state(ledstate * ls, uint8_t value);
+bool led_state_is_valid(ledstate * ls);
+uint8_t led_bits(led_persist * leds);
+bool led_record_parse(const uint8_t * payload, uint8_t len, uint8_t * bits);
+void led_record_seen(led_persist * leds, uint32_t seq, const uint8_t * payload, uint8_t len); // boot index, oldest first
+bool led_page_scan(led_persist * leds, const uint8_t * data, uint16_t epoch); // true if the page has an LED record
+bool led_persist_step(log_page * page, led_persist * leds); // false when the log is full (LOG_RING 0)
+
+#endif //EEPROM_LED_PERSIST_H
@@ -0,0 +1,112 @@
+//
+// Index entries live in a ring so the oldest page can be dropped from the front when the
+// log wraps. The cache is replaced round robin, entries are matched by address and sequence number.
+//
+
+#include <string.h>
+#include "log_index.h"
+#include "log_record.h"
+
+typedef struct cache_slot {
+    bool used;
+    uint32_t seq;
+    uint32_t address;
+    uint8_t len;
+    uint8_t payload[LOG_CACHE_PAYLOAD];
+} cache_slot;
+
+static log_index_entry entries[LOG_INDEX_MAX];
+static int first = 0; // oldest entry
+static int count = 0;
+
+static cache_slot cache[LOG_CACHE_SLOTS];
+static int cache_next = 0; // slot replaced next
+
+static log_index_stats stats;
+
+void log_index_clear(void)
+{
+    first = 0;
+    count = 0;
+    for (int i = 0; i < LOG_CACHE_SLOTS; ++i) cache[i].used = false;
+}
+
+const log_index_entry * log_index_add(uint32_t seq, uint32_t address, const uint8_t * payload, uint8_t len)
+{
+    uint32_t time_ms = count ? entries[(first + count - 1) % LOG_INDEX_MAX].time_ms : 0;
+    record_clock(payload, len, &time_ms); // text records keep the time of the one before
+
+    if (count == LOG_INDEX_MAX) // should not happen with LOG_INDEX_MAX sized for the device, keep the newest
+    {
+        first = (first + 1) % LOG_INDEX_MAX;
+        --count;
+    }
+    log_index_entry * entry = &entries[(first + count) % LOG_INDEX_MAX];
+    entry->seq = seq;
+    entry->address = address;
+    entry->len = len;
+    entry->flags = LOG_INDEX_CRC_OK;
+    entry->type = RECORD_TYPE(payload[0]);
+    entry->time_ms = time_ms;
+    ++count;
+    return entry;
+}
+
+void log_index_drop_page(uint32_t page_address, uint16_t page_size)
+{
+    while (count > 0 && entries[first].address >= page_address && entries[first].address < page_address + page_size)
+    {
+        first = (first + 1) % LOG_INDEX_MAX;
+        --count;
+    }
+}
+
+int log_index_count(void)
+{
+    return count;
+}
+
+const log_index_entry * log_index_get(int i)
+{
+    return &entries[(first + i) % LOG_INDEX_MAX];
+}
+
+int log_index_find(uint32_t record_seq)
+{
+    int lo = 0;
+    int hi = count;
+    while (lo < hi) // entries are in record order
+    {
+        int mid = lo + (hi - lo) / 2;
+        const log_index_entry * entry = log_index_get(mid);
+        if (RECORD_SEQ(entry->seq, entry->address % LOG_MEM_SIZE) < record_seq) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+const uint8_t * log_cache_find(const log_index_entry * entry)
+{
+    for (int i = 0; i < LOG_CACHE_SLOTS; ++i)
+    {
+        if (cache[i].used && cache[i].address == entry->address && cache[i].seq == entry->seq) return cache[i].payload;
+    }
+    return NULL;
+}
+
+void log_cache_put(const log_index_entry * entry, const uint8_t * payload)
+{
+    if (entry->len > LOG_CACHE_PAYLOAD || log_cache_find(entry)) return;
+    cache_slot * slot = &cache[cache_next];
+    cache_next = (cache_next + 1) % LOG_CACHE_SLOTS;
+    slot->used = true;
+    slot->seq = entry->seq;
+    slot->address = entry->address;
+    slot->len = entry->len;
+    memcpy(slot->payload, payload, entry->len);
+}
+
+log_index_stats * log_index_get_stats(void)
+{
+    return &stats;
+}
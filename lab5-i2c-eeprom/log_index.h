@@ -0,0 +1,49 @@
+//
+// RAM index of the records in the EEPROM log, oldest first, plus a small payload cache.
+// Built once at boot and kept up to date on every append and erase, so reads only touch
+// the bus for payloads that are not cached. The type byte and absolute time of every record
+// are kept as a summary, queries pick their records from it before anything is read.
+//
+
+#ifndef EEPROM_LOG_INDEX_H
+#define EEPROM_LOG_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define INDEX_PAGES 31 // newest pages indexed at boot, boot cost stays the same for any EEPROM size
+#define LOG_INDEX_MAX (INDEX_PAGES * 14) // 14 smallest records per page
+#define LOG_CACHE_SLOTS 16
+#define LOG_CACHE_PAYLOAD 64
+
+#define LOG_INDEX_CRC_OK 0x01 // record CRC checked when it was indexed
+
+typedef struct log_index_entry {
+    uint32_t seq; // sequence number of the page holding the record
+    uint32_t address; // EEPROM address of the record's length byte
+    uint8_t len; // payload length
+    uint8_t flags;
+    uint8_t type; // first payload byte without REC_ABS
+    uint32_t time_ms; // absolute, relative to the oldest record until an absolute record is seen
+} log_index_entry;
+
+typedef struct log_index_stats {
+    uint32_t hits; // payloads served from RAM
+    uint32_t misses; // payloads fetched from the EEPROM
+    uint32_t bytes_saved; // bus bytes a full log read would have moved, minus what was actually read
+} log_index_stats;
+
+void log_index_clear(void);
+// add a record with a good CRC, drops the oldest entry when full
+const log_index_entry * log_index_add(uint32_t seq, uint32_t address, const uint8_t * payload, uint8_t len);
+void log_index_drop_page(uint32_t page_address, uint16_t page_size); // oldest page is being reused
+int log_index_count(void);
+const log_index_entry * log_index_get(int i); // 0 is the oldest record
+int log_index_find(uint32_t record_seq); // first entry with RECORD_SEQ >= record_seq, count if none
+
+const uint8_t * log_cache_find(const log_index_entry * entry);
+void log_cache_put(const log_index_entry * entry, const uint8_t * payload);
+
+log_index_stats * log_index_get_stats(void);
+
+#endif //EEPROM_LOG_INDEX_H
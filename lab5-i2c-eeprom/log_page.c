@@ -0,0 +1,210 @@
+//
+// A batch is written with two transfers that go through the queue in order, so the commit marker never
+// reaches the EEPROM before the records it seals.
+//
+
+#include <string.h>
+#include "log_page.h"
+#include "log_index.h"
+#include "crc.h"
+
+void page_start(log_page * page, uint32_t address, uint32_t seq)
+{
+    memset(page->data, TERM_NULL, LOG_MEM_SIZE);
+    page->address = address;
+    page->seq = seq;
+    page_header(page->data, page->epoch, seq);
+    page->fill = PAGE_HDR_LEN;
+    page->flushed = 0; // header goes out with the first records
+}
+
+void page_resume(log_page * page, const log_search * search)
+{
+    if (search->lo == 0)
+    {
+        page_start(page, FIRST_MEM_ADDR, page->seq); // empty log, numbers carry on from the epoch record
+        return;
+    }
+    // keep filling the newest page, appends after a torn record overwrite it
+    page->address = FIRST_MEM_ADDR + (search->lo - 1) * LOG_MEM_SIZE;
+    page->seq = search->first_seq + search->lo - 1;
+    page->fill = page->flushed = page_fill(page->data);
+    memset(&page->data[page->fill], TERM_NULL, LOG_MEM_SIZE - page->fill);
+}
+
+bool page_flush(log_page * page)
+{
+    // Two writes per batch: the records followed by an end of records marker, then the commit marker
+    // over that end marker. Without the second write boot treats the batch as torn and drops it.
+    if (page->flushed == page->fill) return true; // nothing buffered
+    if (eeprom_req_busy(&page->req)) eeprom_req_wait(&page->req); // previous flush still owns the tx buffers
+    if (eeprom_req_busy(&page->commit_req)) eeprom_req_wait(&page->commit_req);
+    if (eeprom_queue_space() < 2) return false; // both writes go in together, try again later
+
+    size_t len = page->fill - page->flushed;
+    memcpy(page->tx, &page->data[page->flushed], len);
+    page->tx[len++] = TERM_NULL; // log_append always leaves room for the marker
+    eeprom_write_async(&page->req, page->tx, page->address + page->flushed, len); // split at device pages if smaller
+
+    // the queue runs in order, so the marker is only written after the records are
+    uint8_t mark = page->fill;
+    page->data[mark] = COMMIT_MARK;
+    page->data[mark + 1] = commit_check(page->data, mark);
+    memcpy(page->commit_tx, &page->data[mark], COMMIT_LEN);
+    len = COMMIT_LEN;
+    if (mark + COMMIT_LEN < LOG_MEM_SIZE) page->commit_tx[len++] = TERM_NULL;
+    eeprom_write_async(&page->commit_req, page->commit_tx, page->address + mark, len);
+
+    page->fill = page->flushed = mark + COMMIT_LEN;
+    return true;
+}
+
+bool log_append(log_page * page, const uint8_t * payload, uint8_t len)
+{
+    int size = 1 + len + CRC_LEN;
+    if (len > MAX_RECORD_LEN) return false;
+
+    if (page->fill + size + COMMIT_LEN > LOG_MEM_SIZE) // no room left in this page, continue in the next one
+    {
+        while (!page_flush(page)) eeprom_poll(); // buffered records must be queued before the page is reused
+        uint32_t next = page->address + LOG_MEM_SIZE;
+        if (next > LAST_MEM_ADDR)
+        {
+#if LOG_RING
+            next = FIRST_MEM_ADDR; // wrap around and overwrite the oldest page
+#else
+            return false; // log is full
+#endif
+        }
+        log_index_drop_page(next, LOG_MEM_SIZE); // records of a reused page leave the index
+        page_start(page, next, page->seq + 1);
+    }
+
+    const log_index_entry * entry = log_index_add(page->seq, page->address + page->fill, payload, len);
+    log_cache_put(entry, payload); // fresh records are the ones most likely to be read back
+
+    uint8_t * record = &page->data[page->fill];
+    record[0] = len;
+    memcpy(&record[1], payload, len);
+    uint16_t crc = calculate_crc(record, 1 + len); // CRC covers the length byte and the payload
+    record[1 + len] = (uint8_t)(crc >> 8);
+    record[2 + len] = (uint8_t)(crc & 0xFF);
+    page->fill += size;
+    page->last_append = time_us_64();
+
+    if (page->fill + 2 + CRC_LEN + COMMIT_LEN > LOG_MEM_SIZE) page_flush(page); // page can't take more, no point waiting
+    return true;
+}
+
+bool log_event_append(log_page * page, uint8_t type, const uint8_t * data, uint8_t data_len)
+{
+    // A delta is only valid after the record before it on the same page: the first record of a page,
+    // including the first one after an erase, carries the uptime instead.
+    static uint64_t last_ms=0; // time of the previous record
+    uint64_t now_ms = time_us_64() / 1000;
+    uint8_t payload[MAX_RECORD_LEN];
+    if (1 + VARINT_MAX_LEN + data_len > MAX_RECORD_LEN) return false;
+
+    size_t len = record_encode(payload, type, (uint32_t)(now_ms - last_ms), data, data_len);
+    bool first_on_page = page->fill == PAGE_HDR_LEN || page->fill + 1 + len + CRC_LEN + COMMIT_LEN > LOG_MEM_SIZE;
+    if (type == REC_BOOT || first_on_page)
+    {
+        len = record_encode(payload, type == REC_BOOT ? type : type | REC_ABS, (uint32_t)now_ms, data, data_len);
+    }
+    if (!log_append(page, payload, len)) return false;
+    last_ms = now_ms;
+    return true;
+}
+
+bool read_epoch(uint16_t * epoch, uint32_t * first_seq)
+{
+    uint8_t buffer[EPOCH_AREA_LEN];
+    for (int i = 0; i < EPOCH_READ_TRIES; ++i)
+    {
+        if (!i2c_read(buffer, EPOCH_MEM_ADDR, sizeof(buffer))) continue; // NACK or bus error, try again
+        if (!epoch_pick(buffer, epoch, first_seq)) *epoch = *first_seq = 0; // neither copy was ever written, the part is new
+        return true;
+    }
+    return false;
+}
+
+bool log_erase(log_page * page)
+{
+    // Erasing only moves to the next epoch: one write, every older page stops being valid.
+    // It goes over the older copy, if the write is torn the current epoch is still read at boot.
+    uint8_t buffer[EPOCH_REC_LEN];
+
+    // The epoch record keeps the first sequence number of the new log, so a boot that finds it empty
+    // does not start again from 0 and reuse numbers of the erased records.
+    uint16_t next_epoch = page->epoch + 1;
+    uint32_t first_seq = page->seq + 1;
+    epoch_encode(buffer, next_epoch, first_seq);
+    if (!i2c_write(buffer, epoch_address(next_epoch), sizeof(buffer))) return false;
+
+    page->epoch = next_epoch;
+    log_index_clear();
+    page_start(page, FIRST_MEM_ADDR, first_seq); // buffered records are dropped, sequence numbers keep counting
+    return true;
+}
+
+void scrub_step(uint32_t * scrub_address, const log_page * page)
+{
+    // Clear stale pages left behind by a logical erase, one page per call. Pages up to the one
+    // being filled belong to the current epoch, so the scrub only touches the part of the log after it.
+    static eeprom_req read_req;
+    static eeprom_req write_req;
+    static uint8_t buffer[PAGE_HDR_LEN];
+
+    if (eeprom_req_busy(&read_req) || eeprom_req_busy(&write_req)) return;
+
+    if (read_req.status == EEPROM_REQ_IDLE)
+    {
+        if (*scrub_address <= page->address) *scrub_address = page->address + LOG_MEM_SIZE;
+        if (*scrub_address > LAST_MEM_ADDR)
+        {
+            *scrub_address = SCRUB_DONE;
+            return;
+        }
+        eeprom_read_async(&read_req, buffer, *scrub_address, PAGE_HDR_LEN);
+        return;
+    }
+
+    // header has arrived
+    bool ok = read_req.status == EEPROM_REQ_DONE;
+    read_req.status = EEPROM_REQ_IDLE;
+    write_req.status = EEPROM_REQ_IDLE;
+
+    bool empty = true;
+    for (int i = 0; i < PAGE_HDR_LEN; ++i) if (buffer[i] != TERM_NULL) empty = false;
+
+    // only write pages that are not already empty, in ring mode the oldest pages live after the head,
+    // and the log may have moved onto this page while the header was being read
+    if (ok && !empty && !validate_page(buffer, page->epoch) && *scrub_address > page->address)
+    {
+        memset(buffer, TERM_NULL, PAGE_HDR_LEN); // zeroed header never passes the CRC check
+        eeprom_write_async(&write_req, buffer, *scrub_address, PAGE_HDR_LEN);
+    }
+    *scrub_address += LOG_MEM_SIZE;
+}
+
+uint32_t index_window(const log_page * page)
+{
+#if LOG_RING
+    uint32_t before = LOG_SLOTS - 1; // oldest page follows the one being filled once the log has wrapped
+#else
+    uint32_t before = (page->address - FIRST_MEM_ADDR) / LOG_MEM_SIZE;
+#endif
+    return before < INDEX_PAGES - 1 ? before : INDEX_PAGES - 1;
+}
+
+uint32_t older_pages(const log_page * page, uint32_t * first_address)
+{
+    uint32_t slot = (page->address - FIRST_MEM_ADDR) / LOG_MEM_SIZE;
+#if LOG_RING
+    *first_address = FIRST_MEM_ADDR + (slot + 1) % LOG_SLOTS * LOG_MEM_SIZE; // the previous lap, if there was one
+    return LOG_SLOTS - 1 - index_window(page);
+#else
+    *first_address = FIRST_MEM_ADDR;
+    return slot - index_window(page);
+#endif
+}
@@ -0,0 +1,55 @@
+//
+// The log page being filled: records are buffered in RAM and written in batches, each sealed by a commit
+// marker, and the log moves on to the next page once this one is full. Also the epoch (erase) and the
+// background scrub of stale pages. Only the EEPROM queue is used, so the same code runs on the host model.
+//
+
+#ifndef EEPROM_LOG_PAGE_H
+#define EEPROM_LOG_PAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "eeprom.h"
+#include "log_record.h"
+
+#ifndef LOG_RING
+#define LOG_RING 1 // 1: overwrite the oldest record when the log is full, 0: erase when full
+#endif
+
+#define LAST_MEM_ADDR (eeprom_size() - LOG_MEM_SIZE)
+#define LOG_SLOTS ((LAST_MEM_ADDR - FIRST_MEM_ADDR) / LOG_MEM_SIZE + 1)
+#define SCRUB_DONE UINT32_MAX
+#define EPOCH_READ_TRIES 5 // boot stalls after this many failed reads, none is ever taken as epoch 0 or a free page
+
+typedef struct log_page {
+    uint32_t address; // EEPROM address of the page being filled
+    uint32_t seq; // sequence number of that page
+    uint16_t epoch; // pages from other epochs count as erased
+    uint8_t fill; // bytes of data in use (header + records)
+    uint8_t flushed; // bytes of data already written to the EEPROM
+    uint64_t last_append; // time of the last append, buffered records are written after a quiet period
+    uint8_t data[LOG_MEM_SIZE];
+    eeprom_req req; // flush in progress
+    uint8_t tx[LOG_MEM_SIZE]; // bytes being flushed
+    eeprom_req commit_req; // commit marker for that flush
+    uint8_t commit_tx[COMMIT_LEN + 1];
+} log_page;
+
+void page_start(log_page * page, uint32_t address, uint32_t seq);
+// After the boot search: fills on the newest page it found, which the caller has read into page->data,
+// or starts an empty log at the first page with page->seq from the epoch record.
+void page_resume(log_page * page, const log_search * search);
+bool page_flush(log_page * page); // false if the queue has no room for both writes, try again later
+bool log_append(log_page * page, const uint8_t * payload, uint8_t len); // false when the log is full (LOG_RING 0)
+bool log_event_append(log_page * page, uint8_t type, const uint8_t * data, uint8_t data_len);
+
+bool read_epoch(uint16_t * epoch, uint32_t * first_seq); // false if the EEPROM does not answer
+bool log_erase(log_page * page); // next epoch, the log starts over at the first page with the next sequence number
+void scrub_step(uint32_t * scrub_address, const log_page * page); // clears one stale page after an erase
+
+uint32_t index_window(const log_page * page); // pages before the one being filled that the boot index covers
+// Slots of the log older than the index window, oldest first from *first_address. Some of them may be empty
+// or left over from an older epoch, they fail validate_page.
+uint32_t older_pages(const log_page * page, uint32_t * first_address);
+
+#endif //EEPROM_LOG_PAGE_H
@@ -0,0 +1,289 @@
+//
+// Page walking and the record codec. Nothing here touches the hardware, so the same file builds for the host tools.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "log_record.h"
+#include "crc.h"
+
+bool validate_page(const uint8_t * page, uint16_t epoch)
+{
+    if (calculate_crc(page, PAGE_HDR_LEN) != 0) return false; // empty, scrubbed or torn header
+    return (uint16_t)(page[0] << 8 | page[1]) == epoch; // a page left over from before the last erase is treated as empty
+}
+
+uint32_t page_seq(const uint8_t * page)
+{
+    const uint8_t * seq_p = page + EPOCH_LEN; // sequence number follows epoch
+    return (uint32_t)seq_p[0] << 24 | (uint32_t)seq_p[1] << 16 | (uint32_t)seq_p[2] << 8 | seq_p[3];
+}
+
+int record_span(const uint8_t * page, int offset)
+{
+    if (offset + 1 + CRC_LEN > LOG_MEM_SIZE) return 0; // page is full
+    uint8_t len = page[offset];
+    if (len == TERM_NULL || len > MAX_RECORD_LEN || offset + 1 + len + CRC_LEN > LOG_MEM_SIZE) return 0; // end of records
+    return 1 + len + CRC_LEN; // length byte + payload + 2 byte CRC
+}
+
+uint8_t commit_check(const uint8_t * page, int offset)
+{
+    uint8_t buffer[SEQ_LEN + 1];
+    memcpy(buffer, page + EPOCH_LEN, SEQ_LEN); // sequence numbers never repeat, neither do markers
+    buffer[SEQ_LEN] = (uint8_t)offset;
+    return (uint8_t)calculate_crc(buffer, sizeof(buffer));
+}
+
+bool is_commit(const uint8_t * page, int offset)
+{
+    return offset + COMMIT_LEN <= LOG_MEM_SIZE && page[offset] == COMMIT_MARK && page[offset + 1] == commit_check(page, offset);
+}
+
+static bool committed(const uint8_t * page, int offset)
+{
+    // records up to the next marker belong to one batch
+    int size;
+    while (!is_commit(page, offset))
+    {
+        if ((size = record_span(page, offset)) == 0) return false; // batch never got its marker
+        offset += size;
+    }
+    return true;
+}
+
+int page_next_record(const uint8_t * page, int * offset, int * torn)
+{
+    int o = *offset;
+    int size;
+    while (o < LOG_MEM_SIZE)
+    {
+        if (is_commit(page, o))
+        {
+            o += COMMIT_LEN;
+            continue;
+        }
+        if ((size = record_span(page, o)) == 0 || !committed(page, o)) return 0;
+        if (calculate_crc(&page[o], size) == 0)
+        {
+            *offset = o;
+            return size;
+        }
+        if (torn) ++*torn; // the length byte survived, the records after it are still good
+        o += size;
+    }
+    return 0;
+}
+
+uint8_t page_fill(const uint8_t * page)
+{
+    int offset = PAGE_HDR_LEN;
+    int end = PAGE_HDR_LEN; // after the last marker
+    int size;
+    while (offset < LOG_MEM_SIZE)
+    {
+        if (is_commit(page, offset))
+        {
+            offset += COMMIT_LEN;
+            end = offset;
+        }
+        else if ((size = record_span(page, offset)) > 0)
+        {
+            offset += size; // walk the packed records
+        }
+        else
+        {
+            break;
+        }
+    }
+    return (uint8_t)end;
+}
+
+void page_header(uint8_t * page, uint16_t epoch, uint32_t seq)
+{
+    page[0] = (uint8_t)(epoch >> 8);
+    page[1] = (uint8_t)(epoch & 0xFF);
+    page[2] = (uint8_t)(seq >> 24);
+    page[3] = (uint8_t)(seq >> 16);
+    page[4] = (uint8_t)(seq >> 8);
+    page[5] = (uint8_t)(seq & 0xFF);
+    uint16_t crc = calculate_crc(page, EPOCH_LEN + SEQ_LEN);
+    page[6] = (uint8_t)(crc >> 8);
+    page[7] = (uint8_t)(crc & 0xFF);
+}
+
+void epoch_encode(uint8_t * record, uint16_t epoch, uint32_t first_seq)
+{
+    record[0] = (uint8_t)(epoch >> 8);
+    record[1] = (uint8_t)(epoch & 0xFF);
+    for (int i = 0; i < SEQ_LEN; ++i) record[EPOCH_LEN + i] = (uint8_t)(first_seq >> (8 * (SEQ_LEN - 1 - i)));
+    uint16_t crc = calculate_crc(record, EPOCH_LEN + SEQ_LEN);
+    record[EPOCH_LEN + SEQ_LEN] = (uint8_t)(crc >> 8);
+    record[EPOCH_LEN + SEQ_LEN + 1] = (uint8_t)(crc & 0xFF);
+}
+
+uint32_t epoch_address(uint16_t epoch)
+{
+    return EPOCH_MEM_ADDR + (epoch & 1) * EPOCH_COPY_STRIDE;
+}
+
+bool epoch_pick(const uint8_t * area, uint16_t * epoch, uint32_t * first_seq)
+{
+    const uint8_t * copy[2] = { area, area + EPOCH_COPY_STRIDE };
+    bool valid[2];
+    uint16_t value[2];
+    uint32_t seq[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        valid[i] = calculate_crc(copy[i], EPOCH_REC_LEN) == 0; // blank or torn copies fail the CRC
+        value[i] = (uint16_t)(copy[i][0] << 8 | copy[i][1]);
+        seq[i] = valid[i] ? page_seq(copy[i]) : 0; // epoch and sequence number laid out as in a page header
+        if (!valid[i]) valid[i] = calculate_crc(copy[i], EPOCH_OLD_REC_LEN) == 0;
+    }
+    if (!valid[0] && !valid[1]) return false;
+    int newer = valid[0] && valid[1] ? (int16_t)(value[1] - value[0]) > 0 : valid[1]; // survives the wrap at 65535
+    *epoch = value[newer];
+    *first_seq = seq[newer];
+    return true;
+}
+
+void log_search_start(log_search * search, uint32_t slots)
+{
+    search->lo = 0;
+    search->hi = slots;
+    search->first_seq = 0;
+    search->slot = 0; // first page first, it gives the sequence number to compare against
+    search->reads = 0;
+    search->failed = 0;
+}
+
+bool log_search_step(log_search * search, const uint8_t * page, uint16_t epoch)
+{
+    ++search->reads;
+    if (!page)
+    {
+        ++search->failed;
+        return true; // same slot again, taking it as free would move the head back over the log
+    }
+    search->failed = 0;
+    uint32_t slot = search->slot;
+    bool valid = validate_page(page, epoch);
+    if (search->lo == 0 && slot > 0) // the last slot, read because slot 0 was not valid
+    {
+        // A ring rewrites slot 0 when it wraps. If that write was cut, the last slot holds the newest page
+        // of the log, otherwise the log is empty.
+        if (valid) search->first_seq = page_seq(page) - slot;
+        search->lo = search->hi = valid ? slot + 1 : 0;
+        return false;
+    }
+    if (valid && (slot == 0 || page_seq(page) == search->first_seq + slot))
+    {
+        if (slot == 0) search->first_seq = page_seq(page);
+        search->lo = slot + 1;
+    }
+    else if (slot == 0 && search->hi > 1)
+    {
+        search->slot = search->hi - 1;
+        return true;
+    }
+    else
+    {
+        search->hi = slot;
+    }
+    // In ring mode the pages after the head hold older records, their sequence numbers are
+    // one lap behind, so the same search stops at the oldest page.
+    search->slot = search->lo + (search->hi - search->lo) / 2;
+    return search->lo < search->hi;
+}
+
+size_t varint_encode(uint8_t * out, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0X80)
+    {
+        out[n++] = (uint8_t)(value | 0X80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+size_t varint_decode(const uint8_t * in, size_t len, uint32_t * value)
+{
+    *value = 0;
+    for (size_t n = 0; n < len && n < VARINT_MAX_LEN; ++n)
+    {
+        *value |= (uint32_t)(in[n] & 0X7F) << (7 * n);
+        if (!(in[n] & 0X80)) return n + 1;
+    }
+    return 0;
+}
+
+size_t record_encode(uint8_t * payload, uint8_t type, uint32_t time_ms, const uint8_t * data, uint8_t data_len)
+{
+    size_t n = 0;
+    payload[n++] = type;
+    n += varint_encode(&payload[n], time_ms);
+    if (data_len) memcpy(&payload[n], data, data_len);
+    return n + data_len;
+}
+
+bool record_decode(const uint8_t * payload, uint8_t len, log_event * event)
+{
+    if (len < 2 || payload[0] >= REC_TEXT_MIN) return false;
+    size_t n = varint_decode(&payload[1], len - 1, &event->time_ms);
+    if (n == 0) return false;
+    event->type = RECORD_TYPE(payload[0]);
+    event->absolute = event->type == REC_BOOT || (payload[0] & REC_ABS);
+    event->data = &payload[1 + n];
+    event->data_len = (uint8_t)(len - 1 - n);
+    return true;
+}
+
+const char * record_type_name(uint8_t type)
+{
+    switch (type)
+    {
+        case REC_LED: return "LEDs";
+        case REC_BOOT: return "Boot";
+        case REC_TEST: return "Test";
+        default: return NULL;
+    }
+}
+
+bool record_clock(const uint8_t * payload, uint8_t len, uint32_t * clock_ms)
+{
+    log_event event;
+    if (!record_decode(payload, len, &event)) return false;
+    if (event.absolute) *clock_ms = event.time_ms; // new timebase after a boot, same one otherwise
+    else *clock_ms += event.time_ms;
+    return true;
+}
+
+int record_describe(char * out, size_t size, const uint8_t * payload, uint8_t len, uint32_t * clock_ms)
+{
+    log_event event;
+    if (!record_clock(payload, len, clock_ms))
+    {
+        if (len > 0 && payload[0] >= REC_TEXT_MIN) return snprintf(out, size, "%.*s", len, (const char *)payload);
+        return snprintf(out, size, "unknown record");
+    }
+    record_decode(payload, len, &event);
+    unsigned long t = (unsigned long)*clock_ms;
+
+    switch (event.type)
+    {
+        case REC_BOOT:
+        case REC_TEST:
+            return snprintf(out, size, "%s at %lu ms", record_type_name(event.type), t);
+        case REC_LED:
+            if (event.data_len == 2 && event.data[0] == (uint8_t)~event.data[1])
+            {
+                uint8_t bits = event.data[0];
+                return snprintf(out, size, "LEDs %d %d %d at %lu ms", bits & 1, bits >> 1 & 1, bits >> 2 & 1, t);
+            }
+            return snprintf(out, size, "bad LED record at %lu ms", t);
+        default:
+            return snprintf(out, size, "type 0X%02X at %lu ms", event.type, t);
+    }
+}
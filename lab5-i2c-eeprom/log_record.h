@@ -0,0 +1,118 @@
+//
+// Log page and record format, shared by the firmware and the host tools.
+//
+// The first 64 bytes hold two copies of the epoch record (epoch, first sequence number of the log, CRC).
+// Erase writes the next epoch over the older copy, so a torn write leaves the other one intact, and the newer
+// valid copy is the current epoch. The sequence number lets an empty log carry on from the erased one.
+// Page: header (epoch, sequence number, CRC), then packed records: length, payload, CRC, with a
+// zero length byte after the last one. Every batch of records is written first and then sealed by a
+// commit marker in a second write, records without a marker after them were torn by a power loss.
+// Payload: type byte, varint timestamp, typed data.
+// The timestamp of a boot record, or of a record with REC_ABS set in its type byte, is the uptime in ms,
+// every other record stores the ms since the record before it. The first record of every page is absolute,
+// so a page can be timed without the ones before it, which an erase or the ring may have overwritten.
+// Varints are little endian base 128, 7 bits per byte, high bit set on all but the last.
+//
+
+#ifndef EEPROM_LOG_RECORD_H
+#define EEPROM_LOG_RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define LOG_MEM_SIZE 64
+#define EPOCH_MEM_ADDR 0X0000 // epoch page, log starts after it
+#define EPOCH_COPY_STRIDE 0X10 // copies sit in different device pages even on 16 byte page parts
+#define FIRST_MEM_ADDR 0X0040
+#define EPOCH_LEN 2 // page header: epoch (big endian)
+#define SEQ_LEN 4 // page header: sequence number (big endian)
+#define CRC_LEN 2
+#define PAGE_HDR_LEN (EPOCH_LEN + SEQ_LEN + CRC_LEN) // records are packed after the header: length, payload, CRC
+#define EPOCH_REC_LEN (EPOCH_LEN + SEQ_LEN + CRC_LEN)
+#define EPOCH_OLD_REC_LEN (EPOCH_LEN + CRC_LEN) // written before the sequence number was added
+#define EPOCH_AREA_LEN (EPOCH_COPY_STRIDE + EPOCH_REC_LEN) // both copies in one read
+#define COMMIT_MARK 0XFF // never a record length
+#define COMMIT_LEN 2 // marker + check byte tied to the page and offset, stale markers from older data don't match
+#define MAX_RECORD_LEN (LOG_MEM_SIZE - PAGE_HDR_LEN - 1 - CRC_LEN - COMMIT_LEN)
+#define TERM_NULL 0X00
+#define VARINT_MAX_LEN 5 // 32 bit value
+#define RECORD_SEQ(page_seq, offset) ((uint32_t)(page_seq) * LOG_MEM_SIZE + (offset)) // grows with every record, never reused
+
+// record types, anything from 0x20 up is an old plain text record
+#define REC_LED 0X01 // data: LED bits and their complement
+#define REC_BOOT 0X02 // no data, timestamp is the uptime
+#define REC_TEST 0X03 // no data
+#define REC_TEXT_MIN 0X20
+#define REC_ABS 0X10 // type byte flag: the timestamp is the uptime, not a delta
+#define RECORD_TYPE(type_byte) ((type_byte) < REC_TEXT_MIN ? (type_byte) & ~REC_ABS : (type_byte))
+
+// Export frames: sync, type, offset, length, payload, CRC over type..payload (big endian).
+// The sync bytes and the CRC let the receiver skip console text printed between frames.
+#define EXPORT_SYNC0 0XA5
+#define EXPORT_SYNC1 0X5A
+#define EXPORT_HDR_LEN 9 // sync(2) type offset(4) length(2)
+#define EXPORT_CHUNK 256 // largest payload
+#define EXPORT_START 0X01 // payload: image size (4), page size (1)
+#define EXPORT_DATA 0X02 // payload: image bytes at offset
+#define EXPORT_END 0X03 // payload: frames sent including this one (4)
+
+typedef struct log_event {
+    uint8_t type; // without REC_ABS
+    bool absolute; // boot record or REC_ABS set
+    uint32_t time_ms; // uptime when absolute, delta to the previous record otherwise
+    const uint8_t * data; // points into the payload
+    uint8_t data_len;
+} log_event;
+
+bool validate_page(const uint8_t * page, uint16_t epoch);
+uint32_t page_seq(const uint8_t * page);
+int record_span(const uint8_t * page, int offset); // size from the length byte, 0 at the end of the records
+uint8_t commit_check(const uint8_t * page, int offset); // check byte of a marker at offset
+bool is_commit(const uint8_t * page, int offset);
+// Next committed record with a good CRC from *offset on, torn records are skipped and counted in torn
+// (may be NULL). Moves *offset to the record and returns its size, 0 when there are no more.
+int page_next_record(const uint8_t * page, int * offset, int * torn);
+uint8_t page_fill(const uint8_t * page); // offset after the last commit marker, where the next batch goes
+void page_header(uint8_t * page, uint16_t epoch, uint32_t seq);
+
+void epoch_encode(uint8_t * record, uint16_t epoch, uint32_t first_seq);
+uint32_t epoch_address(uint16_t epoch); // copy an epoch is written to, the two copies take turns
+// newer valid copy of EPOCH_AREA_LEN bytes, false if neither is. Old records without a sequence number give 0.
+bool epoch_pick(const uint8_t * area, uint16_t * epoch, uint32_t * first_seq);
+
+// Boot search for the newest page. Pages carry consecutive sequence numbers from the first slot, so the log
+// is the run of slots where seq == first_seq + slot, and a binary search finds its end. When the first slot
+// is not valid the last one is read too: a ring whose wrap to the first slot was cut ends there.
+typedef struct log_search {
+    uint32_t lo; // slots [0, lo) belong to the log
+    uint32_t hi; // slots [hi, slots) are free
+    uint32_t first_seq;
+    uint32_t slot; // slot to read next
+    int reads; // failed ones included
+    int failed; // reads of slot that failed in a row
+} log_search;
+
+void log_search_start(log_search * search, uint32_t slots);
+// Feed the page read from search->slot, NULL if the read failed: the slot is read again then, a page that
+// could not be read is never taken as a free one. Returns true while more pages are needed, then lo is the
+// number of pages in the log and the newest one has sequence number first_seq + lo - 1.
+bool log_search_step(log_search * search, const uint8_t * page, uint16_t epoch);
+
+size_t varint_encode(uint8_t * out, uint32_t value);
+size_t varint_decode(const uint8_t * in, size_t len, uint32_t * value); // 0 if truncated
+
+size_t record_encode(uint8_t * payload, uint8_t type, uint32_t time_ms, const uint8_t * data, uint8_t data_len);
+bool record_decode(const uint8_t * payload, uint8_t len, log_event * event); // false for text records and bad payloads
+
+const char * record_type_name(uint8_t type); // NULL for text records and unknown types
+
+// Apply the timestamp of a record to the running absolute time, false if the record has none.
+// Absolute records set the clock, the others add to it.
+bool record_clock(const uint8_t * payload, uint8_t len, uint32_t * clock_ms);
+
+// One line description of a record payload. clock_ms is the running absolute time, updated by
+// every timestamped record, start it at 0 (times before the first absolute record are relative).
+int record_describe(char * out, size_t size, const uint8_t * payload, uint8_t len, uint32_t * clock_ms);
+
+#endif //EEPROM_LOG_RECORD_H
@@ -6,27 +6,37 @@
 #include <string.h>
 #include "pico/stdlib.h"
 #include <ctype.h>
+#include <stdlib.h>
 
 #include "hardware/i2c.h"
 
+#include "crc.h"
+#include "eeprom.h"
+#include "log_index.h"
+#include "log_record.h"
+#include "log_page.h"
+#include "led_persist.h"
+
 #define I2C1_SDA 14
 #define I2C1_SCL 15
 
-#define FREQ 9600
+#define FREQ 9600 // used when none of the standard rates passes the check
 #define US_TO_S 1000000
 
-#define SLEEP 5
-#define CRC_MSB_INDEX 62
-#define LAST_MEM_ADDR 0x7C0
-#define LOG_MEM_SIZE 64
-#define FIRST_MEM_ADDR 0X0000
-#define TERM_NULL 0X00
+#define SLEEP 5 // button debounce, ms
+#define GPIO_COUNT 30
+#define EEPROM_CHIP EEPROM_24LC256(1) // geometry of the parts on the bus, see eeprom.h
+#define SCRATCH_MEM_ADDR 0X0020 // second half of the epoch page, written by the bus speed check and bench
+#define SCRATCH_LEN 32
+#define BENCH_ROUNDS 4
+#define EXPORT_SIZE eeprom_size() // epoch page + log region
+#define READ_CHUNK_SIZE (INDEX_PAGES * LOG_MEM_SIZE) // whole index window in one read, any multiple of LOG_MEM_SIZE streams it in pieces
+#define FLUSH_DELAY_US 1000000 // buffered records are written after this long without appends
 #define MAX_STR_LEN 62 // 61 chars + terminating null
 
-typedef struct ledstate {
-    uint8_t state;
-    uint8_t not_state;
-} ledstate;
+#define SM_STATS 1 // 1: time every state machine tick for the stats command, 0: compile the timing out
+#define STATS_CALIBRATE_ROUNDS 1000 // timed bookkeeping runs when the overhead is measured
+
 
 //global variables
 
@@ -38,33 +48,70 @@ uint SW_0=7;
 uint SW_1=8;
 uint SW_2=9;
 
-uint8_t device_addr=0X50;
+const eeprom_geometry geometry = EEPROM_CHIP;
 
 typedef enum {
     bootScan,
+    bootIndex,
+    bootLeds,
     erase,
     write,
     read,
+    bench,
+    exportLog,
     userInput
     } eeprom_st;
 
+#define STATE_COUNT (userInput + 1)
+
+#if SM_STATS
+typedef struct state_stats {
+    uint32_t ticks;
+    uint64_t total_us; // time in eeprom_cmd_sm while in this state, polling and input included
+    uint32_t max_us; // longest tick
+    uint32_t i2c_count; // bus transactions that finished during those ticks
+    uint64_t i2c_us; // their time on the bus
+} state_stats;
+
+static state_stats sm_stats[STATE_COUNT];
+static const char * const state_names[STATE_COUNT] = {
+    "bootScan", "bootIndex", "bootLeds", "erase", "write", "read", "bench", "exportLog", "userInput"
+};
+#endif
+
+typedef enum {
+    queryAll,
+    queryTail, // last value records
+    querySince, // records from sequence number value on
+    queryGrep // records whose description starts with prefix
+    } query_kind;
+
+typedef struct log_query {
+    query_kind kind;
+    uint32_t value;
+    char prefix[MAX_STR_LEN];
+} log_query;
+
 typedef struct eeprom_sm {
     eeprom_st state;
-    uint16_t mem_address;
+    log_page page;
+    uint32_t scrub_address; // next page to clear in the background, SCRUB_DONE when finished
     bool boot;
+    char input[MAX_STR_LEN]; // console line, typed while transfers run
+    bool input_ready;
+    led_persist leds;
+    log_query query; // what read prints
 } eeprom_sm;
 
 // Part 1
 
 bool debounce(uint pin);
 
-void set_led_state(ledstate *ls, uint8_t value);
-
-void led_logic(bool init, uint64_t power_up, const uint16_t * mem_address);
+void led_logic(led_persist * leds);
 
 void print_states(uint64_t power_up, ledstate * structs_);
 
-bool led_state_is_valid(ledstate *ls);
+void led_restore(led_persist * leds, uint8_t bits);
 
 // Part 2
 
@@ -72,37 +119,60 @@ bool read_input(char *str, int max_len);
 
 void init(void);
 
-static inline void add_mem_addr(uint8_t *buffer, const uint16_t * mem_address);
-
 void eeprom_cmd_sm(eeprom_sm * machine);
 
-void i2c_read(char * str_null_crc, const uint16_t  mem_address);
+eeprom_st boot_scan_state(log_page * page, uint32_t * scrub_address, bool * boot);
+
+eeprom_st erase_state(log_page * page, uint32_t * scrub_address, const bool * boot, led_persist * leds);
+
+eeprom_st write_state(log_page * page, bool * boot);
+
+void index_page(const uint8_t * data, uint32_t mem_address, uint16_t epoch, led_persist * leds, int * torn);
+
+eeprom_st boot_index_state(const log_page * page, led_persist * leds);
+
+eeprom_st boot_leds_state(const log_page * page, led_persist * leds);
 
-bool i2c_write(const uint8_t * buffer, size_t total_len);
+bool query_candidate(const log_index_entry * entry, const log_query * query);
 
-bool validate_log(const char * str_null_crc);
+int print_older_page(const uint8_t * data, uint32_t mem_address, const log_page * page, const log_query * query,
+                     uint32_t * clock_ms);
 
-bool validate_crc(const uint8_t * str_null_crc);
+eeprom_st read_state(const log_page * page, const log_query * query);
 
-eeprom_st boot_scan_state(uint16_t * mem_address, bool * boot);
+eeprom_st bench_state(log_page * page);
 
-eeprom_st erase_state(void);
+void send_frame(uint8_t type, uint32_t offset, const uint8_t * data, uint16_t len);
 
-eeprom_st write_state(uint16_t * mem_address, bool * boot);
+eeprom_st export_state(log_page * page);
 
-eeprom_st read_state(void);
+eeprom_st user_input_state(log_page * page, uint32_t * scrub_address, char * input, bool * input_ready, led_persist * leds,
+                           log_query * query);
 
-eeprom_st user_input_state(void);
+#if SM_STATS
+void stats_record(state_stats * stats, uint64_t start_us, const eeprom_bus_stats * bus);
 
-uint16_t calculate_crc(const uint8_t *data_p, size_t length);
+uint32_t stats_overhead_ns(void);
+
+void stats_reset(void);
+#endif
+
+void stats_print(bool csv);
 
 int main(void) {
     init();
-    eeprom_sm machine = { .state=bootScan, .mem_address = FIRST_MEM_ADDR, .boot = false };
+    printf("I2C running at %u Hz.\n", eeprom_probe_rate(SCRATCH_MEM_ADDR, FREQ));
+    eeprom_sm machine = { .state=bootScan, .scrub_address = SCRUB_DONE, .boot = false, .leds = { .saved = LED_NONE } };
+    machine.leds.power_up = time_us_64();
+    while (!read_epoch(&machine.page.epoch, &machine.page.seq)) // seq: where an empty log starts
+    {
+        // going on with a guessed epoch would hide the log and let the next flush overwrite it
+        printf("Reading the epoch failed, check the EEPROM. Retrying...\n");
+        sleep_ms(1000);
+    }
     while (true)     // Loop forever
     {
-        eeprom_cmd_sm(&machine);
-        sleep_ms(SLEEP);
+        eeprom_cmd_sm(&machine); // no sleep needed, states return while their transfers run
     }
 
     return 0;
@@ -110,227 +180,674 @@ int main(void) {
 
 void eeprom_cmd_sm(eeprom_sm * machine)
 {
+#if SM_STATS
+    // the whole tick counts for the state it started in, transfers finished in it included
+    eeprom_st state = machine->state;
+    eeprom_bus_stats bus = *eeprom_get_bus_stats();
+    uint64_t start_us = time_us_64();
+#endif
+    eeprom_poll(); // move queued I2C transfers along
+    if (!machine->input_ready) machine->input_ready = read_input(machine->input, MAX_STR_LEN); // echo typing in every state
+    if (machine->state != bootScan && machine->state != bootIndex && machine->state != bootLeds)
+        led_logic(&machine->leds); // buttons work once the saved state is restored
+
     switch (machine->state)
     {
         case bootScan:
         {
-            machine->state=boot_scan_state(&machine->mem_address, &machine->boot);
+            machine->state=boot_scan_state(&machine->page, &machine->scrub_address, &machine->boot);
+            break;
+        }
+        case bootIndex:
+        {
+            machine->state=boot_index_state(&machine->page, &machine->leds);
+            break;
+        }
+        case bootLeds:
+        {
+            machine->state=boot_leds_state(&machine->page, &machine->leds);
             break;
         }
         case erase:
         {
-            machine->state=erase_state();
+            machine->state=erase_state(&machine->page, &machine->scrub_address, &machine->boot, &machine->leds);
             break;
         }
         case write:
         {
-            machine->state=write_state(&machine->mem_address, &machine->boot);
+            machine->state=write_state(&machine->page, &machine->boot);
             break;
         }
         case read:
         {
-            machine->state=read_state();
+            machine->state=read_state(&machine->page, &machine->query);
+            break;
+        }
+        case bench:
+        {
+            machine->state=bench_state(&machine->page);
+            break;
+        }
+        case exportLog:
+        {
+            machine->state=export_state(&machine->page);
             break;
         }
         case userInput:
         {
-            machine->state=user_input_state();
+            machine->state=user_input_state(&machine->page, &machine->scrub_address, machine->input, &machine->input_ready,
+                                            &machine->leds, &machine->query);
             break;
         }
     }
+#if SM_STATS
+    stats_record(&sm_stats[state], start_us, &bus);
+#endif
 }
 
-void i2c_read(char * str_null_crc, const uint16_t  mem_address)
+#if SM_STATS
+void stats_record(state_stats * stats, uint64_t start_us, const eeprom_bus_stats * bus)
 {
-    uint8_t mem_addr_buff[2];
-    add_mem_addr(mem_addr_buff, &mem_address);
-    //then send the internal memory address AGAIN (with repeated start)
-
-    i2c_write_blocking(i2c1 ,device_addr, mem_addr_buff, 2, true);
-
-    //then finally read
+    const eeprom_bus_stats * now = eeprom_get_bus_stats();
+    uint32_t elapsed = (uint32_t)(time_us_64() - start_us);
+    ++stats->ticks;
+    stats->total_us += elapsed;
+    if (elapsed > stats->max_us) stats->max_us = elapsed;
+    stats->i2c_count += now->transactions - bus->transactions;
+    stats->i2c_us += now->total_us - bus->total_us;
+}
 
-    i2c_read_blocking(i2c1, device_addr, (uint8_t*)str_null_crc, LOG_MEM_SIZE, false);
+uint32_t stats_overhead_ns(void)
+{
+    // same work eeprom_cmd_sm adds to a tick, repeated on a scratch entry
+    state_stats scratch = { 0 };
+    uint64_t start_us = time_us_64();
+    for (int i = 0; i < STATS_CALIBRATE_ROUNDS; ++i)
+    {
+        eeprom_bus_stats bus = *eeprom_get_bus_stats();
+        stats_record(&scratch, time_us_64(), &bus);
+    }
+    return (uint32_t)((time_us_64() - start_us) * 1000 / STATS_CALIBRATE_ROUNDS);
 }
 
-bool i2c_write(const uint8_t * buffer, size_t total_len)
+void stats_reset(void)
 {
-    int retries=5;
-    int ack=0;
+    memset(sm_stats, 0, sizeof(sm_stats));
+}
+#endif
 
-    while (retries--)
+void stats_print(bool csv)
+{
+#if SM_STATS
+    uint32_t overhead_ns = stats_overhead_ns();
+    uint64_t ticks = 0;
+    uint64_t total_us = 0;
+
+    if (csv) printf("state,ticks,total_us,avg_us,max_us,i2c_count,i2c_us\n");
+    else printf("%-10s %10s %12s %8s %8s %8s %12s\n", "state", "ticks", "total us", "avg us", "max us", "i2c", "i2c us");
+    for (int i = 0; i < STATE_COUNT; ++i)
     {
-        ack=i2c_write_blocking(i2c1, device_addr, buffer, total_len, false);
-        if (ack>=0) return true; //success
-        sleep_ms(SLEEP);
+        const state_stats * s = &sm_stats[i];
+        unsigned long avg_us = s->ticks ? (unsigned long)(s->total_us / s->ticks) : 0;
+        if (csv)
+        {
+            printf("%s,%lu,%llu,%lu,%lu,%lu,%llu\n", state_names[i], (unsigned long)s->ticks, s->total_us, avg_us,
+                   (unsigned long)s->max_us, (unsigned long)s->i2c_count, s->i2c_us);
+        }
+        else
+        {
+            printf("%-10s %10lu %12llu %8lu %8lu %8lu %12llu\n", state_names[i], (unsigned long)s->ticks, s->total_us,
+                   avg_us, (unsigned long)s->max_us, (unsigned long)s->i2c_count, s->i2c_us);
+        }
+        ticks += s->ticks;
+        total_us += s->total_us;
     }
-    return false;
+    // bookkeeping runs outside the timed part of a tick, so it adds to the totals above
+    uint64_t overhead_us = ticks * overhead_ns / 1000;
+    if (csv) printf("overhead,%llu,%llu,,,,\n", ticks, overhead_us);
+    else printf("Overhead %lu ns per tick, %llu us in %llu ticks (%llu.%02llu%% of measured time).\n",
+                (unsigned long)overhead_ns, overhead_us, ticks,
+                total_us ? overhead_us * 100 / total_us : 0, total_us ? overhead_us * 10000 / total_us % 100 : 0);
+#else
+    (void)csv;
+    printf("State statistics are compiled out, set SM_STATS to 1.\n");
+#endif
 }
 
-bool validate_log(const char * str_null_crc)
+eeprom_st boot_scan_state(log_page * page, uint32_t * scrub_address, bool * boot)
 {
-    const char * null_index_ptr=strchr(str_null_crc, TERM_NULL); // look for terminating null
-    if (null_index_ptr==NULL) return false; // no terminating null - invalid string
-    int null_index = null_index_ptr - str_null_crc; // since str_null_crc points to 0 index to get the index as a number, we subtract each pointer;
+    // Binary search for the newest page, one page read per tick. The search takes log2(LOG_SLOTS)
+    // reads, so boot stays fast on large parts.
+    static log_search search = { .hi = 0 };
+    static eeprom_req req;
+    static uint8_t buffer[LOG_MEM_SIZE];
+
+    if (search.reads == 0 && search.hi == 0) log_search_start(&search, LOG_SLOTS); // log size depends on the geometry
+    if (req.status == EEPROM_REQ_IDLE)
+    {
+        eeprom_read_async(&req, buffer, FIRST_MEM_ADDR + search.slot * LOG_MEM_SIZE, LOG_MEM_SIZE);
+        return bootScan;
+    }
+    if (eeprom_req_busy(&req)) return bootScan; // keep servicing input until the page arrives
 
-    if (str_null_crc[0] != TERM_NULL && null_index < CRC_MSB_INDEX) //if 1st char is not 0 & there's '\0' before index 62?
+    bool ok = req.status == EEPROM_REQ_DONE;
+    req.status = EEPROM_REQ_IDLE;
+    uint32_t lo = search.lo;
+    bool more = log_search_step(&search, ok ? buffer : NULL, page->epoch); // a failed read is read again
+    if (search.failed >= EPOCH_READ_TRIES)
     {
-        if (validate_crc((const uint8_t*)str_null_crc)) return true;
+        // same as for the epoch: a page taken as free would move the head back and the next flush overwrite the log
+        printf("Reading the log failed, check the EEPROM. Retrying...\n");
+        sleep_ms(1000);
     }
+    if (search.lo != lo) memcpy(page->data, buffer, LOG_MEM_SIZE); // the last page found this way is the newest one
+    if (more) return bootScan; // keep searching
+
+    page_resume(page, &search);
+    printf("Boot. Log head found after %d reads.\n", search.reads);
 
-   return false;
+    *scrub_address = page->address; // clean up whatever an interrupted scrub left behind
+    *boot=true; // for printing "Boot" message in write state
+    return bootIndex;
 }
 
-uint16_t calculate_crc(const uint8_t *data_p, size_t length)
+eeprom_st write_state(log_page * page, bool * boot)
 {
-    uint8_t x;
-    uint16_t crc = 0xFFFF;
-    while (length--) {
-        x = crc >> 8 ^ *data_p++;
-        x ^= x >> 4;
-        crc = (crc << 8) ^ ((uint16_t) (x << 12)) ^ ((uint16_t) (x << 5)) ^ ((uint16_t) x);
-    }
-    return crc;
+        // records are only buffered here, user_input_state writes them out once input goes quiet
+        if (!log_event_append(page, *boot ? REC_BOOT : REC_TEST, NULL, 0))
+        {
+            printf("Log is full, erasing EEPROM...\n");
+            return erase;
+        }
+        *boot=false;
+
+        return userInput;
+}
+
+eeprom_st erase_state(log_page * page, uint32_t * scrub_address, const bool * boot, led_persist * leds)
+{
+    if (!log_erase(page))
+    {
+        printf("Erase failed!\n");
+        return userInput;
+    }
+    *scrub_address = FIRST_MEM_ADDR; // stale pages are cleared later while waiting for input
+    leds->saved = LED_NONE; // LED record went with the rest of the log, write the current state again
+    leds->dirty = true;
+    return *boot ? write : userInput; // a full log at boot still gets its "Boot" record
 }
 
-bool validate_crc(const uint8_t * str_null_crc)
+void index_page(const uint8_t * data, uint32_t mem_address, uint16_t epoch, led_persist * leds, int * torn)
 {
-    // validate data
-    size_t len = strlen((char*)str_null_crc) + 1 + 2; //string + null + 2 byte CRC
-    if (len > LOG_MEM_SIZE) return false;
-    return calculate_crc((const uint8_t*)str_null_crc, len) == 0;
+    if (!validate_page(data, epoch)) return; // empty and stale pages are skipped
+
+    int offset = PAGE_HDR_LEN;
+    int size;
+    while ((size = page_next_record(data, &offset, torn)) > 0) // committed, CRC already checked
+    {
+        log_index_add(page_seq(data), mem_address + offset, &data[offset + 1], data[offset]);
+        led_record_seen(leds, page_seq(data), &data[offset + 1], data[offset]);
+        offset += size;
+    }
 }
 
-eeprom_st boot_scan_state(uint16_t * mem_address, bool * boot)
+eeprom_st boot_index_state(const log_page * page, led_persist * leds)
 {
-    char buffer[LOG_MEM_SIZE];
-    i2c_read(buffer, *mem_address); // read current memory log
+    // The index is built once from the newest pages (index_window): they are streamed with sequential
+    // reads of up to READ_CHUNK_SIZE bytes, oldest first, one read per tick. With the default chunk size
+    // the whole window comes in one transfer.
+    static uint8_t buffer[READ_CHUNK_SIZE];
+    static uint32_t mem_address=FIRST_MEM_ADDR;
+    static bool started=false;
+    static int transfers=0;
+    static uint64_t start_us=0;
+    static eeprom_req req;
+    static size_t len=0; // length of the read in flight
+    static int torn=0;
+
+    if (!started)
+    {
+        uint32_t slot = (page->address - FIRST_MEM_ADDR) / LOG_MEM_SIZE;
+        mem_address = FIRST_MEM_ADDR + (slot + LOG_SLOTS - index_window(page)) % LOG_SLOTS * LOG_MEM_SIZE;
+        log_index_clear();
+        torn = 0;
+        transfers = 0;
+        start_us = time_us_64();
+        started = true;
+    }
 
-    if (*mem_address==LAST_MEM_ADDR) // is curr.slot last_slot?
+    if (req.status == EEPROM_REQ_IDLE)
     {
-        if (validate_log(buffer)) //is it valid?
+        // read up to the page being filled, or up to the end of the log region if the read has to wrap
+        uint32_t end = page->address >= mem_address ? page->address : LAST_MEM_ADDR + LOG_MEM_SIZE;
+        len = end - mem_address;
+        if (len > READ_CHUNK_SIZE) len = READ_CHUNK_SIZE;
+        if (len > 0)
         {
-            return erase;
+            if (eeprom_read_async(&req, buffer, mem_address, len)) ++transfers;
+            return bootIndex;
         }
-        else
+    }
+    else
+    {
+        if (eeprom_req_busy(&req)) return bootIndex; // keep servicing input until the chunk arrives
+        req.status = EEPROM_REQ_IDLE;
+        for (size_t offset = 0; offset < len; offset += LOG_MEM_SIZE)
         {
-            *boot=true; // for printing "Boot" message in write state
-            printf("Boot.\n");
-            return write;
+            index_page(&buffer[offset], mem_address + offset, page->epoch, leds, &torn);
         }
+        mem_address += len;
+        if (mem_address > LAST_MEM_ADDR) mem_address = FIRST_MEM_ADDR;
     }
-    if (validate_log(buffer))
+
+    if (mem_address == page->address)
     {
-        *mem_address+=LOG_MEM_SIZE; //if curr.slot is not the last slot
-        return bootScan;
+        index_page(page->data, page->address, page->epoch, leds, &torn); // newest page is already in RAM
+        printf("Log index built: %d records in %d transfers, %llu us. Torn records skipped: %d.\n", log_index_count(),
+               transfers, time_us_64() - start_us, torn);
+        started = false;
+        return bootLeds;
     }
-    else
+    return bootIndex;
+}
+
+eeprom_st boot_leds_state(const log_page * page, led_persist * leds)
+{
+    // Without an LED record in the index window the pages older than it are read back, newest first, one
+    // chunk per tick, until one holds an LED record. Only a boot whose LEDs have not changed for long pays.
+    static uint8_t buffer[READ_CHUNK_SIZE];
+    static uint32_t left=0; // older pages not read yet
+    static uint32_t end=0; // slot after the newest of them
+    static bool started=false;
+    static int pages=0;
+    static eeprom_req req;
+    static uint32_t n=0; // pages in the read in flight
+
+    if (!started)
     {
-        *boot=true;
-        return write; // write "Boot";
+        uint32_t first_address;
+        left = leds->saved == LED_NONE ? older_pages(page, &first_address) : 0;
+        if (left > 0) end = ((first_address - FIRST_MEM_ADDR) / LOG_MEM_SIZE + left - 1) % LOG_SLOTS + 1;
+        pages = 0;
+        started = true;
     }
 
+    if (left > 0 && req.status == EEPROM_REQ_IDLE)
+    {
+        n = left < READ_CHUNK_SIZE / LOG_MEM_SIZE ? left : READ_CHUNK_SIZE / LOG_MEM_SIZE;
+        if (n > end) n = end; // a read does not wrap, the rest comes from the end of the log region
+        eeprom_read_async(&req, buffer, FIRST_MEM_ADDR + (end - n) * LOG_MEM_SIZE, n * LOG_MEM_SIZE);
+        return bootLeds;
+    }
+    if (left > 0)
+    {
+        if (eeprom_req_busy(&req)) return bootLeds; // keep servicing input until the chunk arrives
+        bool ok = req.status == EEPROM_REQ_DONE;
+        req.status = EEPROM_REQ_IDLE;
+        if (!ok) return bootLeds; // read it again, a page that could not be read may hold the record
+        for (uint32_t i = n; i-- > 0 && left > 0;)
+        {
+            --left;
+            ++pages;
+            if (led_page_scan(leds, &buffer[i * LOG_MEM_SIZE], page->epoch)) left = 0; // newest one found
+        }
+        end = end == n ? LOG_SLOTS : end - n;
+        if (left > 0) return bootLeds;
+    }
+
+    if (pages > 0) printf("%d pages before the index window read for the LED state.\n", pages);
+    if (leds->saved != LED_NONE) printf("LED state restored from the log.\n");
+    led_restore(leds, leds->saved == LED_NONE ? 0 : leds->saved); // LEDs start off when the log has no record
+    started = false;
+    return write;
 }
 
-eeprom_st write_state(uint16_t * mem_address, bool * boot)
+bool query_candidate(const log_index_entry * entry, const log_query * query)
 {
-        //char buffer[LOG_MEM_SIZE];
-        char boot_str[5]="Boot";
-        char test_str[5]="Test";
-        uint8_t buffer[LOG_MEM_SIZE];
-        add_mem_addr(buffer, mem_address); // add current memory address to first 2 indexes of the buffer
+    // decided from the index summary, grep confirms on the description once the payload is there
+    if (query->kind != queryGrep) return true;
+    size_t len = strlen(query->prefix);
+    const char * name = record_type_name(entry->type);
+    if (name) return !strncmp(name, query->prefix, len < strlen(name) ? len : strlen(name));
+    return entry->type >= REC_TEXT_MIN && (len == 0 || entry->type == (uint8_t)query->prefix[0]); // text record
+}
 
-        size_t payload_len = 0; //  initialize
-        //size_t payload_len = strlen(str) + 1; //  the str + '\0'
-        size_t str_len = 0; // initialize
+int print_older_page(const uint8_t * data, uint32_t mem_address, const log_page * page, const log_query * query,
+                     uint32_t * clock_ms)
+{
+    // records of a page the index does not cover, filtered like the indexed ones
+    char text[MAX_STR_LEN];
+    int matches = 0;
+    int offset = PAGE_HDR_LEN;
+    int size;
+    if (!validate_page(data, page->epoch) || page->seq - page_seq(data) <= index_window(page)) return 0;
+    while ((size = page_next_record(data, &offset, NULL)) > 0)
+    {
+        uint32_t seq = RECORD_SEQ(page_seq(data), offset);
+        record_describe(text, sizeof(text), &data[offset + 1], data[offset], clock_ms);
+        if ((query->kind != querySince || seq >= query->value) &&
+            (query->kind != queryGrep || strncmp(text, query->prefix, strlen(query->prefix)) == 0))
+        {
+            printf("Log entry: %s. Memory address: 0X%02lX. Seq: %lu\n", text, (unsigned long)(mem_address + offset),
+                   (unsigned long)seq);
+            ++matches;
+        }
+        offset += size;
+    }
+    return matches;
+}
+
+eeprom_st read_state(const log_page * page, const log_query * query)
+{
+    // Pages older than the index window are streamed first, READ_CHUNK_SIZE bytes per tick, for the
+    // queries that reach back that far: read and grep always, since when it starts before the index.
+    // Then records come from the RAM index, oldest first, and the query picks them from the index summary.
+    // Payloads are served from the page being filled or from the cache. A miss reads the payloads of the
+    // uncached matching records that follow it in the same page with one transfer, so a cold read costs
+    // at most one transfer per page and tail 1 at most one transfer.
+    static uint8_t buffer[LOG_MEM_SIZE];
+    static uint8_t older[READ_CHUNK_SIZE];
+    static uint32_t older_address=0; // next older page to read
+    static uint32_t older_left=0; // older pages still to read
+    static size_t older_len=0; // bytes of the read in flight
+    static uint32_t older_read=0; // older pages read, for the comparison with a full read
+    static uint32_t older_clock=0;
+    static uint32_t run_address=0; // EEPROM address of buffer[0]
+    static int run_end=0; // entries up to run_end are in buffer
+    static int next=0; // entry printed next
+    static bool started=false;
+    static int transfers=0;
+    static int matches=0;
+    static uint32_t bytes_read=0;
+    static uint64_t start_us=0;
+    static eeprom_req req;
+    log_index_stats * stats = log_index_get_stats();
+    char text[MAX_STR_LEN];
+
+    if (!started)
+    {
+        int count = log_index_count();
+        next = 0;
+        if (query->kind == queryTail) next = count > (int)query->value ? count - (int)query->value : 0;
+        if (query->kind == querySince) next = log_index_find(query->value);
+        run_end = next;
+        matches = 0;
+        transfers = 0;
+        bytes_read = 0;
+        start_us = time_us_64();
+        started = true;
+
+        older_left = older_pages(page, &older_address);
+        if (query->kind == queryTail) older_left = 0;
+        if (query->kind == querySince && count > 0 &&
+            RECORD_SEQ(log_index_get(0)->seq, log_index_get(0)->address % LOG_MEM_SIZE) <= query->value) older_left = 0;
+        older_len = 0;
+        older_read = 0;
+        older_clock = 0;
+    }
 
-        if (*boot)
+    if (eeprom_req_busy(&req)) return read; // keep servicing input until the payloads arrive
+    if (req.status != EEPROM_REQ_IDLE)
+    {
+        bool ok = req.status == EEPROM_REQ_DONE;
+        req.status = EEPROM_REQ_IDLE;
+        if (!ok)
         {
-            str_len = strlen(boot_str);
-            payload_len = strlen(boot_str) + 1; //  the str + '\0'
-            memcpy(&buffer[2], boot_str, str_len);
-            *boot=false;
+            printf("Read failed!\n");
+            started = false;
+            return userInput;
+        }
+    }
+
+    if (older_len > 0) // chunk of older pages arrived
+    {
+        for (size_t offset = 0; offset < older_len; offset += LOG_MEM_SIZE)
+        {
+            matches += print_older_page(&older[offset], older_address + offset, page, query, &older_clock);
+        }
+        older_address += older_len;
+        if (older_address > LAST_MEM_ADDR) older_address = FIRST_MEM_ADDR;
+        older_left -= older_len / LOG_MEM_SIZE;
+        older_read += older_len / LOG_MEM_SIZE;
+        older_len = 0;
+    }
+    if (older_left > 0)
+    {
+        // up to the end of the log region, the next read wraps
+        size_t len = older_left * LOG_MEM_SIZE;
+        if (len > READ_CHUNK_SIZE) len = READ_CHUNK_SIZE;
+        if (len > LAST_MEM_ADDR + LOG_MEM_SIZE - older_address) len = LAST_MEM_ADDR + LOG_MEM_SIZE - older_address;
+        if (!eeprom_read_async(&req, older, older_address, len)) return read; // queue full, try again next tick
+        older_len = len;
+        ++transfers;
+        bytes_read += 2 + len;
+        return read;
+    }
+
+    while (next < log_index_count())
+    {
+        const log_index_entry * entry = log_index_get(next);
+        const uint8_t * payload;
+        if (!query_candidate(entry, query))
+        {
+            ++next;
+            continue;
+        }
+        if (next < run_end)
+        {
+            payload = &buffer[entry->address + 1 - run_address];
+            log_cache_put(entry, payload);
+            ++stats->misses;
+        }
+        else if (entry->seq == page->seq)
+        {
+            payload = &page->data[entry->address - page->address + 1]; // includes records that are not written yet
+            ++stats->hits;
+        }
+        else if ((payload = log_cache_find(entry)) != NULL)
+        {
+            ++stats->hits;
         }
         else
         {
-            str_len = strlen(test_str);
-            payload_len = strlen(test_str) + 1; //  the str + '\0'
-            memcpy(&buffer[2], test_str, str_len);
+            // fetch payloads only: from this one up to the last uncached match in a row in the same page
+            run_address = entry->address + 1;
+            run_end = next + 1;
+            while (run_end < log_index_count() && log_index_get(run_end)->seq == entry->seq &&
+                   query_candidate(log_index_get(run_end), query) && !log_cache_find(log_index_get(run_end))) ++run_end;
+            const log_index_entry * last = log_index_get(run_end - 1);
+            size_t len = last->address + 1 + last->len - run_address;
+            if (!eeprom_read_async(&req, buffer, run_address, len))
+            {
+                run_end = next; // queue full, try again next tick
+                return read;
+            }
+            ++transfers;
+            bytes_read += 2 + len; // memory address + payloads
+            return read;
         }
+        ++next;
+
+        uint32_t clock_ms = next > 1 ? log_index_get(next - 2)->time_ms : 0; // time of the record before
+        record_describe(text, sizeof(text), payload, entry->len, &clock_ms);
+        if (query->kind == queryGrep && strncmp(text, query->prefix, strlen(query->prefix)) != 0) continue;
+        printf("Log entry: %s. Memory address: 0X%02lX. Seq: %lu\n", text, (unsigned long)entry->address,
+               (unsigned long)RECORD_SEQ(entry->seq, entry->address % LOG_MEM_SIZE));
+        ++matches;
+    }
 
-        size_t total_len = 2 + payload_len + 2; // total len = payload_len + 2 (2 crc bytes)
+    // compare with streaming every page before the one in RAM, as the index build does
+    uint32_t full = (index_window(page) + older_read) * LOG_MEM_SIZE;
+    full += 2 * ((full + READ_CHUNK_SIZE - 1) / READ_CHUNK_SIZE); // memory address per read
+    if (full > bytes_read) stats->bytes_saved += full - bytes_read;
+    printf("%d records in %d transfers, %lu bus bytes read, %llu us. Cache hits: %lu, misses: %lu, bus bytes saved: %lu.\n",
+           matches, transfers, (unsigned long)bytes_read, time_us_64() - start_us, (unsigned long)stats->hits,
+           (unsigned long)stats->misses, (unsigned long)stats->bytes_saved);
+    uint32_t first_older;
+    if (query->kind == queryTail && query->value > (uint32_t)log_index_count() && older_pages(page, &first_older) > 0)
+    {
+        printf("Tail only covers the %d records in the index, 'read' also prints the older ones.\n", log_index_count());
+    }
+    started = false;
+    return userInput; // reading complete
+}
 
-        /*
-        size_t str_len = *boot ? strlen(boot_str) : strlen(test_str);
-        memcpy(&buffer[2], *boot ? boot_str : test_str, str_len);
-        //size_t str_len = *boot ? strlen(boot_str) : strlen(str); // decide the size of the string
-        //memcpy(&buffer[2], *boot ? boot_str : str, str_len); // copy either boot string or normal string to the buffer
-        */
-        buffer[2 + str_len] = '\0'; // add terminating null
-        uint16_t crc=calculate_crc(&buffer[2], payload_len); //returns 16 bit (2 byte) CRC   (excluding 1st 2 bytes of mem addr)
+eeprom_st bench_state(log_page * page)
+{
+    // Blocking: buffered records go out first, then every rate is checked and timed on its own.
+    static uint8_t buffer[READ_CHUNK_SIZE];
+    uint8_t tx[SCRATCH_LEN];
+    uint selected = eeprom_get_rate();
 
-        buffer[2 + payload_len]=(uint8_t)(crc >> 8); //which we then append after terminating null (first high byte)
-        buffer[2 + payload_len + 1]=(uint8_t)(crc & 0xFF);
+    while (!page_flush(page)) eeprom_poll();
+    for (int i = 0; i < EEPROM_RATE_COUNT; ++i)
+    {
+        uint rate = eeprom_rates[i];
+        if (!eeprom_check_rate(rate, SCRATCH_MEM_ADDR))
+        {
+            printf("%7u Hz: read-back check failed\n", rate);
+            continue;
+        }
 
-        *mem_address+=LOG_MEM_SIZE;
+        uint64_t start_us = time_us_64();
+        for (int round = 0; round < BENCH_ROUNDS; ++round) i2c_read(buffer, FIRST_MEM_ADDR, sizeof(buffer));
+        uint64_t read_us = time_us_64() - start_us;
 
-        i2c_write(buffer, total_len);
+        // sustained writes include the write cycle, each write waits for the previous one
+        memset(tx, TERM_NULL, SCRATCH_LEN);
+        start_us = time_us_64();
+        for (int round = 0; round < BENCH_ROUNDS; ++round) i2c_write(tx, SCRATCH_MEM_ADDR, sizeof(tx));
+        eeprom_wait_ready(make_timeout_time_us(WRITE_CYCLE_MAX_US));
+        uint64_t write_us = time_us_64() - start_us;
 
-        return userInput;
+        printf("%7u Hz: read %llu B/s, write %llu B/s\n", rate,
+               (uint64_t)BENCH_ROUNDS * sizeof(buffer) * US_TO_S / read_us,
+               (uint64_t)BENCH_ROUNDS * SCRATCH_LEN * US_TO_S / write_us);
+    }
+    printf("I2C running at %u Hz.\n", eeprom_set_rate(selected));
+    return userInput;
 }
 
-eeprom_st erase_state(void)
+void send_frame(uint8_t type, uint32_t offset, const uint8_t * data, uint16_t len)
 {
-    static uint16_t mem_address=FIRST_MEM_ADDR;
-    uint8_t buffer[LOG_MEM_SIZE];
-    add_mem_addr(buffer, &mem_address); // add current memory address to first 2 indexes of the buffer
-    buffer[2] = TERM_NULL; // add terminating null
+    static uint8_t frame[EXPORT_HDR_LEN + EXPORT_CHUNK + CRC_LEN];
+    frame[0] = EXPORT_SYNC0;
+    frame[1] = EXPORT_SYNC1;
+    frame[2] = type;
+    frame[3] = (uint8_t)(offset >> 24);
+    frame[4] = (uint8_t)(offset >> 16);
+    frame[5] = (uint8_t)(offset >> 8);
+    frame[6] = (uint8_t)(offset & 0xFF);
+    frame[7] = (uint8_t)(len >> 8);
+    frame[8] = (uint8_t)(len & 0xFF);
+    memcpy(&frame[EXPORT_HDR_LEN], data, len);
+    uint16_t crc = calculate_crc(&frame[2], EXPORT_HDR_LEN - 2 + len);
+    frame[EXPORT_HDR_LEN + len] = (uint8_t)(crc >> 8);
+    frame[EXPORT_HDR_LEN + len + 1] = (uint8_t)(crc & 0xFF);
+
+    for (int i = 0; i < EXPORT_HDR_LEN + len + CRC_LEN; ++i) putchar_raw(frame[i]); // raw: no CR added before 0x0A
+}
 
-    if (mem_address < LAST_MEM_ADDR)
+eeprom_st export_state(log_page * page)
+{
+    // The raw EEPROM image goes out in frames of EXPORT_CHUNK bytes. The next chunk is read while the
+    // current one is being sent, so the UART does not wait for the bus.
+    static uint8_t buffer[2][EXPORT_CHUNK];
+    static int current=0; // buffer the read in flight goes to
+    static uint32_t next_address=0;
+    static uint32_t frames=0;
+    static bool started=false;
+    static uint64_t start_us=0;
+    static eeprom_req req;
+
+    if (!started)
     {
-        i2c_write(buffer, 3); //write 2 bytes of memory address plus 0 to the first entry of the log
-        mem_address += LOG_MEM_SIZE; //advance memory address to the next log (+64 bytes)
-        return erase; //continue erasing
+        while (!page_flush(page)) eeprom_poll(); // buffered records are part of the image
+        eeprom_req_wait(&page->req);
+        eeprom_req_wait(&page->commit_req);
+        uint32_t size = EXPORT_SIZE;
+        uint8_t info[5] = { (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)(size & 0xFF), LOG_MEM_SIZE };
+        start_us = time_us_64();
+        send_frame(EXPORT_START, 0, info, sizeof(info));
+        frames = 1;
+        next_address = 0;
+        current = 0;
+        started = true;
     }
-    else return userInput; //erasing complete
-}
 
-static inline void add_mem_addr(uint8_t *buffer, const uint16_t * mem_address)
-{
-    buffer[0] = (uint8_t)(*mem_address >> 8); // high byte
-    buffer[1] = (uint8_t)(*mem_address & 0XFF); // low byte
+    if (req.status == EEPROM_REQ_IDLE)
+    {
+        eeprom_read_async(&req, buffer[current], next_address, EXPORT_CHUNK); // queue full: try again next tick
+        return exportLog;
+    }
+    if (eeprom_req_busy(&req)) return exportLog;
+
+    bool ok = req.status == EEPROM_REQ_DONE;
+    req.status = EEPROM_REQ_IDLE;
+    if (!ok)
+    {
+        started = false;
+        printf("\nExport failed!\n"); // receiver never sees the end frame
+        return userInput;
+    }
+
+    uint32_t address = next_address;
+    int sent = current;
+    next_address += EXPORT_CHUNK;
+    current ^= 1;
+    if (next_address < EXPORT_SIZE) eeprom_read_async(&req, buffer[current], next_address, EXPORT_CHUNK); // read ahead
+    send_frame(EXPORT_DATA, address, buffer[sent], EXPORT_CHUNK);
+    ++frames;
+    if (next_address < EXPORT_SIZE) return exportLog;
+
+    ++frames;
+    uint8_t count[4] = { (uint8_t)(frames >> 24), (uint8_t)(frames >> 16), (uint8_t)(frames >> 8), (uint8_t)(frames & 0xFF) };
+    send_frame(EXPORT_END, 0, count, sizeof(count));
+    printf("\nExported %lu bytes in %lu frames, %llu us.\n", (unsigned long)EXPORT_SIZE, (unsigned long)frames,
+           time_us_64() - start_us);
+    started = false;
+    return userInput;
 }
 
-eeprom_st read_state(void)
+eeprom_st user_input_state(log_page * page, uint32_t * scrub_address, char * user_input, bool * input_ready, led_persist * leds,
+                           log_query * query)
 {
-    static uint16_t mem_address=FIRST_MEM_ADDR;
-
-    char buffer[LOG_MEM_SIZE];
+    static bool prompt=true;
+    if (prompt)
+    {
+        printf("Type 'erase' to erase EEPROM, 'write' to write, 'read' to read every valid entry, 'tail N', 'since SEQ' or "
+               "'grep PREFIX' to read some of them, 'export' to stream the raw log, 'bench' to time the bus or "
+               "'stats' ('stats csv', 'stats reset') for time spent per state:\n");
+        prompt=false;
+    }
 
-    if (mem_address <= LAST_MEM_ADDR)
+    if (!*input_ready)
     {
-        i2c_read(buffer, mem_address);
-        if (validate_log(buffer))
+        // bus is idle while waiting: write out buffered records once appends go quiet, then scrub
+        if (eeprom_busy()) return userInput;
+        uint32_t led_records = leds->records;
+        if (!led_persist_step(page, leds)) // LED record joins the page buffer, flushed below like any other
         {
-            printf("Log entry: %s. Memory address: 0X%02X\n", buffer, mem_address);
-            mem_address+=LOG_MEM_SIZE; //advance memory address to the next log (+64 bytes)
+            printf("Log is full, erasing EEPROM...\n");
+            return erase;
         }
-        else
+        if (leds->records != led_records)
+        {
+            printf("LED state saved. %lu toggles in %lu records, %lu writes saved.\n", (unsigned long)leds->toggles,
+                   (unsigned long)leds->records, (unsigned long)(leds->toggles - leds->records));
+        }
+        if (page->flushed < page->fill)
+        {
+            if (time_us_64() - page->last_append >= FLUSH_DELAY_US) page_flush(page);
+        }
+        else if (*scrub_address != SCRUB_DONE)
         {
-            printf("No valid log entries found!\n");
-            mem_address = FIRST_MEM_ADDR;
-            return userInput; // reading complete
+            scrub_step(scrub_address, page);
         }
+        return userInput;
     }
-    return read;
-}
-
-eeprom_st user_input_state(void)
-{
-    printf("Type 'erase' to erase EEPROM, 'write' to write or 'read' to read every valid entry:\n");
-    char user_input[MAX_STR_LEN];
-
-    while (!read_input(user_input, MAX_STR_LEN));
+    *input_ready=false;
+    prompt=true;
 
     if (!strcmp(user_input, "erase"))
     {
@@ -340,6 +857,25 @@ eeprom_st user_input_state(void)
     else if (!strcmp(user_input, "read"))
     {
         printf("Reading EEPROM...\n");
+        query->kind = queryAll;
+        return read;
+    }
+    else if (!strncmp(user_input, "tail ", 5) || !strncmp(user_input, "since ", 6))
+    {
+        char * end;
+        query->kind = user_input[0] == 't' ? queryTail : querySince;
+        query->value = strtoul(strchr(user_input, ' ') + 1, &end, 10);
+        if (*end != '\0')
+        {
+            printf("Invalid number!\n");
+            return userInput;
+        }
+        return read;
+    }
+    else if (!strncmp(user_input, "grep ", 5))
+    {
+        query->kind = queryGrep;
+        strcpy(query->prefix, &user_input[5]);
         return read;
     }
     else if (!strcmp(user_input, "write"))
@@ -347,6 +883,28 @@ eeprom_st user_input_state(void)
         printf("Writing to EEPROM...\n");
         return write;
     }
+    else if (!strcmp(user_input, "export"))
+    {
+        return exportLog; // no text before the frames, the receiver is waiting for them
+    }
+    else if (!strcmp(user_input, "bench"))
+    {
+        printf("Measuring EEPROM throughput...\n");
+        return bench;
+    }
+    else if (!strcmp(user_input, "stats") || !strcmp(user_input, "stats csv"))
+    {
+        stats_print(user_input[5] != '\0');
+        return userInput;
+    }
+    else if (!strcmp(user_input, "stats reset"))
+    {
+#if SM_STATS
+        stats_reset();
+#endif
+        printf("State statistics cleared.\n");
+        return userInput;
+    }
     else if (user_input[0]=='\0')
     {
         return userInput;
@@ -402,6 +960,7 @@ void init(void)
 
     // initialize i2c
     i2c_init(i2c1, FREQ);
+    eeprom_init(&geometry);
 
     //create gpio pins
     uint sda=I2C1_SDA;
@@ -428,91 +987,65 @@ void init(void)
     gpio_pull_up(scl);
 }
 
-#if 0
-void led_logic(bool init, uint64_t power_up, const uint16_t * mem_address)
+void led_logic(led_persist * leds)
 {
-    static bool on_state1=false;
-    static bool on_state2=false;
-    static bool on_state3=false;
+    const uint pins[LED_COUNT]={led1, led2, led3};
+    const uint buttons[LED_COUNT]={SW_0, SW_1, SW_2};
 
-    static ledstate led_structs[3];
-
-    const uint leds[3]={led1, led2, led3};
-
-    print_states(power_up, led_structs);
-    for (int i=0;i<3;++i)
+    for (int i=0;i<LED_COUNT;++i)
     {
-        gpio_put(leds[i], led_structs[i].state);
+        if (debounce(buttons[i]))
+        {
+            set_led_state(&leds->leds[i], !leds->leds[i].state); //toggle state
+            gpio_put(pins[i], leds->leds[i].state);
+            leds->dirty = true; // saved once the buttons have been quiet for LED_QUIET_US
+            leds->last_toggle = time_us_64();
+            ++leds->toggles;
+            print_states(leds->power_up, leds->leds);
+        }
     }
-    print_states(power_up, led_structs);
+}
 
-    if (debounce(SW_0))
-    {
-        on_state1=!on_state1; //toggle state
-        set_led_state(&led_structs[0], on_state1);
-        gpio_put(led1, on_state1);
-        write_state(led_structs, mem_address, false); // save led state to EEPROM
-        print_states(power_up, led_structs);
-    }
-    if (debounce(SW_1))
-    {
-        on_state2=!on_state2; //toggle state
-        set_led_state(&led_structs[1], on_state2);
-        gpio_put(led2, on_state2);
-        //i2c_write(led_structs, mem_address); // save led state to EEPROM
-        print_states(power_up, led_structs);
-    }
-    if (debounce(SW_2))
+
+
+void led_restore(led_persist * leds, uint8_t bits)
+{
+    const uint pins[LED_COUNT]={led1, led2, led3};
+    for (int i=0;i<LED_COUNT;++i)
     {
-        on_state3=!on_state3; //toggle state
-        set_led_state(&led_structs[2], on_state3);
-        gpio_put(led3, on_state3);
-        //i2c_write(led_structs, mem_address); // save led state to EEPROM
-        print_states(power_up, led_structs);
+        set_led_state(&leds->leds[i], bits >> i & 1);
+        gpio_put(pins[i], leds->leds[i].state);
     }
+    print_states(leds->power_up, leds->leds);
 }
 
-bool debounce(uint pin) //simple debounce logic in a separate function (added while statement to wait until user releases the button)
+
+bool debounce(uint pin) // reports a press once, after the button has read pressed for SLEEP ms, without blocking
 {
-    if (!gpio_get(pin)) //if you detect press first wait
+    static uint64_t pressed_since[GPIO_COUNT];
+    static bool reported[GPIO_COUNT];
+
+    if (gpio_get(pin)) //released
     {
-        sleep_ms(SLEEP);
-        if (!gpio_get(pin)) // if you still detect the press, wait until the button is released
-        {
-            while (!gpio_get(pin));
-            return true; //means the button was pressed
-        }
+        pressed_since[pin] = 0;
+        reported[pin] = false;
+        return false;
     }
-    return false;
+    uint64_t now = time_us_64();
+    if (pressed_since[pin] == 0) pressed_since[pin] = now;
+    if (reported[pin] || now - pressed_since[pin] < SLEEP * 1000) return false;
+    reported[pin] = true; //means the button was pressed
+    return true;
 }
 
-void set_led_state(ledstate *ls, uint8_t value)
-{
-    ls->state = value;
-    ls->not_state = ~value;
-}
 
-bool led_state_is_valid(ledstate *ls) {
-    return ls->state == (uint8_t) ~ls->not_state;
-}
 
 void print_states(uint64_t power_up, ledstate * structs)
 {
     uint64_t since_boot_time=(time_us_64() - power_up) / US_TO_S;
     printf("%llu Seconds since power up.\n", since_boot_time);
-    for (int i=0;i<3;++i)
+    for (int i=0;i<LED_COUNT;++i)
     {
         printf("The state of LED%d: %d\n", i+1, structs[i].state);
     }
 }
-#endif
-
-
-
-
-
-
-
-
-
-
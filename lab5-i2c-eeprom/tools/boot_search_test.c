@@ -0,0 +1,136 @@
+//
+// Host test for the boot search. Builds log images for several log sizes (empty, one page, half full,
+// full, wrapped rings with the head anywhere, stale pages after an erase, a ring whose wrap to the first
+// slot was cut), runs log_search over them and checks that it finds the newest page, also when page reads
+// fail. Prints the page reads each boot needs.
+//
+// gcc -std=c11 -Wall -I.. -o boot_search_test boot_search_test.c ../log_record.c ../crc.c
+// ./boot_search_test
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log_record.h"
+
+#define MAX_SLOTS 4095 // 256 KB of log, the largest preset
+#define EPOCH 7
+
+static uint8_t image[MAX_SLOTS][LOG_MEM_SIZE];
+static int failures;
+
+// slots up to head hold the current log, the rest hold older ring pages, pages of the previous epoch or nothing
+static void build(uint32_t slots, uint32_t head, uint32_t first_seq, bool wrapped, uint32_t stale_from)
+{
+    memset(image, TERM_NULL, sizeof(image));
+    for (uint32_t slot = 0; slot < slots; ++slot)
+    {
+        if (slot <= head) page_header(image[slot], EPOCH, first_seq + slot);
+        else if (wrapped) page_header(image[slot], EPOCH, first_seq + slot - slots); // one lap older
+        else if (slot >= stale_from) page_header(image[slot], EPOCH - 1, first_seq + slot); // before the erase
+    }
+}
+
+// reads fail_at up to fail_at + fails - 1 fail, the search must read the same slot again
+static int run(const char * name, uint32_t slots, int head, uint32_t first_seq, int fail_at, int fails)
+{
+    log_search search;
+    log_search_start(&search, slots);
+    bool more = true;
+    while (more)
+    {
+        bool failed = search.reads >= fail_at && search.reads < fail_at + fails;
+        uint32_t slot = search.slot;
+        more = log_search_step(&search, failed ? NULL : image[search.slot], EPOCH);
+        if (failed && (!more || search.slot != slot))
+        {
+            printf("FAIL %s: a failed read of slot %lu moved the search\n", name, (unsigned long)slot);
+            ++failures;
+        }
+        if (search.reads > 64 + fails)
+        {
+            printf("FAIL %s: search does not end\n", name);
+            ++failures;
+            return search.reads;
+        }
+    }
+    int found = (int)search.lo - 1;
+    uint32_t seq = search.first_seq + search.lo - 1;
+    if (found != head || (head >= 0 && seq != first_seq + (uint32_t)head))
+    {
+        printf("FAIL %s (%lu slots): head %d seq %lu, expected %d seq %lu\n", name, (unsigned long)slots, found,
+               (unsigned long)seq, head, (unsigned long)(first_seq + head));
+        ++failures;
+    }
+    int limit = 2 + fails; // first page, then at most ceil(log2(slots)) + 1 halvings
+    for (uint32_t n = slots; n > 1; n = (n + 1) / 2) ++limit;
+    if (search.reads > limit)
+    {
+        printf("FAIL %s (%lu slots): %d reads, limit %d\n", name, (unsigned long)slots, search.reads, limit);
+        ++failures;
+    }
+    return search.reads;
+}
+
+int main(void)
+{
+    // LOG_SLOTS of the geometry presets: 24LC16, 24LC256, 24LC512, 2 x 24LC1025 and M24M02
+    const uint32_t sizes[] = { 31, 511, 1023, 4095 };
+
+    printf("%6s %8s %8s %8s %8s %8s %8s %8s\n", "slots", "empty", "one", "half", "full", "ring", "erased", "cut wrap");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        uint32_t slots = sizes[i];
+        int reads[7];
+
+        memset(image, TERM_NULL, sizeof(image));
+        reads[0] = run("empty", slots, -1, 0, -1, 0);
+        build(slots, 0, 100, false, slots);
+        reads[1] = run("one page", slots, 0, 100, -1, 0);
+        build(slots, slots / 2, 100, false, slots);
+        reads[2] = run("half", slots, (int)(slots / 2), 100, -1, 0);
+        build(slots, slots - 1, 100, false, slots);
+        reads[3] = run("full", slots, (int)(slots - 1), 100, -1, 0);
+
+        // the head of a ring can be anywhere, check every slot on the small parts and a spread on the big ones
+        int worst = 0;
+        uint32_t step = slots > 600 ? 37 : 1;
+        for (uint32_t head = 0; head < slots; head += step)
+        {
+            build(slots, head, 5000, true, slots);
+            int r = run("ring", slots, (int)head, 5000, -1, 0);
+            if (r > worst) worst = r;
+        }
+        reads[4] = worst;
+
+        // a new epoch over a full log of the old one, before the scrub has cleared the stale pages
+        build(slots, slots / 3, 900, false, slots / 3 + 1);
+        reads[5] = run("erased", slots, (int)(slots / 3), 900, -1, 0);
+
+        // the ring came round to the first slot and the power failed while its header was written: the
+        // newest page is the last one, a lap older than what the first slot was to hold
+        build(slots, slots - 1, 5000, false, slots);
+        image[0][1] ^= 0X5A;
+        reads[6] = run("cut wrap", slots, (int)(slots - 1), 5000, -1, 0);
+
+        printf("%6lu %8d %8d %8d %8d %8d %8d %8d\n", (unsigned long)slots, reads[0], reads[1], reads[2], reads[3],
+               reads[4], reads[5], reads[6]);
+
+        // failed reads, one or several in a row at every step of the search: the head must not move
+        const int runs[] = { 1, 3, 8 };
+        for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); ++r)
+        {
+            for (int fail = 0; fail < 14; ++fail)
+            {
+                build(slots, slots - 1, 100, false, slots);
+                run("failed read, full", slots, (int)(slots - 1), 100, fail, runs[r]);
+                build(slots, slots / 3, 100, false, slots);
+                run("failed read, third", slots, (int)(slots / 3), 100, fail, runs[r]);
+                build(slots, slots / 2, 5000, true, slots);
+                run("failed read, ring", slots, (int)(slots / 2), 5000, fail, runs[r]);
+            }
+        }
+    }
+    printf("%s\n", failures ? "FAILED" : "all searches found the head");
+    return failures ? 1 : 0;
+}
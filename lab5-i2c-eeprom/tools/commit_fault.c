@@ -0,0 +1,298 @@
+//
+// Power-cut fault injection for page_flush on the simulated EEPROM. A batch is flushed on top of batches
+// already committed to the page, and the power is cut at every byte of its two writes in turn (the records
+// with their end marker, then the commit marker), with several values for the half programmed byte. After
+// each cut the page is read back the way boot does: every committed record must still be there, the cut
+// batch must come back whole or not at all, and no torn record may be returned. Boot then searches the log as on
+// the board (sim/log_boot.c) and must find the page, the firmware goes on from page_fill, so a batch written
+// after the reboot must read back too.
+// The same is done for the write of the first slot when the ring wraps (24LC16): boot must go on from the
+// last slot or the new first page, never start the log over.
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o commit_fault commit_fault.c sim/eeprom_sim.c sim/log_boot.c ../log_page.c ../eeprom.c ../log_index.c ../log_record.c ../crc.c
+// ./commit_fault
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eeprom_sim.h"
+#include "log_page.h"
+#include "log_index.h"
+#include "log_boot.h"
+
+#define SEEDS 8 // values of the half programmed byte per cut
+#define MAX_BATCHES 4
+#define MAX_RECORDS 8
+#define EPOCH 3
+#define CUT_SLOT 5 // the pages before it are in the log already, boot finds this one or the one before
+#define WRAP_LEN 10 // payload of the records that fill the ring
+
+typedef struct scenario {
+    const char * name;
+    int batches; // committed before the one that is cut, the last one is cut
+    int records[MAX_BATCHES]; // records per batch
+    uint8_t len[MAX_BATCHES]; // payload length of every record in the batch
+} scenario;
+
+static const scenario scenarios[] = {
+    {"first batch of a page", 1, {3}, {6}},
+    {"middle of a page", 3, {2, 1, 2}, {5, 9, 4}},
+    {"batch ends the page", 3, {2, 1, 1}, {5, 9, 19}},
+};
+
+static log_page page;
+static int failures;
+
+static void payload(uint8_t * out, int batch, int record, uint8_t len)
+{
+    for (int i = 0; i < len; ++i) out[i] = (uint8_t)(batch * 31 + record * 7 + i);
+}
+
+static void append_batch(int batch, int records, uint8_t len)
+{
+    uint8_t data[MAX_RECORD_LEN];
+    for (int r = 0; r < records; ++r)
+    {
+        payload(data, batch, r, len);
+        if (!log_append(&page, data, len)) ++failures;
+    }
+}
+
+// builds the page up to the batch that is cut
+static void setup(const sim_config * config, const scenario * s)
+{
+    sim_init(config);
+    log_index_clear();
+    for (uint32_t slot = 0; slot < CUT_SLOT; ++slot)
+    {
+        uint8_t header[PAGE_HDR_LEN];
+        page_header(header, EPOCH, slot);
+        i2c_write(header, FIRST_MEM_ADDR + slot * LOG_MEM_SIZE, PAGE_HDR_LEN);
+    }
+    page.epoch = EPOCH;
+    page_start(&page, FIRST_MEM_ADDR + CUT_SLOT * LOG_MEM_SIZE, CUT_SLOT);
+    for (int b = 0; b < s->batches - 1; ++b)
+    {
+        append_batch(b, s->records[b], s->len[b]);
+        while (!page_flush(&page)) eeprom_poll();
+        sim_drain();
+    }
+}
+
+// the batch that is cut, a batch that fills the page is flushed by log_append already
+static void cut_batch(const scenario * s)
+{
+    append_batch(s->batches - 1, s->records[s->batches - 1], s->len[s->batches - 1]);
+    while (!page_flush(&page)) eeprom_poll();
+    sim_drain();
+}
+
+static void reboot(void)
+{
+    log_search search;
+    log_index_clear();
+    page.seq = 0; // as read_epoch leaves it, an empty log would start there
+    sim_boot_search(&page, &search);
+}
+
+// offsets of the records boot would return from the page
+static int read_back(const uint8_t * data, int * found, int * torn)
+{
+    int offset = PAGE_HDR_LEN;
+    int size;
+    int count = 0;
+    if (!validate_page(data, page.epoch)) return 0;
+    while ((size = page_next_record(data, &offset, torn)) > 0)
+    {
+        if (count == MAX_BATCHES * MAX_RECORDS + 1) break; // more than was ever appended, the caller fails it
+        found[count++] = offset;
+        offset += size;
+    }
+    return count;
+}
+
+// exactly the records of the first `batches` batches, in order, plus the one written after the reboot
+static bool matches(const uint8_t * data, const scenario * s, int batches, bool extra, int * torn)
+{
+    int offsets[MAX_BATCHES * MAX_RECORDS + 2];
+    int count = read_back(data, offsets, torn);
+    int n = 0;
+    for (int b = 0; b < batches; ++b)
+    {
+        for (int r = 0; r < s->records[b]; ++r, ++n)
+        {
+            uint8_t expected[MAX_RECORD_LEN];
+            payload(expected, b, r, s->len[b]);
+            if (n >= count || data[offsets[n]] != s->len[b] || memcmp(&data[offsets[n] + 1], expected, s->len[b]) != 0)
+                return false;
+        }
+    }
+    if (extra)
+    {
+        uint8_t expected[MAX_RECORD_LEN];
+        payload(expected, 7, 0, 3);
+        if (n >= count || data[offsets[n]] != 3 || memcmp(&data[offsets[n] + 1], expected, 3) != 0) return false;
+        ++n;
+    }
+    return n == count; // nothing torn or stale came back
+}
+
+static void run(const char * part, const sim_config * config, const scenario * s)
+{
+    // bytes the flush writes, from a run without a cut
+    setup(config, s);
+    uint32_t before = sim_get_stats()->write_bytes;
+    cut_batch(s);
+    uint32_t total = sim_get_stats()->write_bytes - before;
+
+    int committed = 0;
+    int dropped = 0;
+    int torn = 0;
+    for (uint32_t cut = 0; cut <= total; ++cut)
+    {
+        for (int seed = 0; seed < (cut < total ? SEEDS : 1); ++seed)
+        {
+            setup(config, s);
+            srand(seed * 977 + cut);
+            if (cut < total) sim_cut_after(cut);
+            cut_batch(s);
+            sim_power_on();
+
+            uint8_t data[LOG_MEM_SIZE];
+            memcpy(data, &sim_memory()[page.address], LOG_MEM_SIZE);
+            bool whole = matches(data, s, s->batches, false, &torn);
+            bool none = matches(data, s, s->batches - 1, false, &torn);
+            if (whole) ++committed;
+            if (none) ++dropped;
+            if ((!whole && !none) || (cut == total && !whole))
+            {
+                if (failures < 10) printf("FAIL %s, %s: cut at byte %lu of %lu\n", part, s->name, (unsigned long)cut,
+                                          (unsigned long)total);
+                ++failures;
+                continue;
+            }
+
+            // reboot: boot finds the page again, or the one before if the first batch was lost with the
+            // header, and the next batch goes where page_fill says
+            uint32_t address = page.address;
+            uint32_t head = validate_page(data, EPOCH) ? address : address - LOG_MEM_SIZE;
+            reboot();
+            if (page.address != head)
+            {
+                if (failures < 10) printf("FAIL %s, %s: boot found page 0X%04lX, expected 0X%04lX, cut at byte %lu\n",
+                                          part, s->name, (unsigned long)page.address, (unsigned long)head,
+                                          (unsigned long)cut);
+                ++failures;
+                continue;
+            }
+            append_batch(7, 1, 3);
+            while (!page_flush(&page)) eeprom_poll();
+            sim_drain();
+            memcpy(data, &sim_memory()[page.address], LOG_MEM_SIZE);
+            int kept = page.address != address ? 0 : whole ? s->batches : s->batches - 1; // full page or the one before: none
+            if (!matches(data, s, kept, true, &torn))
+            {
+                if (failures < 10) printf("FAIL %s, %s: batch after the reboot, cut at byte %lu\n", part, s->name,
+                                          (unsigned long)cut);
+                ++failures;
+            }
+        }
+    }
+    printf("%-8s %-22s %6lu %9d %9d %9d\n", part, s->name, (unsigned long)total, committed, dropped, torn);
+}
+
+#if LOG_RING
+// the ring filled up to its last slot, the next append wraps to the first one; returns the last slot's seq
+static uint32_t fill_ring(const sim_config * config)
+{
+    sim_init(config);
+    log_index_clear();
+    page.epoch = EPOCH;
+    page_start(&page, FIRST_MEM_ADDR, 0);
+    for (int n = 0; page.address != LAST_MEM_ADDR || page.fill + 1 + WRAP_LEN + CRC_LEN + COMMIT_LEN <= LOG_MEM_SIZE; ++n)
+        append_batch(n % MAX_BATCHES, 1, WRAP_LEN);
+    while (!page_flush(&page)) eeprom_poll();
+    sim_drain();
+    return page.seq;
+}
+
+// the power is cut while the first slot is written after the wrap: boot must go on from the last slot or from
+// the new first page, never start the log over, and the page written after the reboot must be found by the next
+static void wrap_run(const char * part, const sim_config * config)
+{
+    fill_ring(config);
+    uint32_t before = sim_get_stats()->write_bytes;
+    append_batch(6, 1, WRAP_LEN);
+    while (!page_flush(&page)) eeprom_poll();
+    sim_drain();
+    uint32_t total = sim_get_stats()->write_bytes - before;
+
+    int committed = 0;
+    int dropped = 0;
+    int torn = 0;
+    for (uint32_t cut = 0; cut <= total; ++cut)
+    {
+        for (int seed = 0; seed < (cut < total ? SEEDS : 1); ++seed)
+        {
+            uint32_t last_seq = fill_ring(config);
+            srand(seed * 977 + cut);
+            if (cut < total) sim_cut_after(cut);
+            append_batch(6, 1, WRAP_LEN);
+            while (!page_flush(&page)) eeprom_poll();
+            sim_drain();
+            sim_power_on();
+
+            reboot();
+            bool whole = page.address == FIRST_MEM_ADDR && page.seq == last_seq + 1;
+            bool none = page.address == LAST_MEM_ADDR && page.seq == last_seq;
+            if (whole) ++committed;
+            if (none) ++dropped;
+            if (!whole && !none)
+            {
+                if (failures < 10) printf("FAIL %s, wrap: boot found page 0X%04lX seq %lu after seq %lu, cut at byte %lu\n",
+                                          part, (unsigned long)page.address, (unsigned long)page.seq,
+                                          (unsigned long)last_seq, (unsigned long)cut);
+                ++failures;
+                continue;
+            }
+
+            // the next batch goes to the first slot either way, and the boot after it must find it there
+            append_batch(7, 1, 3);
+            while (!page_flush(&page)) eeprom_poll();
+            sim_drain();
+            reboot();
+            int offsets[MAX_BATCHES * MAX_RECORDS + 2];
+            int count = read_back(page.data, offsets, &torn);
+            uint8_t expected[MAX_RECORD_LEN];
+            payload(expected, 7, 0, 3);
+            if (page.address != FIRST_MEM_ADDR || page.seq != last_seq + 1 || count == 0 ||
+                page.data[offsets[count - 1]] != 3 || memcmp(&page.data[offsets[count - 1] + 1], expected, 3) != 0)
+            {
+                if (failures < 10) printf("FAIL %s, wrap: batch after the reboot not found, cut at byte %lu\n", part,
+                                          (unsigned long)cut);
+                ++failures;
+            }
+        }
+    }
+    printf("%-8s %-22s %6lu %9d %9d %9d\n", part, "wrap to the first slot", (unsigned long)total, committed, dropped,
+           torn);
+}
+#endif
+
+int main(void)
+{
+    sim_config large = { .geometry = EEPROM_24LC256(1), .write_cycle_us = 5000, .poll_ns = 500 };
+    sim_config small = { .geometry = EEPROM_24LC16, .write_cycle_us = 5000, .poll_ns = 500 };
+    printf("Power cut at every byte of the flush, %d values of the half programmed byte per cut.\n", SEEDS);
+    printf("%-8s %-22s %6s %9s %9s %9s\n", "part", "batch", "bytes", "whole", "dropped", "torn");
+    eeprom_init(&large.geometry);
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) run("24LC256", &large, &scenarios[i]);
+    eeprom_init(&small.geometry); // 16 byte device pages, each write is split
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) run("24LC16", &small, &scenarios[i]);
+#if LOG_RING
+    wrap_run("24LC16", &small); // the ring comes round quickest on the small part
+#endif
+    printf("%s\n", failures ? "FAILED" : "committed records survived every cut, no torn record was returned");
+    return failures ? 1 : 0;
+}
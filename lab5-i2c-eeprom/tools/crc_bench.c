@@ -0,0 +1,145 @@
+//
+// Host check for the CRC-16 engines. Every engine must give the same CRC as crc16_bitwise for any
+// start value, length and alignment, then each one is timed on 64-byte records (one full log page).
+// The numbers are for the host CPU, they only show the ratio between the engines.
+//
+// gcc -std=gnu11 -O2 -Wall -I.. -o crc_bench crc_bench.c ../crc.c
+// ./crc_bench
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "crc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#else
+#define HAVE_CYCLES 0
+#endif
+
+#define RECORD_LEN 64
+#define RECORDS 4096
+#define ROUNDS 200
+#define CHECK_LEN 300
+
+typedef uint16_t (*crc_fn)(uint16_t crc, const uint8_t *data_p, size_t length);
+
+static const struct {
+    const char * name;
+    crc_fn fn;
+} engines[] = {
+        {"bitwise", crc16_bitwise},
+        {"table", crc16_table},
+        {"slice4", crc16_slice4},
+};
+
+#define ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#if HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int check_equivalence(void)
+{
+    static uint8_t buffer[CHECK_LEN + 4];
+    int failures = 0;
+    int cases = 0;
+
+    // CRC-16/CCITT-FALSE check value
+    const uint8_t check[] = "123456789";
+    for (size_t e = 0; e < ENGINES; e++) {
+        uint16_t crc = engines[e].fn(CRC16_INIT, check, 9);
+        if (crc != 0x29B1) {
+            printf("FAIL %s: check value %04X, expected 29B1\n", engines[e].name, crc);
+            failures++;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(buffer); i++) buffer[i] = (uint8_t) rand();
+    for (int len = 0; len <= CHECK_LEN; len++) {
+        for (int align = 0; align < 4; align++) {
+            uint16_t start = (uint16_t) rand();
+            uint16_t expected = crc16_bitwise(start, buffer + align, len);
+            for (size_t e = 1; e < ENGINES; e++) {
+                uint16_t crc = engines[e].fn(start, buffer + align, len);
+                if (crc != expected) {
+                    if (failures < 10)
+                        printf("FAIL %s: len %d align %d start %04X: %04X, expected %04X\n",
+                               engines[e].name, len, align, start, crc, expected);
+                    failures++;
+                }
+                cases++;
+            }
+        }
+    }
+
+    // a record followed by its CRC (big endian) must check to 0, this is what validate_page relies on
+    for (size_t e = 0; e < ENGINES; e++) {
+        uint8_t record[RECORD_LEN];
+        for (int i = 0; i < RECORD_LEN - 2; i++) record[i] = (uint8_t) rand();
+        uint16_t crc = engines[e].fn(CRC16_INIT, record, RECORD_LEN - 2);
+        record[RECORD_LEN - 2] = crc >> 8;
+        record[RECORD_LEN - 1] = crc & 0xFF;
+        if (engines[e].fn(CRC16_INIT, record, RECORD_LEN) != 0) {
+            printf("FAIL %s: record with appended CRC does not check to 0\n", engines[e].name);
+            failures++;
+        }
+    }
+
+    printf("equivalence: %d cases, %d failures\n", cases, failures);
+    return failures;
+}
+
+static void benchmark(void)
+{
+    static uint8_t records[RECORDS][RECORD_LEN];
+    for (int r = 0; r < RECORDS; r++)
+        for (int i = 0; i < RECORD_LEN; i++) records[r][i] = (uint8_t) rand();
+
+    double base_ns = 0;
+    printf("\n%-8s %12s %12s %12s %10s\n", "engine", "ns/record", "ns/byte", "bytes/cycle", "speedup");
+    for (size_t e = 0; e < ENGINES; e++) {
+        volatile uint16_t sink = 0;
+        uint64_t t0 = now_ns();
+        uint64_t c0 = now_cycles();
+        for (int round = 0; round < ROUNDS; round++)
+            for (int r = 0; r < RECORDS; r++) sink ^= engines[e].fn(CRC16_INIT, records[r], RECORD_LEN);
+        uint64_t cycles = now_cycles() - c0;
+        uint64_t ns = now_ns() - t0;
+        (void) sink;
+
+        double bytes = (double) ROUNDS * RECORDS * RECORD_LEN;
+        double ns_record = (double) ns / ((double) ROUNDS * RECORDS);
+        if (e == 0) base_ns = ns_record;
+        printf("%-8s %12.1f %12.3f ", engines[e].name, ns_record, ns / bytes);
+        if (HAVE_CYCLES) printf("%12.3f", bytes / cycles);
+        else printf("%12s", "n/a");
+        printf(" %9.1fx\n", base_ns / ns_record);
+    }
+#if HAVE_CYCLES
+    printf("(cycles are TSC ticks, which run at the nominal clock, not the boost clock)\n");
+#endif
+}
+
+int main(void)
+{
+    srand(1);
+    int failures = check_equivalence();
+    benchmark();
+    return failures ? 1 : 0;
+}
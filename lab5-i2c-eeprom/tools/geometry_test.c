@@ -0,0 +1,215 @@
+//
+// The log on every preset geometry of the simulated EEPROM, from a 24LC16 (31 log slots, fewer than the
+// boot index window) to an M24M02 (4095 slots). For each part:
+//  - random reads and writes through the queue cross device pages, address blocks and chips, and must
+//    match a shadow copy (eeprom_span splits them right for the part),
+//  - the log is filled over more than a lap of the ring, and at several head positions a boot is replayed
+//    from the EEPROM: the search must find the head within its read bound, and the records a read reaches
+//    (older pages, then the index window, then the page being filled) must be every record still in the
+//    log, oldest first.
+// Built with -DLOG_RING=0 the log is filled once instead.
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o geometry_test geometry_test.c sim/eeprom_sim.c sim/log_boot.c ../log_page.c ../eeprom.c ../log_index.c ../log_record.c ../crc.c
+// ./geometry_test
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eeprom_sim.h"
+#include "log_page.h"
+#include "log_index.h"
+#include "log_boot.h"
+
+#define MAX_SIZE (2 * 131072)
+#define MAX_SLOTS (MAX_SIZE / LOG_MEM_SIZE)
+#define ROUND_TRIPS 400
+#define MAX_LEN 700
+#define MAX_RECORDS (MAX_SLOTS * 16)
+
+typedef struct part {
+    const char * name;
+    eeprom_geometry geometry;
+} part;
+
+static const part parts[] = {
+    {"24LC16", EEPROM_24LC16},
+    {"24LC256", EEPROM_24LC256(1)},
+    {"24LC512", EEPROM_24LC512(1)},
+    {"2x24LC1025", EEPROM_24LC1025(2)},
+    {"M24M02", EEPROM_M24M02(1)},
+};
+
+static log_page page;
+static uint8_t shadow[MAX_SIZE];
+static uint32_t page_records[8 * MAX_SLOTS]; // records appended per page sequence number
+static uint32_t reached[MAX_RECORDS];
+static int failures;
+
+static void round_trips(const part * p)
+{
+    static uint8_t data[MAX_LEN];
+    static uint8_t back[MAX_LEN];
+    uint32_t size = eeprom_size();
+    uint32_t block = p->geometry.addr_bytes == 1 ? 256 : 65536;
+    memcpy(shadow, sim_memory(), size);
+    for (int i = 0; i < ROUND_TRIPS; ++i)
+    {
+        uint32_t len = 1 + rand() % MAX_LEN;
+        if (len > size / 2) len = size / 2;
+        uint32_t address = rand() % (size - len);
+        uint32_t boundary = i % 3 == 0 ? p->geometry.capacity : i % 3 == 1 ? block : p->geometry.page_size;
+        if (i % 2 && boundary < size)
+        {
+            uint32_t across = boundary * (1 + rand() % (size / boundary - 1)); // straddle it
+            if (across >= len / 2 && across - len / 2 + len <= size) address = across - len / 2;
+        }
+        for (uint32_t b = 0; b < len; ++b) data[b] = (uint8_t)rand();
+        eeprom_req req = { .status = EEPROM_REQ_IDLE };
+        if (!eeprom_write_async(&req, data, address, len) || !eeprom_req_wait(&req)) ++failures;
+        memcpy(&shadow[address], data, len);
+        req.status = EEPROM_REQ_IDLE;
+        if (!eeprom_read_async(&req, back, address, len) || !eeprom_req_wait(&req) || memcmp(back, data, len) != 0)
+        {
+            if (failures < 10) printf("FAIL %s: %lu bytes at 0X%05lX\n", p->name, (unsigned long)len, (unsigned long)address);
+            ++failures;
+        }
+    }
+    if (memcmp(shadow, sim_memory(), size) != 0)
+    {
+        printf("FAIL %s: writes landed outside their range\n", p->name);
+        ++failures;
+    }
+}
+
+// boot_scan_state on the EEPROM contents, returns the page reads
+static int boot_search(uint32_t * head_address, uint32_t * head_seq)
+{
+    static log_page booted;
+    log_search search;
+    booted.epoch = page.epoch;
+    sim_boot_search(&booted, &search);
+    *head_address = booted.address;
+    *head_seq = booted.seq;
+    return search.reads;
+}
+
+static int page_walk(uint32_t address, bool older, uint32_t * out, int n)
+{
+    const uint8_t * data = &sim_memory()[address];
+    int offset = PAGE_HDR_LEN;
+    int size;
+    if (!validate_page(data, page.epoch)) return n;
+    if (older && page.seq - page_seq(data) <= index_window(&page)) return n; // same filter as print_older_page
+    while ((size = page_next_record(data, &offset, NULL)) > 0)
+    {
+        if (n < MAX_RECORDS) out[n] = RECORD_SEQ(page_seq(data), offset);
+        ++n;
+        offset += size;
+    }
+    return n;
+}
+
+// what read_state prints for "read": older pages, the pages boot_index_state indexes, the page being filled
+static int read_reach(void)
+{
+    uint32_t address;
+    uint32_t count = older_pages(&page, &address);
+    uint32_t slot = (page.address - FIRST_MEM_ADDR) / LOG_MEM_SIZE;
+    int n = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        n = page_walk(address, true, reached, n);
+        address += LOG_MEM_SIZE;
+        if (address > LAST_MEM_ADDR) address = FIRST_MEM_ADDR;
+    }
+    for (uint32_t i = index_window(&page) + 1; i-- > 0;)
+    {
+        n = page_walk(FIRST_MEM_ADDR + (slot + LOG_SLOTS - i) % LOG_SLOTS * LOG_MEM_SIZE, false, reached, n);
+    }
+    return n;
+}
+
+// every record the pages still in the log hold, from the append counts
+static int still_in_log(void)
+{
+    int n = 0;
+    uint32_t oldest = page.seq >= LOG_SLOTS ? page.seq - LOG_SLOTS + 1 : 0;
+    for (uint32_t seq = oldest; seq <= page.seq; ++seq) n += (int)page_records[seq];
+    return n;
+}
+
+static void check_boot(const part * p)
+{
+    while (!page_flush(&page)) eeprom_poll();
+    sim_drain();
+    uint32_t head_address;
+    uint32_t head_seq;
+    int reads = boot_search(&head_address, &head_seq);
+    int limit = 2; // as in boot_search_test
+    for (uint32_t n = LOG_SLOTS; n > 1; n = (n + 1) / 2) ++limit;
+    if (head_address != page.address || head_seq != page.seq || reads > limit)
+    {
+        printf("FAIL %s: head 0X%05lX seq %lu in %d reads, expected 0X%05lX seq %lu\n", p->name,
+               (unsigned long)head_address, (unsigned long)head_seq, reads, (unsigned long)page.address,
+               (unsigned long)page.seq);
+        ++failures;
+    }
+
+    int n = read_reach();
+    int want = still_in_log();
+    bool ordered = true;
+    for (int i = 1; i < n && i < MAX_RECORDS; ++i) if (reached[i] <= reached[i - 1]) ordered = false;
+    if (n != want || !ordered)
+    {
+        printf("FAIL %s at page %lu: read reaches %d records, %d in the log%s\n", p->name, (unsigned long)page.seq, n,
+               want, ordered ? "" : ", out of order");
+        ++failures;
+    }
+}
+
+static void fill_log(const part * p)
+{
+    const uint32_t slots = LOG_SLOTS;
+    const uint32_t checks[] = { 0, 1, INDEX_PAGES - 2, INDEX_PAGES, INDEX_PAGES + 7, slots / 2, slots - 1, slots,
+                                slots + INDEX_PAGES, slots + slots / 2 };
+    size_t next_check = 0;
+    int boots = 0;
+    log_index_clear();
+    memset(page_records, 0, sizeof(page_records));
+    page.epoch = 0;
+    page_start(&page, FIRST_MEM_ADDR, 0);
+    while (next_check < sizeof(checks) / sizeof(checks[0]))
+    {
+        uint8_t data[8] = { 0 };
+        if (!log_event_append(&page, REC_TEST, data, (uint8_t)(rand() % sizeof(data)))) break; // full, LOG_RING 0
+        ++page_records[page.seq];
+        while (next_check < sizeof(checks) / sizeof(checks[0]) && page.seq > checks[next_check])
+        {
+            check_boot(p);
+            ++boots;
+            ++next_check;
+        }
+    }
+    check_boot(p);
+    printf("%-11s %8lu %6lu %8lu %6d\n", p->name, (unsigned long)eeprom_size(), (unsigned long)slots,
+           (unsigned long)page.seq + 1, boots + 1);
+}
+
+int main(void)
+{
+    srand(5);
+    printf("%-11s %8s %6s %8s %6s\n", "part", "bytes", "slots", "pages", "boots");
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); ++i)
+    {
+        sim_config config = { .geometry = parts[i].geometry, .write_cycle_us = 3000, .poll_ns = 500 };
+        sim_init(&config);
+        eeprom_init(&config.geometry);
+        eeprom_set_rate(1000000);
+        round_trips(&parts[i]);
+        sim_init(&config); // log starts on a blank part
+        fill_log(&parts[i]);
+    }
+    printf("%s\n", failures ? "FAILED" : "every part split its transfers right and every read reached the whole log");
+    return failures ? 1 : 0;
+}
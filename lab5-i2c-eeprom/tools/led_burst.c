@@ -0,0 +1,207 @@
+//
+// LED persistence on the simulated EEPROM, running led_persist_step the way the idle branch of the
+// firmware does. Reports the records and bus writes saved by coalescing bursts of button presses, then
+// checks that the LED state still comes back at boot (index window, then the older pages newest first, as
+// boot_leds_state reads them) after the log has moved on by several laps of the ring, on a part with more
+// slots than the window and on one with fewer. The record is only written again before the ring overwrites
+// it, the report gives how often that was and how far back boot had to read.
+// Built with -DLOG_RING=0 it checks instead that a full log makes the step ask for an erase and that the
+// LED state is written again after it.
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o led_burst led_burst.c sim/eeprom_sim.c ../led_persist.c ../log_page.c ../eeprom.c ../log_index.c ../log_record.c ../crc.c
+// ./led_burst
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "eeprom_sim.h"
+#include "led_persist.h"
+#include "log_index.h"
+
+#define TICK_US 10000
+#define PRESS_GAP_US 150000 // between presses of one burst
+#define BURST_GAP_US 5000000 // between bursts
+#define BURSTS 20
+#define FLUSH_DELAY_US 1000000 // same quiet period as the firmware
+
+static log_page page;
+static led_persist leds;
+static int failures;
+
+static void start(const sim_config * config)
+{
+    sim_init(config);
+    eeprom_init(&config->geometry);
+    log_index_clear();
+    memset(&leds, 0, sizeof(leds));
+    leds.saved = LED_NONE;
+    page.epoch = 0;
+    page_start(&page, FIRST_MEM_ADDR, 0);
+}
+
+static void toggle(int led)
+{
+    // what led_logic does on a debounced press
+    set_led_state(&leds.leds[led], !leds.leds[led].state);
+    leds.dirty = true;
+    leds.last_toggle = time_us_64();
+    ++leds.toggles;
+}
+
+// one pass of the idle branch of user_input_state, false when the step asked for an erase
+static bool idle(void)
+{
+    eeprom_poll();
+    if (eeprom_busy()) return true;
+    if (!led_persist_step(&page, &leds)) return false;
+    if (page.flushed < page.fill && time_us_64() - page.last_append >= FLUSH_DELAY_US) page_flush(&page);
+    return true;
+}
+
+static void wait_us(uint32_t us)
+{
+    for (uint32_t t = 0; t < us; t += TICK_US)
+    {
+        sim_advance_us(TICK_US);
+        idle();
+    }
+}
+
+static void burst_report(const sim_config * config)
+{
+    const int sizes[] = { 1, 2, 5, 11 };
+    printf("%d bursts per row, presses %d ms apart, LED record written after %d ms without presses.\n", BURSTS,
+           PRESS_GAP_US / 1000, LED_QUIET_US / 1000);
+    printf("%8s %8s %8s %12s %12s\n", "presses", "toggles", "records", "writes saved", "bus writes");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        start(config);
+        sim_clear_stats();
+        for (int b = 0; b < BURSTS; ++b)
+        {
+            for (int p = 0; p < sizes[s]; ++p)
+            {
+                toggle((b + p) % LED_COUNT);
+                wait_us(PRESS_GAP_US);
+            }
+            wait_us(BURST_GAP_US);
+        }
+        if (leds.dirty || (leds.saved != LED_NONE && leds.saved != led_bits(&leds)))
+        {
+            printf("FAIL: LED state not saved after the last burst\n");
+            ++failures;
+        }
+        printf("%8d %8lu %8lu %12lu %12lu\n", sizes[s], (unsigned long)leds.toggles, (unsigned long)leds.records,
+               (unsigned long)(leds.toggles - leds.records), (unsigned long)sim_get_stats()->writes);
+    }
+}
+
+// what a reboot finds: the boot index window oldest first up to the page being filled, then if it has no LED
+// record the older pages newest first; *older is set to the older pages read
+static uint8_t boot_restore(uint32_t * older)
+{
+    led_persist booted = { .saved = LED_NONE };
+    uint32_t slot = (page.address - FIRST_MEM_ADDR) / LOG_MEM_SIZE;
+    uint32_t window = index_window(&page);
+    for (uint32_t i = window + 1; i-- > 0;)
+    {
+        led_page_scan(&booted, &sim_memory()[FIRST_MEM_ADDR + (slot + LOG_SLOTS - i) % LOG_SLOTS * LOG_MEM_SIZE],
+                      page.epoch);
+    }
+    *older = 0;
+    if (booted.saved != LED_NONE) return booted.saved;
+    uint32_t first_address;
+    uint32_t count = older_pages(&page, &first_address);
+    uint32_t first = (first_address - FIRST_MEM_ADDR) / LOG_MEM_SIZE;
+    for (uint32_t i = count; i-- > 0;)
+    {
+        ++*older;
+        if (led_page_scan(&booted, &sim_memory()[FIRST_MEM_ADDR + (first + i) % LOG_SLOTS * LOG_MEM_SIZE], page.epoch))
+            break;
+    }
+    return booted.saved;
+}
+
+#if LOG_RING
+static void restore_after_laps(const char * name, const sim_config * config)
+{
+    // LEDs set once, then only other records for three laps of the ring
+    start(config);
+    toggle(0);
+    toggle(2);
+    uint8_t bits = led_bits(&leds);
+    wait_us(LED_QUIET_US + FLUSH_DELAY_US + 2 * TICK_US);
+    uint32_t end_seq = page.seq + 3 * LOG_SLOTS;
+    uint32_t lost = 0;
+    uint32_t deepest = 0;
+    while (page.seq < end_seq)
+    {
+        uint32_t older;
+        log_event_append(&page, REC_TEST, NULL, 0);
+        wait_us(2 * TICK_US);
+        sim_drain();
+        if (boot_restore(&older) != bits) ++lost; // power cut here, buffered records are gone
+        if (older > deepest) deepest = older;
+    }
+    printf("%-8s %5lu slots: %lu pages written, LED record written again %lu times, boot read up to %lu older "
+           "pages, restore lost after %lu appends.\n", name, (unsigned long)LOG_SLOTS, (unsigned long)(3 * LOG_SLOTS),
+           (unsigned long)leds.refreshes, (unsigned long)deepest, (unsigned long)lost);
+    if (lost || leds.records != 1)
+    {
+        printf("FAIL %s: LED state lost\n", name);
+        ++failures;
+    }
+}
+#else
+static void full_log(const sim_config * config)
+{
+    // the log fills up while a toggle waits to be saved, the step has to ask for an erase instead of
+    // trying again on every pass
+    start(config);
+    bool erase = false;
+    while (log_event_append(&page, REC_TEST, NULL, 0)) while (eeprom_busy()) eeprom_poll();
+    toggle(1);
+    for (int t = 0; t < (LED_QUIET_US / TICK_US) + 2 && !erase; ++t)
+    {
+        sim_advance_us(TICK_US);
+        erase = !idle();
+    }
+    if (!erase)
+    {
+        printf("FAIL: full log, the LED step never asked for an erase\n");
+        ++failures;
+        return;
+    }
+    // what erase_state does
+    if (!log_erase(&page)) ++failures;
+    leds.saved = LED_NONE;
+    leds.dirty = true;
+    wait_us(FLUSH_DELAY_US + 2 * TICK_US);
+    sim_drain();
+    uint32_t older;
+    if (boot_restore(&older) != led_bits(&leds))
+    {
+        printf("FAIL: LED state not written again after the erase\n");
+        ++failures;
+    }
+    else
+    {
+        printf("Full log: erase requested, LED state written again in epoch %u.\n", page.epoch);
+    }
+}
+#endif
+
+int main(void)
+{
+    sim_config large = { .geometry = EEPROM_24LC256(1), .write_cycle_us = 5000, .poll_ns = 500 };
+    burst_report(&large);
+#if LOG_RING
+    sim_config small = { .geometry = EEPROM_24LC16, .write_cycle_us = 5000, .poll_ns = 500 };
+    restore_after_laps("24LC256", &large);
+    restore_after_laps("24LC16", &small);
+#else
+    full_log(&large);
+#endif
+    printf("%s\n", failures ? "FAILED" : "LED state survived");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+//
+// Host decoder for the EEPROM log. Reads an image of the EEPROM from address 0 (epoch page first),
+// puts the valid pages of the current epoch in sequence order and prints every record with its
+// absolute time. With -s it compares record sizes of the binary format with the old string records.
+//
+// gcc -std=c11 -Wall -I.. -o log_decode log_decode.c log_image.c ../log_record.c ../crc.c
+// ./log_decode eeprom.bin
+// ./log_decode -s
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log_record.h"
+#include "log_image.h"
+
+#define SIZE_EVENTS 1000
+
+static int decode(const char * path)
+{
+    static uint8_t image[MAX_IMAGE_SIZE];
+    FILE * f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return 1;
+    }
+    size_t size = fread(image, 1, sizeof(image), f);
+    fclose(f);
+    return decode_image(image, size);
+}
+
+// records packed into pages the way log_append does it, one commit marker per record (flushed one at a time)
+static int pages_needed(const int * sizes, int n)
+{
+    int pages = 1;
+    int fill = PAGE_HDR_LEN;
+    for (int i = 0; i < n; ++i)
+    {
+        if (fill + sizes[i] + COMMIT_LEN > LOG_MEM_SIZE)
+        {
+            ++pages;
+            fill = PAGE_HDR_LEN;
+        }
+        fill += sizes[i] + COMMIT_LEN;
+    }
+    return pages;
+}
+
+static void report(const char * name, const int * sizes, int n)
+{
+    long total = 0;
+    for (int i = 0; i < n; ++i) total += sizes[i];
+    int pages = pages_needed(sizes, n);
+    printf("%-24s %6.2f bytes/record %6.2f records/page\n", name, (double)total / n, (double)n / pages);
+}
+
+static int sizes(void)
+{
+    // synthetic session: a boot, then a test record or an LED change every 0.5 to 30 s
+    static int text[SIZE_EVENTS], text_time[SIZE_EVENTS], binary[SIZE_EVENTS];
+    uint8_t payload[MAX_RECORD_LEN];
+    char str[MAX_RECORD_LEN + 1];
+    uint32_t uptime = 1;
+    srand(1);
+
+    for (int i = 0; i < SIZE_EVENTS; ++i)
+    {
+        uint32_t delta = i ? 500 + (uint32_t)(rand() % 29500) : uptime;
+        uptime += i ? delta : 0;
+        uint8_t type = i == 0 ? REC_BOOT : (rand() % 2 ? REC_TEST : REC_LED);
+        uint8_t bits = (uint8_t)(rand() % 8);
+        uint8_t data[2] = { bits, (uint8_t)~bits };
+        const char * name = type == REC_BOOT ? "Boot" : type == REC_TEST ? "Test" : "LEDs 1 0 1";
+
+        int len = (int)strlen(name); // old format: the string, no time
+        text[i] = 1 + len + CRC_LEN;
+        len = snprintf(str, sizeof(str), "%s %lu", name, (unsigned long)uptime); // same string with uptime in ms
+        text_time[i] = 1 + len + CRC_LEN;
+        len = (int)record_encode(payload, type, delta, data, type == REC_LED ? sizeof(data) : 0);
+        binary[i] = 1 + len + CRC_LEN;
+    }
+
+    printf("%d events, %d byte pages\n", SIZE_EVENTS, LOG_MEM_SIZE);
+    report("string, no time", text, SIZE_EVENTS);
+    report("string + uptime", text_time, SIZE_EVENTS);
+    report("binary + delta time", binary, SIZE_EVENTS);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc == 2 && !strcmp(argv[1], "-s")) return sizes();
+    if (argc == 2) return decode(argv[1]);
+    fprintf(stderr, "usage: %s eeprom.bin | -s\n", argv[0]);
+    return 2;
+}
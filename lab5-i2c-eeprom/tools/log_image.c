@@ -0,0 +1,60 @@
+//
+// Valid pages of the current epoch are put in sequence order, which is the order the firmware wrote them in.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "log_image.h"
+#include "log_record.h"
+
+static const uint8_t * sort_image; // qsort has no context argument
+
+static int compare_seq(const void * a, const void * b)
+{
+    uint32_t sa = page_seq(&sort_image[*(const size_t *)a]);
+    uint32_t sb = page_seq(&sort_image[*(const size_t *)b]);
+    return sa < sb ? -1 : sa > sb;
+}
+
+int decode_image(const uint8_t * image, size_t size)
+{
+    if (size < FIRST_MEM_ADDR || size > MAX_IMAGE_SIZE)
+    {
+        fprintf(stderr, "image size %zu not supported\n", size);
+        return 1;
+    }
+
+    uint16_t epoch = 0; // same rule as the firmware: no valid copy means a never erased part, epoch 0
+    uint32_t first_seq = 0;
+    epoch_pick(&image[EPOCH_MEM_ADDR], &epoch, &first_seq);
+
+    static size_t pages[MAX_IMAGE_SIZE / LOG_MEM_SIZE];
+    size_t count = 0;
+    for (size_t address = FIRST_MEM_ADDR; address + LOG_MEM_SIZE <= size; address += LOG_MEM_SIZE)
+    {
+        if (validate_page(&image[address], epoch)) pages[count++] = address;
+    }
+    sort_image = image;
+    qsort(pages, count, sizeof(pages[0]), compare_seq);
+
+    uint32_t clock_ms = 0;
+    int records = 0;
+    int torn = 0;
+    char text[80];
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t * page = &image[pages[i]];
+        int offset = PAGE_HDR_LEN;
+        int record;
+        while ((record = page_next_record(page, &offset, &torn)) > 0)
+        {
+            record_describe(text, sizeof(text), &page[offset + 1], page[offset], &clock_ms);
+            printf("%s. Memory address: 0X%02zX. Seq: %lu\n", text, pages[i] + offset, (unsigned long)RECORD_SEQ(page_seq(page), offset));
+            offset += record;
+            ++records;
+        }
+    }
+    printf("Epoch %u, first page %lu: %zu pages, %d records, %d torn records skipped.\n", epoch, (unsigned long)first_seq,
+           count, records, torn);
+    return 0;
+}
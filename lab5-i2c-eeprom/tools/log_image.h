@@ -0,0 +1,16 @@
+//
+// Decoding of a whole EEPROM image (epoch page first), shared by the host tools.
+//
+
+#ifndef EEPROM_LOG_IMAGE_H
+#define EEPROM_LOG_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_IMAGE_SIZE 0X100000 // two 512 KB parts
+
+// prints every committed record of the current epoch, oldest first, with absolute times
+int decode_image(const uint8_t * image, size_t size);
+
+#endif //EEPROM_LOG_IMAGE_H
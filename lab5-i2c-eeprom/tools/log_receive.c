@@ -0,0 +1,134 @@
+//
+// Host receiver for the 'export' console command. Reads frames from the serial port (or from a capture
+// file), skips anything that is not a frame with a good CRC, reassembles the EEPROM image, saves it
+// and prints the decoded log. Type 'export' on the console after starting it.
+//
+// gcc -std=gnu11 -Wall -I.. -o log_receive log_receive.c log_image.c ../log_record.c ../crc.c
+// ./log_receive /dev/ttyUSB0 eeprom.bin
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "log_record.h"
+#include "log_image.h"
+#include "crc.h"
+
+#define FRAME_MAX (EXPORT_HDR_LEN + EXPORT_CHUNK + CRC_LEN)
+
+static uint8_t image[MAX_IMAGE_SIZE];
+static uint8_t received[MAX_IMAGE_SIZE]; // 1 for every byte a data frame has covered
+static size_t image_size = 0;
+static unsigned frames = 0;
+
+static void serial_raw(int fd)
+{
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) return; // capture file
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tcsetattr(fd, TCSANOW, &tio);
+}
+
+// returns 1 when the end frame has arrived, -1 if the export is incomplete
+static int handle_frame(uint8_t type, uint32_t offset, const uint8_t * data, uint16_t len)
+{
+    ++frames;
+    switch (type)
+    {
+        case EXPORT_START:
+            if (len != 5) return 0;
+            image_size = (size_t)data[0] << 24 | (size_t)data[1] << 16 | (size_t)data[2] << 8 | data[3];
+            if (image_size > MAX_IMAGE_SIZE) image_size = MAX_IMAGE_SIZE;
+            memset(received, 0, sizeof(received));
+            frames = 1; // a restarted export counts from its own start frame
+            fprintf(stderr, "Export started: %zu bytes, %u byte pages.\n", image_size, data[4]);
+            return 0;
+        case EXPORT_DATA:
+            if (offset + len > image_size) return 0;
+            memcpy(&image[offset], data, len);
+            memset(&received[offset], 1, len);
+            return 0;
+        case EXPORT_END:
+        {
+            unsigned sent = len == 4 ? (unsigned)data[0] << 24 | (unsigned)data[1] << 16 | (unsigned)data[2] << 8 | data[3] : 0;
+            size_t missing = 0;
+            for (size_t i = 0; i < image_size; ++i) missing += !received[i];
+            fprintf(stderr, "Export finished: %u of %u frames, %zu bytes missing.\n", frames, sent, missing);
+            return image_size && !missing ? 1 : -1;
+        }
+        default:
+            return 0;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s serial-device|capture-file image.bin\n", argv[0]);
+        return 2;
+    }
+    int fd = open(argv[1], O_RDONLY | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    serial_raw(fd);
+
+    static uint8_t buf[2 * FRAME_MAX];
+    size_t have = 0;
+    int done = 0;
+    while (!done)
+    {
+        ssize_t n = read(fd, &buf[have], sizeof(buf) - have);
+        if (n <= 0) break; // end of capture file
+        have += (size_t)n;
+
+        // drop bytes until a frame with a good CRC starts at buf[0]
+        while (have >= EXPORT_HDR_LEN && !done)
+        {
+            if (buf[0] != EXPORT_SYNC0 || buf[1] != EXPORT_SYNC1)
+            {
+                memmove(buf, buf + 1, --have);
+                continue;
+            }
+            uint16_t len = (uint16_t)(buf[7] << 8 | buf[8]);
+            if (len > EXPORT_CHUNK)
+            {
+                memmove(buf, buf + 1, --have);
+                continue;
+            }
+            size_t frame_len = EXPORT_HDR_LEN + len + CRC_LEN;
+            if (have < frame_len) break; // rest of the frame is still on its way
+            if (calculate_crc(&buf[2], frame_len - 2) != 0)
+            {
+                memmove(buf, buf + 1, --have); // text that happened to look like a sync
+                continue;
+            }
+            uint32_t offset = (uint32_t)buf[3] << 24 | (uint32_t)buf[4] << 16 | (uint32_t)buf[5] << 8 | buf[6];
+            done = handle_frame(buf[2], offset, &buf[EXPORT_HDR_LEN], len);
+            have -= frame_len;
+            memmove(buf, buf + frame_len, have);
+        }
+    }
+    close(fd);
+
+    if (done != 1)
+    {
+        fprintf(stderr, "No complete export received.\n");
+        return 1;
+    }
+    FILE * f = fopen(argv[2], "wb");
+    if (!f || fwrite(image, 1, image_size, f) != image_size)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    fclose(f);
+    return decode_image(image, image_size);
+}
@@ -0,0 +1,148 @@
+//
+// Wear of the log on the simulated EEPROM. The real append and flush code runs for millions of appends
+// (hundreds of laps of the ring) with different flush patterns, and the model counts every write each byte
+// and each device page sees. A byte is written when its page is programmed with it, a page write cycle is
+// one write transaction on that device page (24xx endurance is specified per page write). Page sequence
+// numbers must go up by one page at a time, and a boot at every wrap must find the newest page.
+//
+// gcc -std=gnu11 -O2 -Wall -Isim -I.. -o log_wear log_wear.c sim/eeprom_sim.c sim/log_boot.c ../log_page.c ../eeprom.c ../log_index.c ../log_record.c ../crc.c
+// ./log_wear [millions of appends, 2 by default]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eeprom_sim.h"
+#include "log_page.h"
+#include "log_index.h"
+#include "log_boot.h"
+
+#define APPENDS 2000000 // per workload
+#define RECORD_GAP_US 50000 // between appends of one burst
+#define FLUSH_DELAY_US 1000000 // same quiet period as the firmware
+
+typedef struct workload {
+    const char * name;
+    int batch; // records per flush, 0: only full pages are flushed
+} workload;
+
+static const workload workloads[] = {
+    {"flush every record", 1},
+    {"bursts of 3", 3},
+    {"bursts of 8", 8},
+    {"full pages only", 0},
+};
+
+static log_page page;
+static log_page booted;
+static int failures;
+
+// right after a wrap the last slot is the newest page on the EEPROM, unless the first one was flushed already
+static void check_wrap(const workload * w)
+{
+    log_search search;
+    booted.epoch = page.epoch;
+    booted.seq = 0;
+    sim_boot_search(&booted, &search);
+    uint32_t address = page.flushed ? page.address : LAST_MEM_ADDR;
+    uint32_t seq = page.flushed ? page.seq : page.seq - 1;
+    if (booted.address != address || booted.seq != seq)
+    {
+        if (failures < 10) printf("FAIL %s: boot after the wrap to page %lu found 0X%05lX seq %lu\n", w->name,
+                                  (unsigned long)page.seq, (unsigned long)booted.address, (unsigned long)booted.seq);
+        ++failures;
+    }
+}
+
+static void run(const workload * w, const sim_config * config, uint32_t appends)
+{
+    sim_init(config);
+    eeprom_init(&config->geometry);
+    log_index_clear();
+    page.epoch = 0;
+    page_start(&page, FIRST_MEM_ADDR, 0);
+
+    uint32_t records = 0;
+    uint32_t first_seq = page.seq;
+    while (records < appends)
+    {
+        uint32_t seq = page.seq;
+        sim_advance_us(RECORD_GAP_US);
+        log_event_append(&page, REC_TEST, NULL, 0);
+        ++records;
+        if (w->batch && records % w->batch == 0)
+        {
+            sim_advance_us(FLUSH_DELAY_US); // input went quiet
+            while (!page_flush(&page)) eeprom_poll();
+        }
+        sim_drain();
+        if (page.seq != seq && page.seq != seq + 1)
+        {
+            if (failures < 10) printf("FAIL %s: page %lu followed by %lu\n", w->name, (unsigned long)seq,
+                                      (unsigned long)page.seq);
+            ++failures;
+        }
+        if (page.seq != seq && page.address == FIRST_MEM_ADDR) check_wrap(w);
+    }
+    double laps = (double)(page.seq - first_seq + 1) / LOG_SLOTS;
+
+    // the image must still read back: every slot a valid page, no torn records
+    int torn = 0;
+    uint32_t valid = 0;
+    for (uint32_t slot = 0; slot < LOG_SLOTS; ++slot)
+    {
+        const uint8_t * data = &sim_memory()[FIRST_MEM_ADDR + slot * LOG_MEM_SIZE];
+        int offset = PAGE_HDR_LEN;
+        int size;
+        if (!validate_page(data, page.epoch)) continue;
+        ++valid;
+        while ((size = page_next_record(data, &offset, &torn)) > 0) offset += size;
+    }
+    if (valid != LOG_SLOTS || torn)
+    {
+        printf("FAIL %s: %lu of %lu pages valid, %d torn records\n", w->name, (unsigned long)valid,
+               (unsigned long)LOG_SLOTS, torn);
+        ++failures;
+    }
+
+    const uint32_t * wear = sim_wear();
+    const uint32_t * page_wear = sim_page_wear();
+    uint32_t end = eeprom_size();
+    uint32_t max = 0;
+    uint64_t total = 0;
+    for (uint32_t address = FIRST_MEM_ADDR; address < end; ++address)
+    {
+        if (wear[address] > max) max = wear[address];
+        total += wear[address];
+    }
+    uint16_t device_page = config->geometry.page_size;
+    uint32_t page_max = 0;
+    uint64_t page_total = 0;
+    uint32_t pages = 0;
+    for (uint32_t address = FIRST_MEM_ADDR; address < end; address += device_page, ++pages)
+    {
+        uint32_t cycles = page_wear[address / device_page];
+        if (cycles > page_max) page_max = cycles;
+        page_total += cycles;
+    }
+    double cells = end - FIRST_MEM_ADDR;
+    printf("%-20s %8lu %6.0f %8.2f %9lu %9.1f %10lu %10.1f %8.2f\n", w->name, (unsigned long)records, laps,
+           (double)sim_get_stats()->writes / records, (unsigned long)max, total / cells, (unsigned long)page_max,
+           (double)page_total / pages, page_max / laps);
+}
+
+int main(int argc, char ** argv)
+{
+    // wear does not depend on how often the CPU polls, a slow poll keeps millions of appends quick
+    sim_config config = { .geometry = EEPROM_24LC256(1), .write_cycle_us = 5000, .poll_ns = 50000 };
+    uint32_t appends = argc > 1 ? (uint32_t)(atof(argv[1]) * 1000000) : APPENDS;
+
+    printf("24LC256, %d byte log pages, %lu slots, %lu appends per workload. Write cycles after the run.\n",
+           LOG_MEM_SIZE, (unsigned long)((config.geometry.capacity - FIRST_MEM_ADDR - LOG_MEM_SIZE) / LOG_MEM_SIZE + 1),
+           (unsigned long)appends);
+    printf("%-20s %8s %6s %8s %9s %9s %10s %10s %8s\n", "workload", "records", "laps", "writes/r", "byte max",
+           "byte mean", "page max", "page mean", "page/lap");
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i) run(&workloads[i], &config, appends);
+    printf("%s\n", failures ? "FAILED" : "page numbers went up one at a time and every wrap booted to the newest page");
+    return failures ? 1 : 0;
+}
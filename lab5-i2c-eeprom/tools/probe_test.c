@@ -0,0 +1,78 @@
+//
+// Host test for eeprom_probe_rate on the simulated EEPROM. The model corrupts reads above a configurable
+// clock, the probe must pick the fastest standard rate at or below it and fall back to the given rate when
+// even 100 kHz fails. Only the scratch area may be written.
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o probe_test probe_test.c sim/eeprom_sim.c ../eeprom.c ../crc.c
+// ./probe_test
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "eeprom_sim.h"
+
+#define SCRATCH_ADDR 0X0020 // same as SCRATCH_MEM_ADDR in main.c
+#define FALLBACK 9600
+
+int main(void)
+{
+    const uint32_t limits[] = { 0, 1500000, 1000000, 999999, 400000, 250000, 100000, 99999, 20000 };
+    sim_config config = { .geometry = EEPROM_24LC256(1), .write_cycle_us = 3000, .poll_ns = 500 };
+    static uint8_t before[32768];
+    int failures = 0;
+
+    sim_init(&config);
+    eeprom_init(&config.geometry);
+    printf("%10s %10s %10s %8s %10s\n", "part max", "expected", "selected", "writes", "probe us");
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); ++i)
+    {
+        config.max_hz = limits[i];
+        sim_init(&config);
+        memcpy(before, sim_memory(), sizeof(before));
+
+        uint expected = FALLBACK;
+        for (int r = 0; r < EEPROM_RATE_COUNT; ++r)
+        {
+            if (limits[i] == 0 || eeprom_rates[r] <= limits[i]) expected = eeprom_rates[r];
+        }
+
+        uint64_t start = sim_time_ns();
+        uint selected = eeprom_probe_rate(SCRATCH_ADDR, FALLBACK);
+        uint64_t us = (sim_time_ns() - start) / 1000;
+
+        bool ok = selected == expected && eeprom_get_rate() == expected;
+        // the check writes its pattern into the scratch area and nowhere else
+        for (uint32_t a = 0; a < sizeof(before); ++a)
+        {
+            if ((a < SCRATCH_ADDR || a >= SCRATCH_ADDR + EEPROM_CHECK_LEN) && sim_memory()[a] != before[a]) ok = false;
+        }
+        if (!ok) ++failures;
+        printf("%10lu %10u %10u %8lu %10llu%s\n", (unsigned long)limits[i], expected, selected,
+               (unsigned long)sim_get_stats()->writes, (unsigned long long)us, ok ? "" : "  FAIL");
+    }
+
+    // a pass must not come from an earlier check: the pattern changes with the rate, so a part that
+    // stopped storing writes fails every rate even though the scratch area still holds a good check block
+    config.max_hz = 0;
+    sim_init(&config);
+    eeprom_probe_rate(SCRATCH_ADDR, FALLBACK);
+    sim_write_protect(true);
+    uint selected = eeprom_probe_rate(SCRATCH_ADDR, FALLBACK);
+    if (selected != FALLBACK)
+    {
+        printf("FAIL: probe passed at %u Hz on a write protected part\n", selected);
+        ++failures;
+    }
+
+    // a part that does not answer at all
+    sim_init(&config);
+    sim_cut_after(0);
+    selected = eeprom_probe_rate(SCRATCH_ADDR, FALLBACK);
+    if (selected != FALLBACK)
+    {
+        printf("FAIL: probe passed at %u Hz on a dead part\n", selected);
+        ++failures;
+    }
+    printf("%s\n", failures ? "FAILED" : "probe picked the fastest working rate every time");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+//
+// Concurrency test for the eeprom.c request queue on the simulated EEPROM. Random reads and writes are
+// kept in flight from a foreground loop that does other work between polls, over two 24LC1025 so requests
+// are split at pages, blocks and chips. Every read must see the writes submitted before it (the queue runs
+// in order), requests must finish in submission order, a full queue must refuse, a chip that stops
+// answering must fail its request without blocking the ones after it, and the foreground loop must keep
+// running while the bus is busy.
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o queue_test queue_test.c sim/eeprom_sim.c ../eeprom.c ../crc.c
+// ./queue_test
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eeprom_sim.h"
+
+#define OPERATIONS 3000
+#define MAX_LEN 600 // crosses pages, and sometimes the block and chip boundaries
+#define FOREGROUND_US 15 // work the main loop does between polls
+
+typedef struct slot {
+    eeprom_req req;
+    uint8_t data[MAX_LEN];
+    uint8_t expected[MAX_LEN]; // reads: the model contents when the read was submitted
+    uint32_t order; // submission number
+    bool used;
+} slot;
+
+static slot slots[EEPROM_QUEUE_LEN];
+static uint8_t shadow[2 * 131072];
+static int failures;
+static uint32_t submitted;
+static uint32_t completed;
+
+static void fail(const char * what, uint32_t order)
+{
+    if (failures < 10) printf("FAIL %s (request %lu)\n", what, (unsigned long)order);
+    ++failures;
+}
+
+static void reap(void)
+{
+    // requests must come back in the order they went in
+    for (;;)
+    {
+        slot * next = NULL;
+        for (int i = 0; i < EEPROM_QUEUE_LEN; ++i)
+        {
+            if (slots[i].used && slots[i].order == completed) next = &slots[i];
+        }
+        if (!next || eeprom_req_busy(&next->req)) break;
+        for (int i = 0; i < EEPROM_QUEUE_LEN; ++i)
+        {
+            if (slots[i].used && slots[i].order > completed && !eeprom_req_busy(&slots[i].req))
+                fail("finished before an older request", slots[i].order);
+        }
+        if (next->req.status != EEPROM_REQ_DONE) fail("request failed", next->order);
+        if (next->req.rx && memcmp(next->data, next->expected, next->req.len) != 0) fail("read does not match", next->order);
+        next->req.status = EEPROM_REQ_IDLE;
+        next->used = false;
+        ++completed;
+    }
+}
+
+static void random_traffic(void)
+{
+    uint32_t size = eeprom_size();
+    uint64_t loops = 0;
+    uint64_t busy_loops = 0;
+    uint64_t start = sim_time_ns();
+    memcpy(shadow, sim_memory(), size);
+
+    while (submitted < OPERATIONS || completed < submitted)
+    {
+        if (submitted < OPERATIONS && rand() % 3 == 0)
+        {
+            slot * s = NULL;
+            for (int i = 0; i < EEPROM_QUEUE_LEN; ++i) if (!slots[i].used) s = &slots[i];
+            uint32_t len = 1 + rand() % MAX_LEN;
+            uint32_t address = rand() % (size - len);
+            if (rand() % 4 == 0) address = 131072 - len / 2; // across the chips
+            bool write = rand() % 2;
+            if (s)
+            {
+                bool ok;
+                if (write)
+                {
+                    for (uint32_t i = 0; i < len; ++i) s->data[i] = (uint8_t)rand();
+                    ok = eeprom_write_async(&s->req, s->data, address, len);
+                    if (ok) memcpy(&shadow[address], s->data, len);
+                }
+                else
+                {
+                    memcpy(s->expected, &shadow[address], len); // writes queued before it land first
+                    ok = eeprom_read_async(&s->req, s->data, address, len);
+                }
+                if (!ok) fail("submit refused with a free slot", submitted);
+                s->order = submitted++;
+                s->used = true;
+            }
+            else if (eeprom_queue_space() != 0)
+            {
+                fail("queue reports space while every request is in flight", submitted);
+            }
+        }
+        ++loops;
+        if (eeprom_busy()) ++busy_loops;
+        eeprom_poll();
+        sim_advance_us(FOREGROUND_US);
+        reap();
+    }
+
+    uint64_t us = (sim_time_ns() - start) / 1000;
+    const sim_stats * stats = sim_get_stats();
+    if (memcmp(shadow, sim_memory(), size) != 0) fail("EEPROM contents differ from the model", 0);
+    printf("%d requests, %lu transactions (%lu refused during write cycles), %llu ms.\n", OPERATIONS,
+           (unsigned long)stats->transactions, (unsigned long)stats->nacks, (unsigned long long)(us / 1000));
+    printf("Foreground loop ran %llu times, %llu of them with requests pending (%.0f%% of the loops).\n",
+           (unsigned long long)loops, (unsigned long long)busy_loops, 100.0 * (double)busy_loops / (double)loops);
+}
+
+static void full_queue(void)
+{
+    static uint8_t data[EEPROM_QUEUE_LEN + 1][16];
+    eeprom_req reqs[EEPROM_QUEUE_LEN + 1];
+    while (eeprom_busy()) eeprom_poll();
+    for (int i = 0; i <= EEPROM_QUEUE_LEN; ++i)
+    {
+        reqs[i].status = EEPROM_REQ_IDLE;
+        bool ok = eeprom_read_async(&reqs[i], data[i], 0, sizeof(data[i]));
+        if (ok != (i < EEPROM_QUEUE_LEN)) fail("full queue", i);
+    }
+    for (int i = 0; i < EEPROM_QUEUE_LEN; ++i) if (!eeprom_req_wait(&reqs[i])) fail("queued read", i);
+    if (eeprom_queue_space() != EEPROM_QUEUE_LEN) fail("space after the queue drained", 0);
+}
+
+static void dead_chip(void)
+{
+    // Power goes in the middle of a write: the write itself was acknowledged, the requests behind it
+    // must fail after their retries instead of keeping the queue busy.
+    static uint8_t data[64];
+    static uint8_t back[64];
+    eeprom_req cut_req = { .status = EEPROM_REQ_IDLE };
+    eeprom_req write_req = { .status = EEPROM_REQ_IDLE };
+    eeprom_req read_req = { .status = EEPROM_REQ_IDLE };
+    memset(data, 0X5A, sizeof(data));
+    while (eeprom_busy()) eeprom_poll();
+    sim_cut_after(10);
+    uint64_t start = sim_time_ns();
+    eeprom_write_async(&cut_req, data, 0X1000, sizeof(data));
+    eeprom_write_async(&write_req, data, 0X1040, sizeof(data));
+    eeprom_read_async(&read_req, back, 0X2000, sizeof(back));
+    bool cut_ok = eeprom_req_wait(&cut_req);
+    bool write_ok = eeprom_req_wait(&write_req);
+    bool read_ok = eeprom_req_wait(&read_req);
+    if (!cut_ok || write_ok || read_ok) fail("requests after the power cut", 0);
+    if (eeprom_busy()) fail("queue still busy after the failures", 0);
+    printf("Dead chip: write and read failed after %llu ms.\n", (unsigned long long)((sim_time_ns() - start) / 1000000));
+
+    sim_power_on();
+    read_req.status = EEPROM_REQ_IDLE;
+    if (!eeprom_read_async(&read_req, back, 0X2000, sizeof(back)) || !eeprom_req_wait(&read_req))
+        fail("read after power came back", 0);
+}
+
+int main(void)
+{
+    sim_config config = { .geometry = EEPROM_24LC1025(2), .write_cycle_us = 5000, .poll_ns = 500 };
+    srand(7);
+    sim_init(&config);
+    eeprom_init(&config.geometry);
+    eeprom_set_rate(1000000);
+
+    random_traffic();
+    full_queue();
+    dead_chip();
+    printf("%s\n", failures ? "FAILED" : "queue ran in order and every read matched");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+//
+// Measured cost of reading the boot index window (31 pages) on the simulated EEPROM, one read per state
+// machine tick as boot_index_state does, for chunk sizes from one page per read up to the whole window.
+// Bus transactions and bytes come from the model, wall time from the simulated clock: bus bit time at the
+// set clock, the poll loop, and TICK_US of other work per tick (input, buttons).
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o read_bench read_bench.c sim/eeprom_sim.c ../log_page.c ../eeprom.c ../log_index.c ../log_record.c ../crc.c
+// ./read_bench
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "eeprom_sim.h"
+#include "log_page.h"
+#include "log_index.h"
+
+#define WINDOW_PAGES 31
+#define TICK_US 20 // rest of a state machine tick
+
+static log_page page;
+static uint8_t buffer[WINDOW_PAGES * LOG_MEM_SIZE];
+static int failures;
+
+static void fill_log(void)
+{
+    log_index_clear();
+    page.epoch = 0;
+    page_start(&page, FIRST_MEM_ADDR, 0);
+    while (page.address < FIRST_MEM_ADDR + WINDOW_PAGES * LOG_MEM_SIZE)
+    {
+        sim_advance_us(1000);
+        log_event_append(&page, REC_TEST, NULL, 0);
+    }
+    while (eeprom_busy()) eeprom_poll();
+}
+
+static int count_records(const uint8_t * data, size_t len)
+{
+    int records = 0;
+    for (size_t offset = 0; offset < len; offset += LOG_MEM_SIZE)
+    {
+        const uint8_t * p = &data[offset];
+        int o = PAGE_HDR_LEN;
+        int size;
+        if (!validate_page(p, page.epoch)) continue;
+        while ((size = page_next_record(p, &o, NULL)) > 0)
+        {
+            o += size;
+            ++records;
+        }
+    }
+    return records;
+}
+
+// streams the window like boot_index_state, returns the records found
+static int read_window(size_t chunk, uint64_t * us, uint32_t * ticks)
+{
+    eeprom_req req = { .status = EEPROM_REQ_IDLE };
+    uint32_t address = FIRST_MEM_ADDR;
+    uint32_t end = FIRST_MEM_ADDR + WINDOW_PAGES * LOG_MEM_SIZE;
+    size_t len = 0;
+    memset(buffer, 0, sizeof(buffer));
+    sim_clear_stats();
+    uint64_t start = sim_time_ns();
+    *ticks = 0;
+    while (address < end || eeprom_req_busy(&req))
+    {
+        ++*ticks;
+        eeprom_poll();
+        sim_advance_us(TICK_US);
+        if (eeprom_req_busy(&req)) continue;
+        if (req.status != EEPROM_REQ_IDLE)
+        {
+            if (req.status != EEPROM_REQ_DONE) ++failures;
+            req.status = EEPROM_REQ_IDLE;
+            address += len;
+            continue; // next read goes out on the next tick
+        }
+        len = end - address < chunk ? end - address : chunk;
+        eeprom_read_async(&req, &buffer[address - FIRST_MEM_ADDR], address, len);
+    }
+    *us = (sim_time_ns() - start) / 1000;
+    return count_records(buffer, sizeof(buffer));
+}
+
+int main(void)
+{
+    const uint rates[] = { 100000, 400000, 1000000 };
+    const size_t chunks[] = { LOG_MEM_SIZE, 4 * LOG_MEM_SIZE, 16 * LOG_MEM_SIZE, WINDOW_PAGES * LOG_MEM_SIZE };
+    sim_config config = { .geometry = EEPROM_24LC256(1), .write_cycle_us = 5000, .poll_ns = 500 };
+    sim_init(&config);
+    eeprom_init(&config.geometry);
+    fill_log();
+    int expected = count_records(&sim_memory()[FIRST_MEM_ADDR], sizeof(buffer));
+
+    printf("%d pages, %d records, %d us of other work per tick.\n", WINDOW_PAGES, expected, TICK_US);
+    printf("%8s %6s %6s %12s %10s %8s %10s\n", "rate", "chunk", "xfers", "bus bytes", "bus us", "ticks", "wall us");
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r)
+    {
+        eeprom_set_rate(rates[r]);
+        for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c)
+        {
+            uint64_t us;
+            uint32_t ticks;
+            int records = read_window(chunks[c], &us, &ticks);
+            const sim_stats * stats = sim_get_stats();
+            if (records != expected)
+            {
+                printf("FAIL: %d records read, %d in the log\n", records, expected);
+                ++failures;
+            }
+            // address and restart phases: device address twice plus the memory address per transaction
+            uint64_t bytes = stats->read_bytes + (uint64_t)stats->transactions * (2 + config.geometry.addr_bytes);
+            printf("%8u %6zu %6lu %12llu %10llu %8lu %10llu\n", rates[r], chunks[c], (unsigned long)stats->transactions,
+                   (unsigned long long)bytes, (unsigned long long)(stats->bus_ns / 1000), (unsigned long)ticks,
+                   (unsigned long long)us);
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+//
+// End-to-end write latency on the simulated EEPROM for several write-cycle times: back-to-back page writes
+// that wait for the write cycle by acknowledge polling (eeprom_wait_ready, what the firmware does) compared
+// with a fixed sleep after every write (5 ms, what it did before, and the 10 ms datasheet worst case).
+// Also checks that the write-cycle time eeprom_get_ready_stats reports matches the model.
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o ready_latency ready_latency.c sim/eeprom_sim.c ../eeprom.c ../crc.c
+// ./ready_latency
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "eeprom_sim.h"
+
+#define WRITES 32
+#define WRITE_LEN 16 // a few records, one device page
+#define OLD_SLEEP_US 5000 // sleep after every write before acknowledge polling
+#define RATE 400000
+
+static int failures;
+
+// WRITES writes, then a read that has to wait for the last write cycle, returns the total time in us
+static uint64_t run(uint32_t write_cycle_us, uint32_t sleep_after_us, uint32_t * retries)
+{
+    static uint8_t data[WRITE_LEN];
+    static uint8_t back[WRITE_LEN];
+    sim_config config = { .geometry = EEPROM_24LC256(1), .write_cycle_us = write_cycle_us, .poll_ns = 500 };
+    sim_init(&config);
+    eeprom_set_rate(RATE);
+
+    uint64_t start = sim_time_ns();
+    for (int i = 0; i < WRITES; ++i)
+    {
+        memset(data, i, sizeof(data));
+        if (!i2c_write(data, 0X40 + i * 64, sizeof(data)))
+        {
+            printf("FAIL: write %d not acknowledged\n", i);
+            ++failures;
+        }
+        if (sleep_after_us) sleep_us(sleep_after_us);
+    }
+    i2c_read(back, 0X40 + (WRITES - 1) * 64, sizeof(back));
+    uint64_t total_us = (sim_time_ns() - start) / 1000;
+    if (back[0] != (uint8_t)(WRITES - 1))
+    {
+        printf("FAIL: read back %02X\n", back[0]);
+        ++failures;
+    }
+    *retries = sim_get_stats()->nacks;
+    return total_us;
+}
+
+int main(void)
+{
+    const uint32_t cycles[] = { 1500, 3000, 5000, 8000 };
+    sim_config config = { .geometry = EEPROM_24LC256(1), .write_cycle_us = 5000, .poll_ns = 500 };
+    sim_init(&config);
+    eeprom_init(&config.geometry);
+
+    printf("%d writes of %d bytes at %d Hz, then a read of the last one. Time per write in us.\n", WRITES, WRITE_LEN, RATE);
+    printf("%8s %10s %8s %10s %10s %8s %12s\n", "tWC us", "polling", "nacks", "sleep 5ms", "sleep 10ms", "saved",
+           "measured tWC");
+    for (size_t i = 0; i < sizeof(cycles) / sizeof(cycles[0]); ++i)
+    {
+        uint32_t nacks;
+        uint32_t ignored;
+        eeprom_ready_stats before = *eeprom_get_ready_stats();
+        uint64_t polling = run(cycles[i], 0, &nacks);
+        const eeprom_ready_stats * after = eeprom_get_ready_stats();
+        uint32_t waits = after->waits - before.waits;
+        uint32_t measured = waits ? (uint32_t)((after->total_us - before.total_us) / waits) : 0;
+        uint64_t old_sleep = run(cycles[i], OLD_SLEEP_US, &ignored);
+        uint64_t worst = run(cycles[i], WRITE_CYCLE_MAX_US, &ignored);
+
+        // every write waited for by polling, never reported shorter than the model, and longer only by the
+        // probe that got through (a 1 byte read, 5 bytes on the bus) plus the refused one before it
+        uint32_t probe_us = (uint32_t)((6 * 9 + 4) * 1000000ULL / RATE) + 10;
+        if (waits != WRITES || measured < cycles[i] || measured > cycles[i] + probe_us)
+        {
+            printf("FAIL tWC %lu: %lu waits, measured %lu us\n", (unsigned long)cycles[i], (unsigned long)waits,
+                   (unsigned long)measured);
+            ++failures;
+        }
+        printf("%8lu %10llu %8lu %10llu %10llu %7.0f%% %12lu\n", (unsigned long)cycles[i],
+               (unsigned long long)(polling / WRITES), (unsigned long)nacks, (unsigned long long)(old_sleep / WRITES),
+               (unsigned long long)(worst / WRITES), 100.0 * (double)(worst - polling) / (double)worst,
+               (unsigned long)measured);
+    }
+    printf("%s\n", failures ? "FAILED" : "write cycle waits match the model");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+//
+// Sequence numbers across erases and reboots on the simulated EEPROM. Boot is replayed from the EEPROM
+// alone the way boot_scan_state does it (epoch record, then the binary search for the newest page), with
+// reboots right after an erase while the log is still empty, erases back to back, and an erase whose epoch
+// write is cut by a power loss. A page sequence number may never be used in two epochs, and an epoch
+// record written by the old firmware, without a sequence number, must still be read.
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o seq_test seq_test.c sim/eeprom_sim.c sim/log_boot.c ../log_page.c ../eeprom.c ../log_index.c ../log_record.c ../crc.c
+// ./seq_test
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "eeprom_sim.h"
+#include "log_page.h"
+#include "log_index.h"
+#include "log_boot.h"
+#include "crc.h"
+
+#define MAX_SEQ 4096
+
+static log_page page;
+static uint16_t owner[MAX_SEQ]; // epoch + 1 of the log a page sequence number went to, 0 if unused
+static int failures;
+
+static void claim(const char * step)
+{
+    if (page.seq >= MAX_SEQ) return;
+    if (owner[page.seq] && owner[page.seq] != page.epoch + 1)
+    {
+        printf("FAIL %s: page %lu used in epoch %u and epoch %u\n", step, (unsigned long)page.seq, owner[page.seq] - 1,
+               page.epoch);
+        ++failures;
+    }
+    owner[page.seq] = page.epoch + 1;
+}
+
+static void boot(const char * step)
+{
+    log_index_clear();
+    if (!read_epoch(&page.epoch, &page.seq)) ++failures;
+    log_search search;
+    sim_boot_search(&page, &search);
+    printf("%-28s epoch %3u, %s, page %lu\n", step, page.epoch, search.lo ? "log found" : "empty log ",
+           (unsigned long)page.seq);
+    claim(step);
+}
+
+static void append_pages(const char * step, int pages)
+{
+    uint32_t end = page.seq + pages;
+    while (page.seq < end)
+    {
+        log_event_append(&page, REC_TEST, NULL, 0);
+        claim(step);
+    }
+    while (!page_flush(&page)) eeprom_poll();
+    sim_drain();
+}
+
+static void erase(const char * step)
+{
+    if (!log_erase(&page)) ++failures;
+    claim(step);
+}
+
+int main(void)
+{
+    sim_config config = { .geometry = EEPROM_24LC256(1), .write_cycle_us = 5000, .poll_ns = 500 };
+    sim_init(&config);
+    eeprom_init(&config.geometry);
+
+    boot("new part");
+    append_pages("first log", 5);
+    boot("reboot");
+    erase("erase");
+    boot("reboot after the erase");
+    boot("and again");
+    append_pages("second log", 2);
+    boot("reboot");
+    erase("erase");
+    erase("erase again");
+    boot("reboot after two erases");
+    append_pages("third log", 3);
+
+    // the epoch write is cut: the old epoch and its log are still there, numbering goes on from its pages
+    uint16_t epoch = page.epoch;
+    sim_cut_after(2);
+    log_erase(&page);
+    sim_power_on();
+    boot("reboot after a cut erase");
+    if (page.epoch != epoch)
+    {
+        printf("FAIL: epoch %u after a cut erase, expected %u\n", page.epoch, epoch);
+        ++failures;
+    }
+    append_pages("log after the cut", 2);
+    erase("erase");
+    boot("reboot after the erase");
+
+    // epoch record of the old firmware: epoch and CRC only, the log starts from 0 as it used to
+    sim_init(&config);
+    uint8_t old[EPOCH_REC_LEN];
+    epoch_encode(old, 9, 0);
+    uint16_t crc = calculate_crc(old, EPOCH_LEN);
+    old[EPOCH_LEN] = (uint8_t)(crc >> 8);
+    old[EPOCH_LEN + 1] = (uint8_t)crc;
+    i2c_write(old, epoch_address(9), EPOCH_OLD_REC_LEN);
+    memset(owner, 0, sizeof(owner));
+    boot("old epoch record");
+    if (page.epoch != 9 || page.seq != 0)
+    {
+        printf("FAIL: old epoch record read as epoch %u page %lu\n", page.epoch, (unsigned long)page.seq);
+        ++failures;
+    }
+    printf("%s\n", failures ? "FAILED" : "no page sequence number was used twice");
+    return failures ? 1 : 0;
+}
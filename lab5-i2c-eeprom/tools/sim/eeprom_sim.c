@@ -0,0 +1,334 @@
+//
+// The model sits behind the DMA channel that feeds IC_DATA_CMD: when it is started, the command words
+// are decoded into one bus transaction (device address from TAR, memory address, data or read commands)
+// and the transaction is carried out at once. What the controller would show while it runs (the stop and
+// abort flags, the busy RX channel) only appears once the simulated clock has passed its end.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eeprom_sim.h"
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+
+#define SIM_CHANNELS 12
+#define SIM_MAX_CHIPS 8
+#define SIM_CORRUPT 0X10 // bit flipped in bytes read too fast
+
+struct i2c_inst {
+    i2c_hw_t hw;
+};
+
+static struct i2c_inst i2c1_inst;
+i2c_inst_t * const i2c1 = &i2c1_inst;
+
+typedef struct sim_channel {
+    bool claimed;
+    volatile uint8_t * write_addr; // RX channel: where read data goes
+    uint32_t count;
+    bool aborted;
+} sim_channel;
+
+static sim_config cfg;
+static sim_stats stats;
+static uint8_t * memory;
+static uint32_t * wear;
+static uint32_t * page_wear;
+static uint64_t now_ns;
+static uint32_t rate = SIM_DEFAULT_RATE;
+static uint64_t busy_until[SIM_MAX_CHIPS]; // write cycle end per chip
+static uint64_t end_ns; // end of the transaction on the bus
+static bool nack;
+static int rx_channel = -1; // channel of the transaction on the bus
+static sim_channel channels[SIM_CHANNELS];
+static long cut_after = -1;
+static bool write_protect;
+static bool power_lost;
+
+void sim_init(const sim_config * config)
+{
+    cfg = *config;
+    uint32_t size = cfg.geometry.capacity * cfg.geometry.chips;
+    free(memory);
+    free(wear);
+    free(page_wear);
+    memory = malloc(size);
+    wear = calloc(size, sizeof(*wear));
+    page_wear = calloc(size / cfg.geometry.page_size, sizeof(*page_wear));
+    memset(memory, 0XFF, size); // erased EEPROM cells
+    memset(busy_until, 0, sizeof(busy_until));
+    memset(&i2c1_inst.hw, 0, sizeof(i2c1_inst.hw));
+    end_ns = now_ns;
+    nack = false;
+    cut_after = -1;
+    power_lost = false;
+    write_protect = false;
+    rate = SIM_DEFAULT_RATE;
+    sim_clear_stats();
+}
+
+uint8_t * sim_memory(void)
+{
+    return memory;
+}
+
+uint32_t * sim_wear(void)
+{
+    return wear;
+}
+
+uint32_t * sim_page_wear(void)
+{
+    return page_wear;
+}
+
+const sim_stats * sim_get_stats(void)
+{
+    return &stats;
+}
+
+void sim_clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sim_write_protect(bool on)
+{
+    write_protect = on;
+}
+
+void sim_cut_after(long bytes)
+{
+    cut_after = bytes;
+}
+
+bool sim_power_lost(void)
+{
+    return power_lost;
+}
+
+void sim_power_on(void)
+{
+    power_lost = false;
+    cut_after = -1;
+}
+
+void sim_drain(void)
+{
+    while (eeprom_busy()) eeprom_poll();
+}
+
+uint64_t sim_time_ns(void)
+{
+    return now_ns;
+}
+
+void sim_advance_us(uint64_t us)
+{
+    now_ns += us * 1000;
+}
+
+static uint64_t bus_time_ns(uint32_t bytes)
+{
+    // 9 clocks per byte (8 bits and the acknowledge), plus start and stop
+    return ((uint64_t)bytes * 9 + 2) * 1000000000ULL / rate;
+}
+
+static bool decode_target(uint32_t tar, uint32_t * chip, uint32_t * block)
+{
+    // same address layout eeprom.c builds, tried for every chip and block the geometry has
+    const eeprom_geometry * g = &cfg.geometry;
+    uint32_t blocks = g->addr_bytes < 4 ? g->capacity >> (8 * g->addr_bytes) : 1;
+    if (blocks == 0) blocks = 1;
+    for (uint32_t c = 0; c < g->chips; ++c)
+    {
+        for (uint32_t b = 0; b < blocks; ++b)
+        {
+            if (tar == (EEPROM_DEVICE_ADDR | c << g->cs_shift | b << g->block_shift))
+            {
+                *chip = c;
+                *block = b;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void transaction(const uint16_t * words, uint count)
+{
+    const eeprom_geometry * g = &cfg.geometry;
+    uint32_t chip;
+    uint32_t block;
+
+    ++stats.transactions;
+    i2c1_inst.hw.raw_intr_stat = 0;
+    nack = power_lost || !decode_target(i2c1_inst.hw.tar, &chip, &block) || now_ns < busy_until[chip];
+    if (nack || count < g->addr_bytes)
+    {
+        nack = true;
+        ++stats.nacks;
+        end_ns = now_ns + bus_time_ns(1); // aborted after the device address
+        stats.bus_ns += end_ns - now_ns;
+        return;
+    }
+
+    uint32_t offset = 0;
+    for (int i = 0; i < g->addr_bytes; ++i) offset = offset << 8 | (words[i] & 0xFF); // high byte first
+    offset = (block << (8 * g->addr_bytes) | offset) & (g->capacity - 1);
+    uint32_t base = chip * g->capacity;
+    uint32_t n = count - g->addr_bytes;
+    const uint16_t * data = &words[g->addr_bytes];
+
+    if (data[0] & I2C_IC_DATA_CMD_CMD_BITS)
+    {
+        // random read: sequential bytes from offset, rolling over inside the part the address reaches
+        uint32_t reach = g->addr_bytes < 4 && g->capacity > 1UL << (8 * g->addr_bytes) ? 1UL << (8 * g->addr_bytes) : g->capacity;
+        uint32_t first = offset - offset % reach;
+        sim_channel * rx = rx_channel >= 0 ? &channels[rx_channel] : NULL;
+        for (uint32_t i = 0; i < n && rx && i < rx->count; ++i)
+        {
+            uint8_t byte = memory[base + first + (offset - first + i) % reach];
+            if (cfg.max_hz && rate > cfg.max_hz && i % 5 == 2) byte ^= SIM_CORRUPT; // too fast for the part
+            rx->write_addr[i] = byte;
+        }
+        ++stats.reads;
+        stats.read_bytes += n;
+        end_ns = now_ns + bus_time_ns(1 + g->addr_bytes + 1 + n);
+    }
+    else
+    {
+        // page write: the address counter wraps inside the page
+        uint32_t page = offset - offset % g->page_size;
+        for (uint32_t i = 0; i < n && !write_protect; ++i)
+        {
+            uint32_t address = base + page + (offset - page + i) % g->page_size;
+            if (cut_after == 0)
+            {
+                memory[address] = (uint8_t)rand(); // half programmed cell, then nothing more
+                ++wear[address];
+                power_lost = true;
+                cut_after = -1;
+                break;
+            }
+            if (cut_after > 0) --cut_after;
+            memory[address] = (uint8_t)data[i];
+            ++wear[address];
+        }
+        ++page_wear[(base + page) / g->page_size];
+        ++stats.writes;
+        stats.write_bytes += n;
+        end_ns = now_ns + bus_time_ns(1 + g->addr_bytes + n);
+        busy_until[chip] = end_ns + (uint64_t)cfg.write_cycle_us * 1000;
+        rx_channel = -1; // nothing to receive
+    }
+    stats.bus_ns += end_ns - now_ns;
+}
+
+i2c_hw_t * i2c_get_hw(i2c_inst_t * i2c)
+{
+    now_ns += cfg.poll_ns;
+    if (now_ns >= end_ns && i2c->hw.raw_intr_stat == 0)
+        i2c->hw.raw_intr_stat = I2C_IC_RAW_INTR_STAT_STOP_DET_BITS | (nack ? I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS : 0);
+    return &i2c->hw;
+}
+
+uint i2c_get_dreq(i2c_inst_t * i2c, bool is_tx)
+{
+    (void)i2c;
+    return is_tx ? 0 : 1;
+}
+
+uint i2c_set_baudrate(i2c_inst_t * i2c, uint baudrate)
+{
+    (void)i2c;
+    rate = baudrate;
+    return rate;
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (int i = 0; i < SIM_CHANNELS; ++i)
+    {
+        if (!channels[i].claimed)
+        {
+            channels[i].claimed = true;
+            return i;
+        }
+    }
+    if (required)
+    {
+        fprintf(stderr, "sim: no free DMA channel\n");
+        exit(1);
+    }
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    (void)channel;
+    dma_channel_config c = { 0 };
+    return c;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config * c, enum dma_channel_transfer_size size) { (void)c; (void)size; }
+void channel_config_set_read_increment(dma_channel_config * c, bool incr) { (void)c; (void)incr; }
+void channel_config_set_write_increment(dma_channel_config * c, bool incr) { (void)c; (void)incr; }
+void channel_config_set_dreq(dma_channel_config * c, uint dreq) { (void)c; (void)dreq; }
+
+void dma_channel_configure(uint channel, const dma_channel_config * config, volatile void * write_addr,
+                           const volatile void * read_addr, uint transfer_count, bool trigger)
+{
+    (void)config;
+    (void)trigger;
+    if (write_addr == &i2c1_inst.hw.data_cmd)
+    {
+        transaction((const uint16_t *)read_addr, transfer_count);
+        return;
+    }
+    channels[channel].write_addr = write_addr; // configured before the TX channel starts the transaction
+    channels[channel].count = transfer_count;
+    channels[channel].aborted = false;
+    rx_channel = (int)channel;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    return (int)channel == rx_channel && !channels[channel].aborted && now_ns < end_ns;
+}
+
+void dma_channel_abort(uint channel)
+{
+    channels[channel].aborted = true;
+}
+
+uint64_t time_us_64(void)
+{
+    return now_ns / 1000;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)(now_ns / 1000);
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us)
+{
+    return now_ns / 1000 + us;
+}
+
+bool time_reached(absolute_time_t t)
+{
+    return now_ns / 1000 >= t;
+}
+
+void sleep_us(uint64_t us)
+{
+    now_ns += us * 1000;
+}
+
+void sleep_ms(uint32_t ms)
+{
+    now_ns += (uint64_t)ms * 1000000;
+}
@@ -0,0 +1,52 @@
+//
+// Host model of 24xx EEPROMs on the Pico I2C controller, for running eeprom.c and the log code off target.
+// Time is simulated: bus transactions take their bit time at the set clock, every poll of the controller
+// costs poll_ns of CPU time, and sleeps just move the clock. A chip does not acknowledge while its
+// write cycle runs. Every byte written is counted per cell, and a power cut can be injected after
+// any number of written bytes.
+//
+
+#ifndef EEPROM_SIM_H
+#define EEPROM_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "eeprom.h"
+
+#define SIM_DEFAULT_RATE 100000 // clock before eeprom_set_rate, like i2c_init(i2c1, 100000)
+
+typedef struct sim_config {
+    eeprom_geometry geometry;
+    uint32_t write_cycle_us; // internal write cycle after every write transaction
+    uint32_t max_hz; // reads come back corrupted above this clock, 0 for no limit
+    uint32_t poll_ns; // CPU time one poll of the controller costs
+} sim_config;
+
+typedef struct sim_stats {
+    uint32_t transactions; // every start condition, probes included
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t nacks; // address not acknowledged: write cycle running, no such chip or power lost
+    uint64_t read_bytes; // data bytes, addresses not included
+    uint64_t write_bytes;
+    uint64_t bus_ns; // time the bus was busy
+} sim_stats;
+
+void sim_init(const sim_config * config); // memory reads 0xFF, wear and stats start from 0
+uint8_t * sim_memory(void); // linear over all chips, like eeprom.c addresses
+uint32_t * sim_wear(void); // write cycles seen by each byte
+uint32_t * sim_page_wear(void); // write cycles seen by each device page
+const sim_stats * sim_get_stats(void);
+void sim_clear_stats(void);
+
+void sim_write_protect(bool on); // writes are acknowledged but not stored, like a part with WP tied high
+void sim_cut_after(long bytes); // power fails while writing the byte after this many more, -1 never
+bool sim_power_lost(void); // every transaction is refused until sim_power_on
+void sim_power_on(void);
+
+void sim_drain(void); // polls the EEPROM queue until every request in it has finished
+
+uint64_t sim_time_ns(void);
+void sim_advance_us(uint64_t us); // CPU busy with something else
+
+#endif //EEPROM_SIM_H
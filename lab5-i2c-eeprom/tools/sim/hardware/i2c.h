@@ -0,0 +1,33 @@
+//
+// Host stand-in for hardware/i2c.h: the registers eeprom.c touches, backed by eeprom_sim.c.
+//
+
+#ifndef SIM_HARDWARE_I2C_H
+#define SIM_HARDWARE_I2C_H
+
+#include "pico/stdlib.h"
+
+typedef struct i2c_inst i2c_inst_t;
+extern i2c_inst_t * const i2c1;
+
+typedef struct {
+    volatile uint32_t enable;
+    volatile uint32_t tar;
+    volatile uint32_t data_cmd;
+    volatile uint32_t raw_intr_stat;
+    volatile uint32_t clr_intr;
+    volatile uint32_t clr_tx_abrt;
+    volatile uint32_t clr_stop_det;
+} i2c_hw_t;
+
+#define I2C_IC_DATA_CMD_CMD_BITS 0X100u
+#define I2C_IC_DATA_CMD_STOP_BITS 0X200u
+#define I2C_IC_DATA_CMD_RESTART_BITS 0X400u
+#define I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS 0X40u
+#define I2C_IC_RAW_INTR_STAT_STOP_DET_BITS 0X200u
+
+i2c_hw_t * i2c_get_hw(i2c_inst_t * i2c); // every call is one poll of the controller and moves time on
+uint i2c_get_dreq(i2c_inst_t * i2c, bool is_tx);
+uint i2c_set_baudrate(i2c_inst_t * i2c, uint baudrate);
+
+#endif //SIM_HARDWARE_I2C_H
@@ -0,0 +1,28 @@
+//
+// Pages are read with i2c_read, one at a time, as the board reads them through the queue.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log_boot.h"
+
+void sim_boot_search(log_page * page, log_search * search)
+{
+    uint8_t buffer[LOG_MEM_SIZE];
+    log_search_start(search, LOG_SLOTS);
+    bool more;
+    do
+    {
+        bool ok = i2c_read(buffer, FIRST_MEM_ADDR + search->slot * LOG_MEM_SIZE, LOG_MEM_SIZE);
+        uint32_t lo = search->lo;
+        more = log_search_step(search, ok ? buffer : NULL, page->epoch);
+        if (search->failed >= EPOCH_READ_TRIES) // the board stalls here until the EEPROM answers
+        {
+            fprintf(stderr, "sim: boot search stalled, the EEPROM does not answer\n");
+            exit(1);
+        }
+        if (search->lo != lo) memcpy(page->data, buffer, LOG_MEM_SIZE); // the last page found this way is the newest one
+    } while (more);
+    page_resume(page, search);
+}
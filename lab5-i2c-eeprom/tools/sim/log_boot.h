@@ -0,0 +1,14 @@
+//
+// Boot of the log on the host model, the way boot_scan_state does it on the board: the search for the
+// newest page page by page from the EEPROM, then page_resume. Blocking, the tools have nothing else to run.
+//
+
+#ifndef LOG_BOOT_H
+#define LOG_BOOT_H
+
+#include "log_page.h"
+
+// page->epoch and page->seq as read_epoch left them, search is left as the search ended (lo 0: empty log)
+void sim_boot_search(log_page * page, log_search * search);
+
+#endif //LOG_BOOT_H
@@ -0,0 +1,23 @@
+//
+// Host stand-in for the parts of pico/stdlib.h that eeprom.c and the log code use.
+// Time is simulated, see eeprom_sim.h.
+//
+
+#ifndef SIM_PICO_STDLIB_H
+#define SIM_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+absolute_time_t make_timeout_time_us(uint64_t us);
+bool time_reached(absolute_time_t t);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+#endif //SIM_PICO_STDLIB_H
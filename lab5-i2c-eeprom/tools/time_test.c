@@ -0,0 +1,118 @@
+//
+// Record timestamps on the simulated EEPROM. Records carrying their true append time as data are written
+// at random gaps over laps of the ring with erases in between, then every valid page is decoded on its own,
+// starting from an unknown clock, the way a boot index window or a partly overwritten log is. Each record
+// must come out at the time it was appended, in the RAM index as well.
+//
+// gcc -std=gnu11 -Wall -Isim -I.. -o time_test time_test.c sim/eeprom_sim.c ../log_page.c ../eeprom.c ../log_index.c ../log_record.c ../crc.c
+// ./time_test
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eeprom_sim.h"
+#include "log_page.h"
+#include "log_index.h"
+
+#define LAPS 3
+#define UNKNOWN_CLOCK 123456789 // whatever the decoder had before the page
+
+static log_page page;
+static int failures;
+
+static uint32_t expected_ms(const log_event * event)
+{
+    return (uint32_t)event->data[0] << 24 | (uint32_t)event->data[1] << 16 | (uint32_t)event->data[2] << 8 | event->data[3];
+}
+
+static void append(void)
+{
+    uint32_t now_ms = (uint32_t)(time_us_64() / 1000);
+    uint8_t data[4] = { (uint8_t)(now_ms >> 24), (uint8_t)(now_ms >> 16), (uint8_t)(now_ms >> 8), (uint8_t)now_ms };
+    log_event_append(&page, REC_TEST, data, sizeof(data));
+    while (!page_flush(&page)) eeprom_poll();
+    while (eeprom_busy()) eeprom_poll();
+}
+
+static uint32_t check_pages(const char * name)
+{
+    uint32_t records = 0;
+    for (uint32_t address = FIRST_MEM_ADDR; address <= LAST_MEM_ADDR; address += LOG_MEM_SIZE)
+    {
+        const uint8_t * data = &sim_memory()[address];
+        int offset = PAGE_HDR_LEN;
+        int size;
+        uint32_t clock_ms = UNKNOWN_CLOCK;
+        if (!validate_page(data, page.epoch)) continue;
+        while ((size = page_next_record(data, &offset, NULL)) > 0)
+        {
+            log_event event;
+            const uint8_t * payload = &data[offset + 1];
+            if (!record_clock(payload, data[offset], &clock_ms) || !record_decode(payload, data[offset], &event) ||
+                clock_ms != expected_ms(&event))
+            {
+                if (failures < 10) printf("FAIL %s: page 0X%04lX offset %d decoded at %lu ms\n", name,
+                                          (unsigned long)address, offset, (unsigned long)clock_ms);
+                ++failures;
+            }
+            ++records;
+            offset += size;
+        }
+    }
+    for (int i = 0; i < log_index_count(); ++i)
+    {
+        const log_index_entry * entry = log_index_get(i);
+        log_event event;
+        const uint8_t * payload = &sim_memory()[entry->address + 1];
+        if (!record_decode(payload, entry->len, &event) || entry->time_ms != expected_ms(&event) || entry->type != REC_TEST)
+        {
+            if (failures < 10) printf("FAIL %s: index entry %d at %lu ms\n", name, i, (unsigned long)entry->time_ms);
+            ++failures;
+        }
+    }
+    return records;
+}
+
+static void run(const char * name, const sim_config * config)
+{
+    sim_init(config);
+    eeprom_init(&config->geometry);
+    log_index_clear();
+    page.epoch = 0;
+    page_start(&page, FIRST_MEM_ADDR, 0);
+    sim_advance_us(5000000); // some uptime before the first record
+    uint32_t records = 0;
+
+    for (int lap = 0; lap < LAPS; ++lap)
+    {
+        // a lap and a half of the ring, then an erase in the middle of a page
+        uint32_t end_seq = page.seq + LOG_SLOTS + LOG_SLOTS / 2;
+        while (page.seq < end_seq)
+        {
+            sim_advance_us(1000 * (1 + rand() % (rand() % 8 ? 2000 : 200000)));
+            append();
+        }
+        records += check_pages(name);
+        if (!log_erase(&page)) ++failures;
+        for (int i = 0; i < 3; ++i)
+        {
+            sim_advance_us(1000 * (1 + rand() % 5000));
+            append();
+        }
+        records += check_pages(name);
+    }
+    printf("%-8s %5lu slots: %lu records decoded page by page, %d index entries.\n", name, (unsigned long)LOG_SLOTS,
+           (unsigned long)records, log_index_count());
+}
+
+int main(void)
+{
+    sim_config small = { .geometry = EEPROM_24LC16, .write_cycle_us = 5000, .poll_ns = 500 };
+    sim_config large = { .geometry = EEPROM_24LC256(1), .write_cycle_us = 5000, .poll_ns = 500 };
+    srand(3);
+    run("24LC16", &small);
+    run("24LC256", &large);
+    printf("%s\n", failures ? "FAILED" : "every record decoded at its append time");
+    return failures ? 1 : 0;
+}